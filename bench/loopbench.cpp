@@ -0,0 +1,141 @@
+// measures the loops of test/testForLoop.alien and test/testControlFlow.alien
+// on the stack machine, with -O and on the register machine. the script is
+// interpreted, so -O sees the calls of main and infers the types as it
+// does for a script run by alien. the two arithmetic loops are the same,
+// but -O only knows the types of the one always called with numbers, it's
+// emitted with the typed instructions and the other one is quickened.
+// usage: loopbench
+#include <vm.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace alien;
+
+namespace {
+
+const char* kScript = R"(
+func count(n) {
+    var sum = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        sum = sum + i;
+    }
+    return sum;
+}
+
+func countDown(n) {
+    var sum = 0;
+    for (var i = n; i > 0; i = i - 1.5) {
+        sum = sum + i;
+    }
+    return sum;
+}
+
+func nested(n) {
+    var sum = 0;
+    for (var i = 0; i <= n; i = 1 + i) {
+        for (var j = i; j > 0; j = j - 1) {
+            sum = sum + i * 10 + j;
+        }
+    }
+    return sum;
+}
+
+func countWhile(n) {
+    var a = 0;
+    var b;
+    while (a < n) {
+        b = a = a + 1;
+    }
+    return b;
+}
+
+func typed(n, a, k) {
+    var x = a;
+    for (var i = 0; i < n; i = i + 1) {
+        x = x * k + a - i / k;
+    }
+    return x;
+}
+
+func quickened(n, a, k) {
+    var x = a;
+    for (var i = 0; i < n; i = i + 1) {
+        x = x * k + a - i / k;
+    }
+    return x;
+}
+
+func main() {
+    quickened(0, nil, nil);
+    for (var run = 0; run < 3; run = run + 1) {
+        var start = clock();
+        count(3000000);
+        report("for     ", (clock() - start) / 3000000);
+        start = clock();
+        countDown(4500000);
+        report("for down", (clock() - start) / 3000000);
+        start = clock();
+        nested(2500);
+        report("nested  ", (clock() - start) / 3126250);
+        start = clock();
+        countWhile(3000000);
+        report("while   ", (clock() - start) / 3000000);
+        start = clock();
+        typed(3000000, 1, 0.5);
+        report("typed   ", (clock() - start) / 3000000);
+        start = clock();
+        quickened(3000000, 1, 0.5);
+        report("quick   ", (clock() - start) / 3000000);
+    }
+}
+)";
+
+// the best seconds per iteration of each loop, by machine.
+std::map<std::string, std::map<std::string, double>> results;
+std::string machine;
+
+bool report(Vm& vm, NativeArgs args, Value& result) {
+  auto name = std::get_if<std::string>(&args[0]);
+  auto seconds = std::get_if<double>(&args[1]);
+  if (!name || !seconds) {
+    return false;
+  }
+  auto best = results[*name].emplace(machine, *seconds).first;
+  if (*seconds < best->second) {
+    best->second = *seconds;
+  }
+  return true;
+}
+
+bool run(const char* name, const Options& options) {
+  machine = name;
+  Vm vm(options);
+  vm.defineNative("report", report, 2);
+  return vm.interpret(kScript) == INTERPRET_OK;
+}
+
+} // namespace
+
+int main() {
+  Options plain;
+  Options optimized;
+  optimized.optimize = true;
+  Options registers;
+  registers.registers = true;
+  if (!run("stack", plain) || !run("-O", optimized) || !run("register", registers)) {
+    return 1;
+  }
+  std::cout << "ns per iteration  stack     -O  register\n";
+  for (auto& [loop, times] : results) {
+    std::cout << loop;
+    for (const char* name : {"stack", "-O", "register"}) {
+      std::cout.width(name == std::string("stack") ? 15 : 7);
+      std::cout.precision(3);
+      std::cout << times[name] * 1e9;
+    }
+    std::cout << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+// measures the throughput of the lexer and the parser on expression-heavy code,
+// and the memory of running a script of many small methods with and without
+// --lazy-parse.
+// usage: parsebench [file], a generated source is used without a file.
+#include <vm.h>
+#include <lexer.h>
+#include <parser.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+using namespace alien;
+
+namespace {
+
+std::string generate() {
+  std::ostringstream os;
+  for (int i = 0; i < 200; i++) {
+    os << "func f" << i << "(a, b, c) {\n";
+    for (int j = 0; j < 500; j++) {
+      os << "    a = (a + " << j << ") * b - c / (b + 1) > " << j
+         << " and !(c <= a) or f" << i << "(a.x, -b, c.y.z) == nil;\n";
+    }
+    os << "    return a;\n}\n";
+  }
+  return os.str();
+}
+
+// a class of 3000 small methods, every one of them is called.
+std::string generateMethods() {
+  const int kMethods = 3000;
+  // a chunk has at most 256 constants, the calls are split into functions.
+  const int kCallsPerFunction = 50;
+  std::ostringstream os;
+  os << "class Big {\n";
+  for (int i = 0; i < kMethods; i++) {
+    os << "    func m" << i << "(a, b) {\n"
+       << "        var c = a * " << i << " + b;\n"
+       << "        if (c > 10) {\n"
+       << "            return c - a;\n"
+       << "        }\n"
+       << "        return c + " << i << ";\n"
+       << "    }\n";
+  }
+  os << "}\n";
+  for (int i = 0; i < kMethods / kCallsPerFunction; i++) {
+    os << "func call" << i << "(big) {\n    var sum = 0;\n";
+    for (int j = i * kCallsPerFunction; j < (i + 1) * kCallsPerFunction; j++) {
+      os << "    sum = sum + big.m" << j << "(1, 2);\n";
+    }
+    os << "    return sum;\n}\n";
+  }
+  os << "func main() {\n    var big = Big();\n";
+  for (int i = 0; i < kMethods / kCallsPerFunction; i++) {
+    os << "    call" << i << "(big);\n";
+  }
+  os << "}\n";
+  return os.str();
+}
+
+// the max RSS in MB of running `source` in a child process, so that every
+// run starts from the same heap. 0 when it fails.
+double maxRss(const std::string& source, const Options& options) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    Vm vm(options);
+    _exit(vm.interpret(source) == INTERPRET_OK ? 0 : 1);
+  }
+  int status;
+  rusage usage;
+  if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss / double(1 << 20);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// the best MB/s of `run` over a few runs, `run` fails with false.
+template <typename F>
+double measure(const std::string& source, F run) {
+  const int kRuns = 5;
+  double best = 0;
+  for (int i = 0; i < kRuns; i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (!run()) {
+      return 0;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::max(best, source.size() / elapsed.count() / (1 << 20));
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+  // before the large source is generated, the children share this heap.
+  std::string methods = generateMethods();
+  Options lazy;
+  lazy.lazyParse = true;
+  double eagerRss = maxRss(methods, Options());
+  double lazyRss = maxRss(methods, lazy);
+  if (eagerRss == 0 || lazyRss == 0) {
+    return 1;
+  }
+  std::string source;
+  if (argc > 1) {
+    std::ifstream in(argv[1]);
+    source.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  } else {
+    source = generate();
+  }
+  double lex = measure(source, [&]() {
+    Lexer lexer(source);
+    for (;;) {
+      auto token = lexer.nextToken();
+      if (token.type_ == TOKEN_ERROR) return false;
+      if (token.type_ == TOKEN_EOF) return true;
+    }
+  });
+  double parse = measure(source, [&]() {
+    Parser parser(source);
+    auto program = parser.parse();
+    return !parser.hadError();
+  });
+  if (lex == 0 || parse == 0) {
+    return 1;
+  }
+  std::cout << source.size() / (1 << 20) << " MB, lex " << lex
+            << " MB/s, parse " << parse << " MB/s\n";
+  std::cout << "3000 methods, max rss " << eagerRss << " MB, --lazy-parse "
+            << lazyRss << " MB\n";
+  return 0;
+}
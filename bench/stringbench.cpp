@@ -0,0 +1,78 @@
+// measures building a string by `s = s + piece` in a loop, on the stack
+// machine, with -O and on the register machine. the time per piece stays
+// the same as the string grows when it's appended in place.
+// usage: stringbench
+#include <vm.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace alien;
+
+namespace {
+
+const char* kScript = R"(
+func build(n) {
+    var s = "";
+    for (var i = 0; i < n; i = i + 1) {
+        s = s + "piece";
+    }
+    return len(s);
+}
+
+func main() {
+}
+)";
+
+// the best ns per piece of a few runs, 0 when it fails.
+double measure(Vm& vm, const Value& build, double pieces) {
+  const int kRuns = 3;
+  double best = 0;
+  for (int i = 0; i < kRuns; i++) {
+    Value result;
+    auto start = std::chrono::steady_clock::now();
+    if (vm.call(build, {Value(pieces)}, result) != INTERPRET_OK) {
+      return 0;
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    double perPiece = elapsed.count() / pieces;
+    if (best == 0 || perPiece < best) {
+      best = perPiece;
+    }
+  }
+  return best;
+}
+
+bool run(const char* name, const Options& options) {
+  Vm vm(options);
+  auto script = vm.compile(kScript);
+  Value build;
+  if (!script || vm.execute(script) != INTERPRET_OK || !vm.getGlobal("build", build)) {
+    return false;
+  }
+  std::cout << name;
+  for (double pieces = 50000; pieces <= 800000; pieces *= 4) {
+    double time = measure(vm, build, pieces);
+    if (time == 0) {
+      return false;
+    }
+    std::cout << "  " << pieces << ": " << time << " ns";
+  }
+  std::cout << '\n';
+  return true;
+}
+
+} // namespace
+
+int main() {
+  Options plain;
+  Options optimized;
+  optimized.optimize = true;
+  Options registers;
+  registers.registers = true;
+  if (!run("stack   ", plain) || !run("-O      ", optimized) || !run("register", registers)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef ALIEN_ARENA_H
+#define ALIEN_ARENA_H
+
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <cstddef>
+
+namespace alien {
+
+// allocates the nodes of a syntax tree one after another in large blocks,
+// the nodes parsed together sit together and are freed all at once.
+// the nodes must be destroyed before their arena, see NodeDeleter.
+class Arena {
+public:
+  static const size_t kBlockSize = 64 * 1024;
+  // the first block holds `firstBlock` bytes, every next one twice the
+  // previous up to kBlockSize, so a small tree doesn't take a whole block.
+  explicit Arena(size_t firstBlock = kBlockSize);
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  template <typename T>
+  T* make() {
+    return new (allocate(sizeof(T), alignof(T))) T();
+  }
+private:
+  void* allocate(size_t size, size_t align);
+private:
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t nextSize_;
+  size_t size_ = 0;
+  size_t used_ = 0;
+};
+
+}
+
+#endif //ALIEN_ARENA_H
@@ -7,9 +7,11 @@
 
 #include <token.h>
 #include <typedef.h>
+#include <arena.h>
 
 #include <iostream>
 #include <memory>
+#include <string_view>
 #include <vector>
 
 namespace alien {
@@ -39,6 +41,10 @@ class Number;
 class String;
 class Literal;
 class This;
+class Array;
+class Map;
+class Index;
+class IndexSet;
 
 class ExprVisitor;
 class StmtVisitor;
@@ -48,6 +54,7 @@ public:
   enum ExprType {
     VARIABLE,
     GET,
+    INDEX,
     OTHER
   };
   virtual void accept(ExprVisitor &visitor) = 0;
@@ -74,6 +81,10 @@ public:
   virtual void visit(String& expr) = 0;
   virtual void visit(Literal& expr) = 0;
   virtual void visit(This& expr) = 0;
+  virtual void visit(Array& expr) = 0;
+  virtual void visit(Map& expr) = 0;
+  virtual void visit(Index& expr) = 0;
+  virtual void visit(IndexSet& expr) = 0;
   virtual ~ExprVisitor() = default;
 };
 
@@ -220,6 +231,55 @@ public:
   void trace(std::ostream& os) const override;
 };
 
+// [a, b, c]
+class Array : public Expr {
+public:
+  void accept(ExprVisitor& visitor) override {
+    visitor.visit(*this);
+  }
+  void trace(std::ostream& os) const override;
+
+  std::vector<ExprPtr> elements;
+};
+
+// {key: value, ...}
+class Map : public Expr {
+public:
+  void accept(ExprVisitor& visitor) override {
+    visitor.visit(*this);
+  }
+  void trace(std::ostream& os) const override;
+
+  std::vector<ExprPtr> keys;
+  std::vector<ExprPtr> values;
+};
+
+// object[index]
+class Index : public Expr {
+public:
+  void accept(ExprVisitor& visitor) override {
+    visitor.visit(*this);
+  }
+  void trace(std::ostream& os) const override;
+  ExprType getType() const override { return INDEX; }
+
+  ExprPtr object;
+  ExprPtr index;
+};
+
+// object[index] = value
+class IndexSet : public Expr {
+public:
+  void accept(ExprVisitor& visitor) override {
+    visitor.visit(*this);
+  }
+  void trace(std::ostream& os) const override;
+
+  ExprPtr object;
+  ExprPtr index;
+  ExprPtr value;
+};
+
 class Stmt {
 public:
   virtual void accept(StmtVisitor &visitor) = 0;
@@ -265,7 +325,16 @@ public:
 
   Token name;
   std::vector<Token> parameters;
+  // the nodes of a body parsed on its own, destroyed after them.
+  std::unique_ptr<Arena> arena;
+  // null while the pre-parser has only skipped the body, `source`
+  // then spans it from the first token after '{' to the '}'.
   StmtPtr body;
+  std::string_view source;
+  int line = 0;
+  // the names the skipped body assigns and the properties it sets.
+  std::vector<std::string_view> assigned;
+  std::vector<std::string_view> setProperties;
 };
 
 class VarDecl : public Stmt {
@@ -366,6 +435,44 @@ public:
   ExprPtr expr;
 };
 
+// walks every node of a tree, analysis passes override
+// the nodes they are interested in and call the base to keep walking.
+class AstWalker : public StmtVisitor, public ExprVisitor {
+public:
+  void visit(ClassDecl &decl) override;
+  void visit(FuncDecl &decl) override;
+  void visit(VarDecl &decl) override;
+  void visit(ConstDecl &decl) override;
+  void visit(BlockStmt &stmt) override;
+  void visit(IfStmt &stmt) override;
+  void visit(WhileStmt &stmt) override;
+  void visit(ForStmt &stmt) override;
+  void visit(PrintStmt &stmt) override;
+  void visit(ReturnStmt &stmt) override;
+  void visit(ExprStmt &stmt) override;
+  void visit(Assign& expr) override;
+  void visit(Binary& expr) override;
+  void visit(Call& expr) override;
+  void visit(Get& expr) override;
+  void visit(Grouping& expr) override;
+  void visit(Set& expr) override;
+  void visit(Unary& expr) override;
+  void visit(Variable& expr) override;
+  void visit(Logical& expr) override;
+  void visit(Number& expr) override;
+  void visit(String& expr) override;
+  void visit(Literal& expr) override;
+  void visit(This& expr) override;
+  void visit(Array& expr) override;
+  void visit(Map& expr) override;
+  void visit(Index& expr) override;
+  void visit(IndexSet& expr) override;
+};
+
+// whether a subtree assigns to the variable `name`.
+bool isAssigned(std::string_view name, Stmt& stmt);
+bool isAssigned(std::string_view name, Expr& expr);
+
 }
 
 #endif //ALIEN_AST_H
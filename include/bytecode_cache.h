@@ -0,0 +1,124 @@
+#ifndef ALIEN_BYTECODE_CACHE_H
+#define ALIEN_BYTECODE_CACHE_H
+
+#include <object.h>
+#include <source_file.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdint>
+
+namespace alien {
+
+class Vm;
+
+// a cache file is an image of the compiled script and every function and
+// class it references, only used for the source and the flags it was
+// compiled from. it's mapped read-only and the code runs in place, so the
+// pages are shared between the processes. a function copies its code out
+// of the image when the vm first quickens an instruction of it. the
+// constants are read from the pool when they're loaded, only the objects
+// are created on the heap. an image whose checksum doesn't match, or whose
+// code doesn't verify, is a miss.
+//
+// a snapshot is the same image of the heap after the top-level code has
+// run, the globals and every object they reach, instances included.
+//
+// the layout, with every offset from the start of the file:
+//
+//   CacheHeader
+//   CacheObject[objects]
+//   ImageConstant[...]        the pools of the functions, the receivers
+//                             and the elements of the arrays and maps
+//   CacheField[...]           methods, fields of instances and globals
+//   bytes                     names, strings and code
+constexpr uint32_t kCacheVersion = 10;
+
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t hash;
+  // the fnv-1a of everything after the header.
+  uint64_t checksum;
+  uint64_t size;
+  uint32_t flags;
+  uint32_t objects;
+  // the script of a cache.
+  uint32_t root;
+  // the globals of a snapshot.
+  uint32_t globals;
+  uint32_t globalTable;
+  uint32_t padding;
+};
+
+enum CacheKind : uint32_t {
+  CACHE_FUNCTION,
+  CACHE_CLASS,
+  CACHE_INSTANCE,
+  CACHE_BOUND_METHOD,
+  // only the name, it's bound to the native of the vm it's loaded into.
+  CACHE_NATIVE,
+  CACHE_ARRAY,
+  CACHE_MAP,
+  // the doubles are in the bytes, `code` and `codeSize` in bytes.
+  CACHE_FLOAT64_ARRAY,
+  // the text a slice views in the bytes, it's loaded as a root.
+  CACHE_SLICE,
+};
+
+struct CacheObject {
+  CacheKind kind;
+  // the arity of a function, the class of an instance or the method
+  // of a bound method.
+  uint32_t index;
+  uint32_t name;
+  uint32_t nameSize;
+  // the code of a function, the methods of a class or the fields of
+  // an instance.
+  uint32_t code;
+  uint32_t codeSize;
+  // the pool of a function, the receiver of a bound method, the
+  // elements of an array or the keys and values of a map.
+  uint32_t pool;
+  uint32_t constants;
+};
+
+struct CacheField {
+  uint32_t name;
+  uint32_t nameSize;
+  ImageConstant value;
+};
+
+// a loaded cache, the chunks of its functions point into it.
+struct CacheImage {
+  SourceFile file;
+  std::vector<Obj*> objects;
+};
+
+// the compiler switches a cache is specific to.
+uint8_t cacheFlags(const Options& options);
+
+// the script of `path` if it's been compiled from `source` with `flags`,
+// nullptr otherwise. the objects are added to `vm`, `image` has to live
+// as long as them.
+ObjFunction* readCache(const std::string& path, std::string_view source,
+                       uint8_t flags, Vm& vm, CacheImage& image);
+
+// false when `script` can't be written to `path`, every function has
+// to be compiled.
+bool writeCache(const std::string& path, std::string_view source,
+                uint8_t flags, ObjFunction* script);
+
+// like readCache, but the heap of the snapshot is restored into `globals`.
+bool readSnapshot(const std::string& path, std::string_view source, uint8_t flags,
+                  Vm& vm, CacheImage& image, std::unordered_map<std::string, Value>& globals);
+
+bool writeSnapshot(const std::string& path, std::string_view source, uint8_t flags,
+                   const std::unordered_map<std::string, Value>& globals);
+
+}
+
+#endif //ALIEN_BYTECODE_CACHE_H
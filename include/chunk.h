@@ -10,6 +10,7 @@
 #include <vector>
 #include <ostream>
 
+#include <cstddef>
 #include <cstdint>
 
 namespace alien {
@@ -33,14 +34,26 @@ enum OpCode : uint8_t {
   OP_NOT,
   OP_NEGATE,
   OP_CALL,
+  // a call in tail position, always followed by OP_RETURN.
+  OP_TAIL_CALL,
   OP_RETURN,
 
   OP_GET_LOCAL,
   OP_SET_LOCAL,
+  // adds the value on the stack to the local in place and pops it,
+  // for `s = s + e;` as a statement.
+  OP_APPEND_LOCAL,
   OP_GET_GLOBAL,
   OP_SET_GLOBAL,
   OP_GET_PROPERTY,
   OP_SET_PROPERTY,
+  // creates an array of the elements on the stack, the operand is their count.
+  OP_ARRAY,
+  // creates a map of the keys and values on the stack, the operand is the
+  // count of the pairs.
+  OP_MAP,
+  OP_GET_INDEX,
+  OP_SET_INDEX,
 
   OP_DEFINE_GLOBAL,
 
@@ -48,14 +61,105 @@ enum OpCode : uint8_t {
   OP_JUMP,
   OP_JUMP_IF_FALSE,
   OP_JUMP_IF_TRUE,
+  // counted loops, see Compiler::compileCountedLoop.
+  OP_FOR_PREP,
+  OP_FOR_LOOP,
 
   OP_POP,
+
+  // quickened instructions, never emitted by the compiler.
+  // the generic ones rewrite themselves into these after the
+  // first execution and are restored when the guard fails.
+  OP_ADD_NUM,
+  OP_ADD_STR,
+  OP_SUBTRACT_NUM,
+  OP_MULTIPLY_NUM,
+  OP_DIVIDE_NUM,
+  OP_GREATER_NUM,
+  OP_LESS_NUM,
+
+  // typed instructions, emitted when the operands are proven
+  // to be numbers (see ir_types.h), they don't check anything.
+  OP_ADD_DOUBLE,
+  OP_SUBTRACT_DOUBLE,
+  OP_MULTIPLY_DOUBLE,
+  OP_DIVIDE_DOUBLE,
+  OP_GREATER_DOUBLE,
+  OP_LESS_DOUBLE,
+  OP_NEGATE_DOUBLE,
+};
+
+// the comparison of a counted loop, stored as an operand of OP_FOR_*.
+enum ForCompare : uint8_t {
+  FOR_LESS,
+  FOR_LESS_EQUAL,
+  FOR_GREATER,
+  FOR_GREATER_EQUAL,
+};
+
+// a constant in the pool of a mapped image, see bytecode_cache.h.
+enum ImageTag : uint32_t {
+  IMAGE_NIL,
+  IMAGE_FALSE,
+  IMAGE_TRUE,
+  IMAGE_NUMBER,
+  IMAGE_STRING,
+  IMAGE_OBJ,
+};
+
+struct ImageConstant {
+  ImageTag tag;
+  // the size of a string.
+  uint32_t size;
+  // the bits of a number, the offset of a string in the image
+  // or the index of an object of the image.
+  uint64_t payload;
+};
+
+Value imageValue(const ImageConstant& constant, const char* image, Obj* const* objects);
+
+// the parts of an image a chunk executes in place.
+struct ImageChunk {
+  const OpCode* code = nullptr;
+  size_t size = 0;
+  const ImageConstant* pool = nullptr;
+  size_t constants = 0;
+  const char* image = nullptr;
+  Obj* const* objects = nullptr;
 };
 
 class Chunk {
 public:
   void write(OpCode byte) { code_.push_back(byte); }
-  Value getConstant(int index) { return constants_[index]; }
+  Value getConstant(int index) {
+    if (image_.pool) {
+      return imageValue(image_.pool[index], image_.image, image_.objects);
+    }
+    return constants_[index];
+  }
+  // the code being executed.
+  const OpCode* instructions() const { return image_.code ? image_.code : code_.data(); }
+  // quickening rewrites the code in place. the image is mapped read-only
+  // and shared, the code of a chunk is copied out of it the first time.
+  void rewrite(size_t offset, OpCode code) {
+    if (image_.code) {
+      code_.assign(image_.code, image_.code + image_.size);
+      image_.code = nullptr;
+    }
+    code_[offset] = code;
+  }
+  // runs the code of an image in place and reads its constants from the pool.
+  void mapImage(const ImageChunk& image) { image_ = image; }
+  // calls `f` with every object among the constants.
+  template <typename F>
+  void forEachObj(F f) {
+    for (const auto& value : constants_) {
+      if (std::holds_alternative<Obj*>(value)) f(std::get<Obj*>(value));
+    }
+    for (size_t i = 0; i < image_.constants; i++) {
+      if (image_.pool[i].tag == IMAGE_OBJ) f(image_.objects[image_.pool[i].payload]);
+    }
+  }
   int addConstant(const Value& value);
   void disassemble(std::ostream& os = std::cout);
   void disassembleInstruction(int i, std::ostream& os = std::cout);
@@ -68,6 +172,7 @@ private:
   // which line does this bytecode
   // belongs to in source code.
   std::vector<Value> constants_;
+  ImageChunk image_;
 };
 
 }
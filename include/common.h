@@ -1,6 +1,8 @@
 #ifndef ALIEN_COMMON_H
 #define ALIEN_COMMON_H
 
+#include <string>
+
 namespace alien {
 
 enum ExitCode {
@@ -8,6 +10,28 @@ enum ExitCode {
   EX_UNAVAILABLE = 69,
 };
 
+// command line switches of the interpreter.
+struct Options {
+  // compile functions through the ssa ir.
+  bool optimize = false;
+  // print the ir of every function after each pass.
+  bool dumpIr = false;
+  // print the inferred types of every function.
+  bool dumpTypes = false;
+  // compile to and run the register machine instead of the stack machine.
+  bool registers = false;
+  // only brace-match the function bodies, parse them when they're compiled.
+  bool lazyParse = false;
+  // the number of threads compiling the function bodies.
+  int jobs = 1;
+  // the compiled script is loaded from and saved to this file, see
+  // bytecode_cache.h. empty when there's no cache.
+  std::string cacheFile;
+  // the heap after the top-level code is restored from and saved to
+  // this file, `main` is called after that. see bytecode_cache.h.
+  std::string snapshotFile;
+};
+
 }
 
 #endif
\ No newline at end of file
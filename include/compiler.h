@@ -9,9 +9,14 @@
 #include <vm.h>
 #include <chunk.h>
 #include <object.h>
+#include <ir.h>
+#include <ir_types.h>
 
+#include <memory>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace alien {
 
@@ -19,7 +24,8 @@ class Compiler : public StmtVisitor, public ExprVisitor {
 public:
   explicit Compiler(Vm& vm)
   : vm_(vm), currentChunk_(&globalChunk_) {}
-  ObjFunction* compile(std::vector<StmtPtr>& stmts);
+  // the script calls `main` after the top-level code unless `callMain` is false.
+  ObjFunction* compile(std::vector<StmtPtr>& stmts, bool callMain = true);
   void visit(ClassDecl &decl) override;
   void visit(FuncDecl &decl) override;
   void visit(VarDecl &decl) override;
@@ -44,10 +50,48 @@ public:
   void visit(String& expr) override;
   void visit(Literal& expr) override;
   void visit(This& expr) override;
+  void visit(Array& expr) override;
+  void visit(Map& expr) override;
+  void visit(Index& expr) override;
+  void visit(IndexSet& expr) override;
   bool hadError() { return hadError_; }
+  // without the ast kept alive, nothing can be left as a stub.
+  void setLazy(bool lazy) { lazy_ = lazy; }
+  // the host may call and reassign every global, so nothing is assumed
+  // about the functions: none is inlined or has its signature inferred.
+  void setOpen(bool open) { open_ = open; }
+  // compiles a function left as a stub, false on a compile error.
+  bool compileLazily(ObjFunction* func);
 private:
+  void compileFunction(FuncDecl& decl, Chunk& chunk);
+  // compiles every body up front on `jobs` threads.
+  void compileInParallel(std::vector<StmtPtr>& stmts, int jobs);
+  // creates the class and finds its methods which can be inlined.
+  ObjClass* declareClass(ClassDecl& decl);
+  bool isInitializerDecl(FuncDecl& decl) const;
   void fixJump(int offset);
   void emitLoop(int loopStart);
+  void emitCall(Call& expr, bool tail);
+  bool compileCountedLoop(ForStmt& stmt);
+  bool compileAppend(Expr& expr);
+  // collects what inlining and the ir need to know about the whole program.
+  void analyzeProgram(std::vector<StmtPtr>& stmts);
+  // compiles the function through the ir, false if it can't.
+  bool compileOptimized(FuncDecl& decl, Chunk& chunk);
+
+private:
+  // calls to small functions and methods are replaced by their bodies,
+  // the arguments are substituted for the parameters.
+  struct InlineFrame {
+    FuncDecl* decl;
+    std::vector<ExprPtr>* arguments;
+    // `this` of an inlined method, nullptr for functions.
+    Expr* receiver;
+  };
+  bool inlineCall(Call& expr);
+  bool isSimpleArgument(Expr& arg, std::vector<ExprPtr>& arguments);
+  int  inlineParameter(std::string_view name);
+  void emitArgument(Expr& arg);
 
 private:
   struct Local {
@@ -66,6 +110,8 @@ private:
   ObjClass* currentClass_ = nullptr;
   bool isInitializer = false;
   bool hadError_ = false;
+  bool lazy_ = true;
+  bool open_ = false;
   int depth_ = 0;
   Vm& vm_;
   Chunk globalChunk_;
@@ -75,6 +121,31 @@ private:
   // the first slot is for `this` or the function's name.
   // remember to clear it when begin to compile a function or method.
   std::vector<Local> locals_;
+
+  // global functions which are defined once and never assigned.
+  std::unordered_map<std::string_view, FuncDecl*> inlineFunctions_;
+  // methods of the class being compiled no property shadows.
+  std::unordered_map<std::string_view, FuncDecl*> inlineMethods_;
+  std::unordered_set<std::string_view> setProperties_;
+  // reading one of these may bind a new method object.
+  std::unordered_set<std::string_view> methodNames_;
+  std::vector<InlineFrame> inlineFrames_;
+
+  // -O builds the global functions before compiling anything,
+  // the types of their parameters depend on each other.
+  std::unordered_map<FuncDecl*, std::unique_ptr<IrFunction>> irFunctions_;
+  Signatures signatures_;
+
+  // functions are compiled on their first call, the ast outlives the run.
+  struct LazyFunction {
+    FuncDecl* decl;
+    ObjClass* klass;
+  };
+  std::unordered_map<ObjFunction*, LazyFunction> lazyFunctions_;
+  std::unordered_map<ObjClass*, std::unordered_map<std::string_view, FuncDecl*>> classInlineMethods_;
+  // what the parallel compilation made before the declarations are visited.
+  std::unordered_map<ClassDecl*, ObjClass*> declaredClasses_;
+  std::unordered_map<FuncDecl*, Chunk> compiledChunks_;
 };
 
 }
@@ -0,0 +1,136 @@
+#ifndef ALIEN_IR_H
+#define ALIEN_IR_H
+
+#include <value.h>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+namespace alien {
+
+// a mid-level ssa ir, built per function between the ast and the bytecode.
+// every local variable is resolved to ssa values, the rest of the
+// language (globals, properties, calls) stays as explicit instructions.
+enum IrOp : uint8_t {
+  IR_PARAM,
+  IR_CONSTANT,
+  IR_COPY,
+  IR_PHI,
+
+  IR_ADD,
+  IR_SUBTRACT,
+  IR_MULTIPLY,
+  IR_DIVIDE,
+  IR_EQUAL,
+  IR_GREATER,
+  IR_LESS,
+  IR_NOT,
+  IR_NEGATE,
+
+  IR_GET_GLOBAL,
+  IR_SET_GLOBAL,
+  IR_GET_PROPERTY,
+  IR_SET_PROPERTY,
+  IR_ARRAY,
+  IR_MAP,
+  IR_GET_INDEX,
+  IR_SET_INDEX,
+  IR_CALL,
+  IR_PRINT,
+
+  // terminators, always the last instruction of a block.
+  IR_JUMP,
+  IR_BRANCH,
+  IR_RETURN,
+};
+
+class IrBlock;
+
+class IrInstr {
+public:
+  IrInstr(IrOp op, int id)
+  : op(op), id(id) {}
+  bool isTerminator() const;
+  // whether it may run into a runtime error,
+  // depends on what we know about the operands.
+  bool canTrap() const;
+  // can't be removed or reordered with other effects.
+  bool hasSideEffects() const;
+  // pure instructions are candidates of cse and licm.
+  bool isPure() const;
+  // reads a global or a property, its value depends on the stores before it.
+  bool isLoad() const { return op == IR_GET_GLOBAL || op == IR_GET_PROPERTY; }
+  // leaves a value on the stack of the vm.
+  bool producesValue() const;
+  void print(std::ostream& os) const;
+
+  IrOp op;
+  int id;
+  IrBlock* block = nullptr;
+  // for phis they are in the same order as the predecessors.
+  std::vector<IrInstr*> operands;
+  // IR_CONSTANT.
+  Value constant;
+  // IR_PARAM, the slot in the frame.
+  int slot = 0;
+  // the name of a global or a property.
+  std::string name;
+};
+
+class IrBlock {
+public:
+  explicit IrBlock(int id)
+  : id(id) {}
+  IrInstr* terminator() const;
+  int predIndex(IrBlock* pred) const;
+
+  int id;
+  std::vector<IrInstr*> phis;
+  std::vector<IrInstr*> instrs;
+  std::vector<IrBlock*> preds;
+  // IR_BRANCH jumps to succs[0] when the condition is truthy.
+  std::vector<IrBlock*> succs;
+  // filled by IrFunction::computeDominators.
+  IrBlock* idom = nullptr;
+  int order = -1;
+};
+
+class IrFunction {
+public:
+  IrFunction(std::string name, int arity)
+  : name(std::move(name)), arity(arity) {}
+  IrBlock* newBlock();
+  IrInstr* newInstr(IrOp op);
+  void addEdge(IrBlock* from, IrBlock* to);
+  // splits every edge from a block with several successors
+  // to a block with several predecessors.
+  void splitCriticalEdges();
+  void removeUnreachableBlocks();
+  void replaceAllUses(IrInstr* from, IrInstr* to);
+  void removeInstr(IrInstr* instr);
+  // reachable blocks in reverse postorder, the first
+  // successor of a block is laid out first.
+  std::vector<IrBlock*> reversePostorder();
+  void computeDominators();
+  bool dominates(IrBlock* a, IrBlock* b) const;
+  void dump(std::ostream& os);
+
+  std::string name;
+  int arity;
+  bool isMethod = false;
+  bool isInitializer = false;
+  IrBlock* entry = nullptr;
+  std::vector<std::unique_ptr<IrBlock>> blocks;
+private:
+  std::vector<std::unique_ptr<IrInstr>> instrs_;
+};
+
+std::ostream& operator<<(std::ostream& os, IrOp op);
+
+}
+
+#endif //ALIEN_IR_H
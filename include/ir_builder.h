@@ -0,0 +1,97 @@
+#ifndef ALIEN_IR_BUILDER_H
+#define ALIEN_IR_BUILDER_H
+
+#include <ast.h>
+#include <ir.h>
+
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace alien {
+
+// builds the ssa form of a function straight from the ast,
+// "Simple and Efficient Construction of Static Single Assignment Form",
+// Braun et al. trivial phis are left to the copy propagation.
+class IrBuilder : public StmtVisitor, public ExprVisitor {
+public:
+  // returns nullptr if the function can't be expressed in the ir,
+  // the compiler falls back to the bytecode generator then.
+  std::unique_ptr<IrFunction> build(FuncDecl& decl, bool isMethod);
+  void visit(ClassDecl &decl) override;
+  void visit(FuncDecl &decl) override;
+  void visit(VarDecl &decl) override;
+  void visit(ConstDecl &decl) override;
+  void visit(BlockStmt &stmts) override;
+  void visit(IfStmt &stmt) override;
+  void visit(WhileStmt &stmt) override;
+  void visit(ForStmt &stmt) override;
+  void visit(PrintStmt &stmt) override;
+  void visit(ReturnStmt &stmt) override;
+  void visit(ExprStmt&stmt) override;
+  void visit(Assign& expr) override;
+  void visit(Binary& expr) override;
+  void visit(Call& expr) override;
+  void visit(Get& expr) override;
+  void visit(Grouping& expr) override;
+  void visit(Set& expr) override;
+  void visit(Unary& expr) override;
+  void visit(Variable& expr) override;
+  void visit(Logical& expr) override;
+  void visit(Number& expr) override;
+  void visit(String& expr) override;
+  void visit(Literal& expr) override;
+  void visit(This& expr) override;
+  void visit(Array& expr) override;
+  void visit(Map& expr) override;
+  void visit(Index& expr) override;
+  void visit(IndexSet& expr) override;
+
+private:
+  IrInstr* expr(Expr& expr);
+  IrInstr* emit(IrOp op, std::vector<IrInstr*> operands = {});
+  IrInstr* constant(const Value& value);
+  void jump(IrBlock* target);
+  void branch(IrInstr* condition, IrBlock* ifTrue, IrBlock* ifFalse);
+  // the condition of a rotated loop, it's evaluated before the
+  // first iteration and again at the end of every iteration.
+  void loop(Expr* condition, Stmt& body, Expr* increment);
+
+private:
+  struct Local {
+    int depth;
+    std::string_view name;
+    int variable;
+  };
+  void addLocal(std::string_view name);
+  int  resolveLocal(std::string_view name);
+  void beginScope();
+  void endScope();
+
+private:
+  void writeVariable(int variable, IrBlock* block, IrInstr* value);
+  IrInstr* readVariable(int variable, IrBlock* block);
+  IrInstr* readVariableRecursive(int variable, IrBlock* block);
+  void addPhiOperands(int variable, IrInstr* phi);
+  IrInstr* newPhi(IrBlock* block);
+  void sealBlock(IrBlock* block);
+
+private:
+  std::unique_ptr<IrFunction> func_;
+  IrBlock* block_ = nullptr;
+  // the value of the last visited expression.
+  IrInstr* value_ = nullptr;
+  bool failed_ = false;
+  int depth_ = 0;
+  int variables_ = 0;
+  std::vector<Local> locals_;
+  std::unordered_map<IrBlock*, std::unordered_map<int, IrInstr*>> definitions_;
+  std::unordered_map<IrBlock*, std::vector<std::pair<int, IrInstr*>>> incompletePhis_;
+  std::unordered_set<IrBlock*> sealed_;
+};
+
+}
+
+#endif //ALIEN_IR_BUILDER_H
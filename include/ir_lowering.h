@@ -0,0 +1,19 @@
+#ifndef ALIEN_IR_LOWERING_H
+#define ALIEN_IR_LOWERING_H
+
+#include <ir.h>
+#include <ir_types.h>
+#include <chunk.h>
+
+namespace alien {
+
+// generates the bytecode of a function from its ssa form.
+// the copies must have been propagated. returns false if the function
+// doesn't fit in the one-byte operands (slots, constants and jumps),
+// the chunk is left in an unspecified state then.
+// arithmetic on operands `types` proves to be numbers uses the typed opcodes.
+bool lowerToChunk(IrFunction& func, Chunk& chunk, const TypeMap& types);
+
+}
+
+#endif //ALIEN_IR_LOWERING_H
@@ -0,0 +1,37 @@
+#ifndef ALIEN_IR_PASSES_H
+#define ALIEN_IR_PASSES_H
+
+#include <ir.h>
+
+#include <ostream>
+#include <string_view>
+#include <unordered_set>
+
+namespace alien {
+
+// replaces copies and trivial phis with their operands.
+void propagateCopies(IrFunction& func);
+// dominator-based value numbering of pure instructions.
+void eliminateCommonSubexpressions(IrFunction& func);
+// reuses the result of a load or the value of a store for later loads
+// of the same global or property in a basic block.
+// reading a method binds a new object each time, `methods` are left alone.
+void eliminateRedundantLoads(IrFunction& func,
+                             const std::unordered_set<std::string_view>& methods);
+// moves loop-invariant pure instructions, and loads
+// no store or call in the loop may change, to the loop preheader.
+void hoistLoopInvariants(IrFunction& func,
+                         const std::unordered_set<std::string_view>& methods);
+// removes instructions whose values are never used
+// and which can neither trap nor have side effects.
+void eliminateDeadCode(IrFunction& func);
+
+// runs the passes above, dumps the ir after
+// each of them when `dump` is not nullptr.
+void optimize(IrFunction& func,
+              const std::unordered_set<std::string_view>& methods,
+              std::ostream* dump = nullptr);
+
+}
+
+#endif //ALIEN_IR_PASSES_H
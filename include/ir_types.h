@@ -0,0 +1,76 @@
+#ifndef ALIEN_IR_TYPES_H
+#define ALIEN_IR_TYPES_H
+
+#include <ir.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace alien {
+
+// the set of types a value may have at runtime. an empty set
+// means the value is never computed, its instruction is unreachable
+// or always runs into an error.
+enum TypeBits : uint8_t {
+  TYPE_NONE   = 0,
+  TYPE_NIL    = 1 << 0,
+  TYPE_BOOL   = 1 << 1,
+  TYPE_NUMBER = 1 << 2,
+  TYPE_STRING = 1 << 3,
+  TYPE_OBJECT = 1 << 4,
+  TYPE_ANY    = 0x1f,
+};
+using Type = uint8_t;
+
+using TypeMap = std::unordered_map<const IrInstr*, Type>;
+
+// e.g. number|string.
+std::string typeName(Type type);
+
+// what the calls of a global function need to know.
+struct Signature {
+  std::vector<Type> parameters;
+  // the union of what it returns.
+  Type result = TYPE_NONE;
+};
+using Signatures = std::unordered_map<std::string, Signature>;
+
+// the types of the values of a function, `parameters` doesn't include the first slot.
+// ssa values never change, so this is flow-sensitive for the locals.
+// direct calls to the functions in `signatures` return their result type.
+TypeMap inferTypes(IrFunction& func, const std::vector<Type>& parameters,
+                   const Signatures* signatures = nullptr);
+
+// the name of the global function a call goes to, empty if it's unknown.
+// a function calls itself through its first slot.
+std::string directCallee(const IrFunction& func, const IrInstr* call);
+
+// counts the references of `func` to the global functions, a function called
+// through a local is counted once. the functions a reference doesn't
+// only call may be called from anywhere, they are `escaped`.
+void countReferences(const IrFunction& func,
+                     std::unordered_map<std::string, int>& references,
+                     std::unordered_set<std::string>& escaped);
+
+// the signatures of `stable` functions, whose names always refer to them.
+// the parameters of the `closed` ones, which are only ever called directly
+// by the functions in `funcs`, come from their calls, the others may take anything.
+Signatures inferSignatures(const std::vector<IrFunction*>& funcs,
+                           const std::unordered_set<std::string>& stable,
+                           const std::unordered_set<std::string>& closed);
+
+// whether an arithmetic instruction only ever sees numbers,
+// it needs no type checks then.
+bool isNumberOp(const IrInstr* instr, const TypeMap& types);
+
+// prints every value with its types,
+// and why an arithmetic instruction isn't specialised.
+void dumpTypes(IrFunction& func, const TypeMap& types, std::ostream& os);
+
+}
+
+#endif //ALIEN_IR_TYPES_H
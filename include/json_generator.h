@@ -39,6 +39,10 @@ public:
   void visit(String& expr) override;
   void visit(Literal& expr) override;
   void visit(This& expr) override;
+  void visit(Array& expr) override;
+  void visit(Map& expr) override;
+  void visit(Index& expr) override;
+  void visit(IndexSet& expr) override;
   
 private:
   void push() { jLevel_.push(jCurrent_); }
@@ -8,15 +8,17 @@
 #include <token.h>
 
 #include <string_view>
-#include <unordered_map>
 
 namespace alien {
 
 class Lexer {
 public:
-  explicit Lexer(std::string_view source)
-  : source_(source) {}
+  explicit Lexer(std::string_view source, int line = 1)
+  : source_(source), line_(line) {}
   Token nextToken();
+  // where the last token starts in the source.
+  int tokenStart() const { return tokenStart_; }
+  std::string_view source() const { return source_; }
 
 private:
   Token identifier();
@@ -34,7 +36,6 @@ private:
   void skipWhitespace();
 private:
   std::string_view source_;
-  static std::unordered_map<std::string_view, TokenType> keywords_;
 
   int pos_ = 0;
   int tokenStart_ = 0;
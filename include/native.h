@@ -0,0 +1,13 @@
+#ifndef ALIEN_NATIVE_H
+#define ALIEN_NATIVE_H
+
+namespace alien {
+
+class Vm;
+
+// defines the natives every vm starts with.
+void defineBuiltins(Vm& vm);
+
+}
+
+#endif //ALIEN_NATIVE_H
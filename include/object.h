@@ -7,11 +7,15 @@
 
 #include <value.h>
 #include <chunk.h>
+#include <register_chunk.h>
+#include <table.h>
 #include <common.h>
 
 #include <string>
+#include <string_view>
 #include <ostream>
 #include <unordered_map>
+#include <vector>
 
 namespace alien {
 
@@ -20,12 +24,23 @@ enum ObjType {
   OBJ_FUNCTION,
   OBJ_INSTANCE,
   OBJ_BOUND_METHOD,
+  OBJ_NATIVE,
+  OBJ_ARRAY,
+  OBJ_MAP,
+  OBJ_FLOAT64_ARRAY,
+  OBJ_SLICE,
 };
 
 class ObjFunction;
 class ObjClass;
 class ObjInstance;
 class ObjBoundMethod;
+class ObjNative;
+class ObjArray;
+class ObjMap;
+class ObjFloat64Array;
+class ObjSlice;
+class Vm;
 // runtime objects
 class Obj {
 public:
@@ -44,6 +59,11 @@ public:
   virtual ObjClass*    asClass() { return nullptr; }
   virtual ObjInstance* asInstance() { return nullptr; }
   virtual ObjBoundMethod* asBoundMethod() { return nullptr; }
+  virtual ObjNative*   asNative() { return nullptr; }
+  virtual ObjArray*    asArray() { return nullptr; }
+  virtual ObjMap*      asMap() { return nullptr; }
+  virtual ObjFloat64Array* asFloat64Array() { return nullptr; }
+  virtual ObjSlice*    asSlice() { return nullptr; }
 private:
   ObjType type_;
   bool isMarked_;
@@ -54,6 +74,13 @@ public:
   explicit ObjFunction(std::string name, Chunk chunk, int arity)
   : Obj(OBJ_FUNCTION), name_(std::move(name)),
     chunk_(std::move(chunk)), arity_(arity) {}
+  // a stub, the chunk is compiled on the first call.
+  ObjFunction(std::string name, int arity)
+  : Obj(OBJ_FUNCTION), name_(std::move(name)), arity_(arity), isCompiled_(false) {}
+  // a function of the register machine.
+  ObjFunction(std::string name, RegisterChunk chunk, int arity)
+  : Obj(OBJ_FUNCTION), name_(std::move(name)),
+    registerChunk_(std::move(chunk)), arity_(arity) {}
   ~ObjFunction() override = default;
   void mark() override {
     if (isMarked()) {
@@ -64,7 +91,8 @@ public:
     std::cout << "mark function " << name_ << "\n";
 #endif
     // we have global functions in the global chunk.
-    for (const auto& value : chunk_.constants()) {
+    chunk_.forEachObj([](Obj* obj) { obj->mark(); });
+    for (const auto& value : registerChunk_.constants()) {
       if (std::holds_alternative<Obj*>(value)) {
         AS_OBJ(value)->mark();
       }
@@ -73,13 +101,22 @@ public:
   void print(std::ostream& os) override {
     os << "[func] " << name_;
   }
+  const std::string& name() const { return name_; }
   int          arity() { return arity_; }
   Chunk&       chunk() { return chunk_; }
+  RegisterChunk& registerChunk() { return registerChunk_; }
+  bool         isCompiled() const { return isCompiled_; }
+  void setChunk(Chunk chunk) {
+    chunk_ = std::move(chunk);
+    isCompiled_ = true;
+  }
   ObjFunction* asFunction() override { return this; }
 private:
   std::string name_;
   Chunk chunk_;
+  RegisterChunk registerChunk_;
   int arity_;
+  bool isCompiled_ = true;
 };
 
 
@@ -114,6 +151,8 @@ public:
     os << "[class] " << name_;
   }
   ObjClass* asClass() override { return this; }
+  const std::string& name() const { return name_; }
+  const std::unordered_map<std::string, ObjFunction*>& methods() const { return methods_; }
 private:
   std::string name_;
   std::unordered_map<std::string, ObjFunction*> methods_;
@@ -136,6 +175,7 @@ public:
   void setField(const std::string& name, const Value& value) {
     fields_[name] = value;
   }
+  const std::unordered_map<std::string, Value>& fields() const { return fields_; }
   void mark() override {
     if (isMarked()) {
       return;
@@ -189,6 +229,205 @@ public:
   Value receiver_;
 };
 
+// the elements are stored contiguously, an append only allocates
+// when the buffer has to grow.
+class ObjArray : public Obj {
+public:
+  ObjArray()
+  : Obj(OBJ_ARRAY) {}
+  explicit ObjArray(std::vector<Value> elements)
+  : Obj(OBJ_ARRAY), elements_(std::move(elements)) {}
+  ~ObjArray() override = default;
+  ObjArray* asArray() override { return this; }
+  std::vector<Value>& elements() { return elements_; }
+  void mark() override {
+    if (isMarked()) {
+      return;
+    }
+    Obj::mark();
+#ifdef DEBUG_GC
+    std::cout << "mark array\n";
+#endif
+    for (const auto& value : elements_) {
+      if (std::holds_alternative<Obj*>(value)) {
+        AS_OBJ(value)->mark();
+      }
+    }
+  }
+  void print(std::ostream& os) override {
+    // an array may contain itself.
+    if (printing_) {
+      os << "[...]";
+      return;
+    }
+    printing_ = true;
+    os << '[';
+    for (size_t i = 0; i < elements_.size(); i++) {
+      if (i > 0) {
+        os << ", ";
+      }
+      printValue(elements_[i], os);
+    }
+    os << ']';
+    printing_ = false;
+  }
+private:
+  std::vector<Value> elements_;
+  bool printing_ = false;
+};
+
+class ObjMap : public Obj {
+public:
+  ObjMap()
+  : Obj(OBJ_MAP) {}
+  ~ObjMap() override = default;
+  ObjMap* asMap() override { return this; }
+  Table& table() { return table_; }
+  void mark() override {
+    if (isMarked()) {
+      return;
+    }
+    Obj::mark();
+#ifdef DEBUG_GC
+    std::cout << "mark map\n";
+#endif
+    table_.forEach([](const Table::Entry& entry) {
+      if (std::holds_alternative<Obj*>(entry.key)) {
+        AS_OBJ(entry.key)->mark();
+      }
+      if (std::holds_alternative<Obj*>(entry.value)) {
+        AS_OBJ(entry.value)->mark();
+      }
+    });
+  }
+  void print(std::ostream& os) override {
+    if (printing_) {
+      os << "{...}";
+      return;
+    }
+    printing_ = true;
+    os << '{';
+    const char* separator = "";
+    table_.forEach([&](const Table::Entry& entry) {
+      os << separator;
+      separator = ", ";
+      printValue(entry.key, os);
+      os << ": ";
+      printValue(entry.value, os);
+    });
+    os << '}';
+    printing_ = false;
+  }
+private:
+  Table table_;
+  bool printing_ = false;
+};
+
+// an array of unboxed doubles, so that the bulk operations can work on
+// contiguous memory.
+class ObjFloat64Array : public Obj {
+public:
+  explicit ObjFloat64Array(std::vector<double> elements)
+  : Obj(OBJ_FLOAT64_ARRAY), elements_(std::move(elements)) {}
+  ~ObjFloat64Array() override = default;
+  ObjFloat64Array* asFloat64Array() override { return this; }
+  std::vector<double>& elements() { return elements_; }
+  void print(std::ostream& os) override {
+    os << '[';
+    for (size_t i = 0; i < elements_.size(); i++) {
+      if (i > 0) {
+        os << ", ";
+      }
+      printValue(elements_[i], os);
+    }
+    os << ']';
+  }
+private:
+  std::vector<double> elements_;
+};
+
+// a range of a string which shares the text instead of copying it.
+// a root slice owns the text, the others view a range of their root
+// and keep it alive.
+class ObjSlice : public Obj {
+public:
+  explicit ObjSlice(std::string text)
+  : Obj(OBJ_SLICE), text_(std::move(text)), start_(0), size_(text_.size()) {}
+  ObjSlice(ObjSlice* root, size_t start, size_t size)
+  : Obj(OBJ_SLICE), root_(root), start_(start), size_(size) {}
+  ~ObjSlice() override = default;
+  ObjSlice* asSlice() override { return this; }
+  ObjSlice* root() { return root_ ? root_ : this; }
+  // where the range starts in the text of the root.
+  size_t start() const { return start_; }
+  std::string_view view() const {
+    return std::string_view((root_ ? root_->text_ : text_).data() + start_, size_);
+  }
+  void mark() override {
+    if (isMarked()) {
+      return;
+    }
+    Obj::mark();
+#ifdef DEBUG_GC
+    std::cout << "mark slice\n";
+#endif
+    if (root_) {
+      root_->mark();
+    }
+  }
+  void print(std::ostream& os) override {
+    os << view();
+  }
+private:
+  std::string text_;
+  ObjSlice* root_ = nullptr;
+  size_t start_;
+  size_t size_;
+};
+
+// the text of a string or a slice, false for the other values.
+bool stringView(const Value& value, std::string_view& view);
+// `a + b` where either may be a slice, false unless both are text.
+bool concatenate(const Value& a, const Value& b, Value& result);
+
+// the arguments of a native, they're still in the stack of the vm.
+// they're found by their offset, the stack may grow and move while the
+// native runs, e.g. when it calls back into the vm.
+class NativeArgs {
+public:
+  NativeArgs(const std::vector<Value>& stack, size_t start, int size)
+  : stack_(stack), start_(start), size_(size) {}
+  const Value& operator[](int i) const { return stack_[start_ + i]; }
+  int size() const { return size_; }
+private:
+  const std::vector<Value>& stack_;
+  size_t start_;
+  int size_;
+};
+
+// false on a runtime error, which the native reports itself.
+using NativeFn = bool (*)(Vm& vm, NativeArgs args, Value& result);
+
+// a function written in c++, it's called without a frame.
+class ObjNative : public Obj {
+public:
+  // any number of arguments when `arity` is negative.
+  ObjNative(std::string name, NativeFn function, int arity)
+  : Obj(OBJ_NATIVE), name_(std::move(name)), function_(function), arity_(arity) {}
+  ~ObjNative() override = default;
+  ObjNative* asNative() override { return this; }
+  void print(std::ostream& os) override {
+    os << "[native] " << name_;
+  }
+  const std::string& name() const { return name_; }
+  NativeFn function() const { return function_; }
+  int arity() const { return arity_; }
+private:
+  std::string name_;
+  NativeFn function_;
+  int arity_;
+};
+
 }
 
 
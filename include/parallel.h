@@ -0,0 +1,14 @@
+#ifndef ALIEN_PARALLEL_H
+#define ALIEN_PARALLEL_H
+
+#include <functional>
+
+namespace alien {
+
+// runs `body(0)` to `body(count - 1)` on up to `threads` threads
+// and returns when all of them have finished.
+void parallelFor(int count, int threads, const std::function<void(int)>& body);
+
+}
+
+#endif //ALIEN_PARALLEL_H
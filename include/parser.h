@@ -6,6 +6,7 @@
 #define ALIEN_PARSER_H
 
 #include <ast.h>
+#include <arena.h>
 #include <lexer.h>
 #include <typedef.h>
 
@@ -17,9 +18,13 @@ namespace alien {
 
 class Parser {
 public:
-  explicit Parser(std::string_view);
+  // with `preParse` the bodies of functions are only brace-matched,
+  // see parseBody.
+  explicit Parser(std::string_view source, bool preParse = false, int line = 1);
   std::vector<StmtPtr> parse();
   bool hadError() const;
+  // parses a body the pre-parser skipped, false on a syntax error.
+  static bool parseBody(FuncDecl& decl);
 private:
   enum FunctionType {
     TYPE_METHOD,
@@ -39,18 +44,47 @@ private:
   StmtPtr parseReturnStmt();
   StmtPtr parsePrintStmt();
   StmtPtr parseBlock();
+  void skipBody(FuncDecl& decl);
+  template <typename T>
+  NodePtr<T> make() { return NodePtr<T>(arena_->make<T>()); }
   ExprPtr parseExpr();
-  ExprPtr parseAssign();
-  ExprPtr parseOr();
-  ExprPtr parseAnd();
-  ExprPtr parseEquality();
-  ExprPtr parseCmp();
-  ExprPtr parseTerm();
-  ExprPtr parseFactor();
-  ExprPtr parseUnary();
-  ExprPtr parseCall();
-  ExprPtr parsePrimary();
+private:
+  // expressions are parsed by precedence climbing, each token has a rule
+  // for starting an expression and for continuing one on its left.
+  enum Precedence {
+    PREC_NONE,
+    PREC_ASSIGN,      // =
+    PREC_OR,          // or
+    PREC_AND,         // and
+    PREC_EQUALITY,    // == !=
+    PREC_COMPARISON,  // < > <= >=
+    PREC_TERM,        // + -
+    PREC_FACTOR,      // * /
+    PREC_UNARY,       // ! -
+    PREC_CALL,        // . () []
+  };
+  struct Rule {
+    ExprPtr (Parser::*prefix)();
+    ExprPtr (Parser::*infix)(ExprPtr left);
+    Precedence precedence;
+  };
+  static const Rule& rule(TokenType type);
+  ExprPtr parsePrecedence(Precedence precedence);
+  ExprPtr parseAssign(ExprPtr target);
+  ExprPtr parseLogical(ExprPtr left);
+  ExprPtr parseBinary(ExprPtr left);
   ExprPtr parseArgs(ExprPtr callee);
+  ExprPtr parseGet(ExprPtr object);
+  ExprPtr parseIndex(ExprPtr object);
+  ExprPtr parseArray();
+  ExprPtr parseMap();
+  ExprPtr parseUnary();
+  ExprPtr parseLiteral();
+  ExprPtr parseThis();
+  ExprPtr parseNumber();
+  ExprPtr parseString();
+  ExprPtr parseVariable();
+  ExprPtr parseGrouping();
 private:
   bool match(TokenType type);
   template <typename T, typename... Args>
@@ -66,6 +100,9 @@ private:
 private:
   bool panicMode_ = false;
   bool hadError_  = false;
+  bool preParse_;
+  // the nodes of the tree, it must outlive what parse returns.
+  std::unique_ptr<Arena> arena_ = std::make_unique<Arena>();
   Token previous_;
   Token current_;
   Lexer lexer_;
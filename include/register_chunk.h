@@ -0,0 +1,91 @@
+#ifndef ALIEN_REGISTER_CHUNK_H
+#define ALIEN_REGISTER_CHUNK_H
+
+#include <value.h>
+
+#include <vector>
+#include <ostream>
+
+#include <cstdint>
+
+namespace alien {
+
+// instructions of the register machine, R(x) is the slot x of the frame
+// and K(x) the constant x. the first slots hold the function or `this`,
+// the arguments and the locals, temporaries are above them.
+enum RegisterOp : uint8_t {
+  ROP_MOVE,           // R(A) = R(B)
+  ROP_LOADK,          // R(A) = K(Bx)
+  ROP_LOADNIL,        // R(A) = nil
+  ROP_LOADBOOL,       // R(A) = B
+  ROP_PRINT,          // print R(A)
+
+  ROP_EQUAL,          // R(A) = R(B) == R(C)
+  ROP_GREATER,        // R(A) = R(B) > R(C)
+  ROP_LESS,           // R(A) = R(B) < R(C)
+
+  ROP_ADD,            // R(A) = R(B) + R(C)
+  ROP_SUBTRACT,       // R(A) = R(B) - R(C)
+  ROP_MULTIPLY,       // R(A) = R(B) * R(C)
+  ROP_DIVIDE,         // R(A) = R(B) / R(C)
+
+  ROP_NOT,            // R(A) = !R(B)
+  ROP_NEGATE,         // R(A) = -R(B)
+  ROP_CALL,           // R(A) = R(A)(R(A + 1), ..., R(A + B))
+  ROP_RETURN,         // return R(A)
+
+  ROP_GET_GLOBAL,     // R(A) = globals[K(Bx)]
+  ROP_SET_GLOBAL,     // globals[K(Bx)] = R(A)
+  ROP_DEFINE_GLOBAL,  // define globals[K(Bx)] = R(A)
+  ROP_GET_PROPERTY,   // R(A) = R(B).K(C)
+  ROP_SET_PROPERTY,   // R(A).K(B) = R(C)
+  ROP_ARRAY,          // R(A) = [R(B), ..., R(B + C - 1)]
+  ROP_MAP,            // R(A) = {R(B): R(B + 1), ..., R(B + 2C - 2): R(B + 2C - 1)}
+  ROP_GET_INDEX,      // R(A) = R(B)[R(C)]
+  ROP_SET_INDEX,      // R(A)[R(B)] = R(C)
+
+  ROP_JUMP,           // ip += sBx
+  ROP_JUMP_IF_FALSE,  // if !R(A) then ip += sBx
+  ROP_JUMP_IF_TRUE,   // if R(A) then ip += sBx
+};
+
+// an instruction is 32 bits, the opcode and three 8-bit operands A, B
+// and C, or A and a 16-bit Bx. jumps are relative to the next
+// instruction, their sBx is stored with a bias.
+const int kJumpBias = 0x7fff;
+
+inline uint32_t encode(RegisterOp op, int a, int b = 0, int c = 0) {
+  return op | (a << 8) | (b << 16) | (static_cast<uint32_t>(c) << 24);
+}
+
+inline uint32_t encodeBx(RegisterOp op, int a, int bx) {
+  return op | (a << 8) | (static_cast<uint32_t>(bx) << 16);
+}
+
+inline RegisterOp opOf(uint32_t instruction) { return static_cast<RegisterOp>(instruction & 0xff); }
+inline int argA(uint32_t instruction) { return (instruction >> 8) & 0xff; }
+inline int argB(uint32_t instruction) { return (instruction >> 16) & 0xff; }
+inline int argC(uint32_t instruction) { return instruction >> 24; }
+inline int argBx(uint32_t instruction) { return instruction >> 16; }
+inline int argSBx(uint32_t instruction) { return argBx(instruction) - kJumpBias; }
+
+class RegisterChunk {
+public:
+  void write(uint32_t instruction) { code_.push_back(instruction); }
+  int addConstant(const Value& value);
+  void disassemble(std::ostream& os = std::cout);
+  void disassembleInstruction(int i, std::ostream& os = std::cout);
+  std::vector<uint32_t>& code() { return code_; }
+  std::vector<Value>& constants() { return constants_; }
+  // the size of the frame.
+  int  registers() const { return registers_; }
+  void setRegisters(int registers) { registers_ = registers; }
+private:
+  std::vector<uint32_t> code_;
+  std::vector<Value> constants_;
+  int registers_ = 1;
+};
+
+}
+
+#endif //ALIEN_REGISTER_CHUNK_H
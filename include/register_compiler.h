@@ -0,0 +1,104 @@
+#ifndef ALIEN_REGISTER_COMPILER_H
+#define ALIEN_REGISTER_COMPILER_H
+
+#include <ast.h>
+#include <vm.h>
+#include <register_chunk.h>
+#include <object.h>
+
+#include <string_view>
+#include <vector>
+
+namespace alien {
+
+// compiles the ast to the instructions of the register machine, see
+// register_chunk.h. locals live in fixed slots of the frame and
+// expressions are evaluated into the slot their value is needed in.
+class RegisterCompiler : public StmtVisitor, public ExprVisitor {
+public:
+  explicit RegisterCompiler(Vm& vm)
+  : vm_(vm) {}
+  ObjFunction* compile(std::vector<StmtPtr>& stmts);
+  void visit(ClassDecl &decl) override;
+  void visit(FuncDecl &decl) override;
+  void visit(VarDecl &decl) override;
+  void visit(ConstDecl &decl) override;
+  void visit(BlockStmt &stmts) override;
+  void visit(IfStmt &stmt) override;
+  void visit(WhileStmt &stmt) override;
+  void visit(ForStmt &stmt) override;
+  void visit(PrintStmt &stmt) override;
+  void visit(ReturnStmt &stmt) override;
+  void visit(ExprStmt&stmt) override;
+  void visit(Assign& expr) override;
+  void visit(Binary& expr) override;
+  void visit(Call& expr) override;
+  void visit(Get& expr) override;
+  void visit(Grouping& expr) override;
+  void visit(Set& expr) override;
+  void visit(Unary& expr) override;
+  void visit(Variable& expr) override;
+  void visit(Logical& expr) override;
+  void visit(Number& expr) override;
+  void visit(String& expr) override;
+  void visit(Literal& expr) override;
+  void visit(This& expr) override;
+  void visit(Array& expr) override;
+  void visit(Map& expr) override;
+  void visit(Index& expr) override;
+  void visit(IndexSet& expr) override;
+  bool hadError() { return hadError_; }
+
+private:
+  // evaluates `expr` into the slot `dest`, or
+  // only for its effects when `dest` is kDiscard.
+  void expr(Expr& expr, int dest);
+  // the slot holding the value of `expr`, the slot of a local is used
+  // directly unless `later`, evaluated before it's read, assigns it.
+  int  operand(Expr& expr, Expr* later = nullptr);
+  // `dest`, or a new temporary if the value isn't needed.
+  int  target(int dest);
+  int  allocate();
+  bool isLocalSlot(int slot) const { return slot < static_cast<int>(locals_.size()); }
+
+private:
+  void emit(uint32_t instruction) { chunk_->write(instruction); }
+  int  emitJump(RegisterOp op, int a = 0);
+  void fixJump(int at);
+  void emitLoop(int loopStart);
+  int  constant(const Value& value, int limit);
+  int  name(std::string_view name, int limit);
+  void error(std::string_view message);
+
+private:
+  struct Local {
+    int depth;
+    std::string_view name;
+  };
+  void addLocal(std::string_view name);
+  int  resolveLocal(std::string_view name);
+  void beginScope();
+  void endScope();
+
+private:
+  static const int kDiscard = -1;
+  Vm& vm_;
+  RegisterChunk globalChunk_;
+  // the chunk of the function being compiled.
+  RegisterChunk* chunk_ = &globalChunk_;
+  ObjClass* currentClass_ = nullptr;
+  bool isInitializer_ = false;
+  bool hadError_ = false;
+  int depth_ = 0;
+  // the first slot is `this` or the function, the slots
+  // above the locals are temporaries of the current statement.
+  std::vector<Local> locals_;
+  int freeSlot_ = 1;
+  int maxSlots_ = 1;
+  // the destination of the expression being visited.
+  int dest_ = kDiscard;
+};
+
+}
+
+#endif //ALIEN_REGISTER_COMPILER_H
@@ -0,0 +1,36 @@
+#ifndef ALIEN_SOURCE_FILE_H
+#define ALIEN_SOURCE_FILE_H
+
+#include <string>
+#include <string_view>
+
+#include <cstddef>
+
+namespace alien {
+
+// the text of a script, mapped into memory when it's a regular file and
+// read into a buffer otherwise, e.g. from a pipe. the tokens and the ast
+// point into it, so it has to outlive the parser and the vm.
+class SourceFile {
+public:
+  SourceFile() = default;
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+  ~SourceFile();
+
+  // false when `path` can't be opened or read.
+  bool open(const std::string& path);
+  std::string_view text() const { return std::string_view(data_, size_); }
+
+private:
+  bool read(int fd);
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string buffer_;
+};
+
+}
+
+#endif //ALIEN_SOURCE_FILE_H
@@ -0,0 +1,55 @@
+#ifndef ALIEN_TABLE_H
+#define ALIEN_TABLE_H
+
+#include <value.h>
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace alien {
+
+// a hash table keyed by values, laid out like a swiss table. every slot
+// has a control byte, which is empty, deleted, or the low 7 bits of the
+// hash of its key. a lookup compares the bytes of a group of 16 slots
+// at once, and only compares the keys whose bytes match.
+class Table {
+public:
+  struct Entry {
+    Value key;
+    Value value;
+  };
+  // nullptr when there's no `key`.
+  Value* find(const Value& key);
+  void set(const Value& key, const Value& value);
+  // false when there's no `key`.
+  bool erase(const Value& key);
+  size_t size() const { return size_; }
+  // calls `f` with every entry, in the order of the slots.
+  template <typename F>
+  void forEach(F f) const {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (ctrl_[i] >= 0) f(slots_[i]);
+    }
+  }
+private:
+  static const size_t kNotFound = SIZE_MAX;
+  size_t findSlot(const Value& key, uint64_t hash) const;
+  // the first empty or deleted slot on the probe sequence of `hash`.
+  size_t freeSlot(uint64_t hash) const;
+  void rehash(size_t capacity);
+
+  std::vector<int8_t> ctrl_;
+  std::vector<Entry> slots_;
+  size_t size_ = 0;
+  size_t deleted_ = 0;
+};
+
+// equal values have the same hash, numbers by value, strings by their
+// bytes and objects by identity.
+uint64_t hashValue(const Value& value);
+
+}
+
+#endif //ALIEN_TABLE_H
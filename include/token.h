@@ -13,9 +13,10 @@ namespace alien {
 enum TokenType {
   TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
   TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE,
+  TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET,
   TOKEN_PLUS, TOKEN_MINUS, TOKEN_STAR,
   TOKEN_SLASH, TOKEN_COMMA, TOKEN_SEMICOLON,
-  TOKEN_DOT,
+  TOKEN_DOT, TOKEN_COLON,
 
   // about compare
   TOKEN_BANG, TOKEN_BANG_EQUAL,
@@ -11,8 +11,15 @@ namespace alien {
 
 class Expr;
 class Stmt;
-using StmtPtr = std::unique_ptr<Stmt>;
-using ExprPtr = std::unique_ptr<Expr>;
+// the nodes live in the parser's arena, deleting one only destroys it.
+struct NodeDeleter {
+  template <typename T>
+  void operator()(T* node) const { node->~T(); }
+};
+template <typename T>
+using NodePtr = std::unique_ptr<T, NodeDeleter>;
+using StmtPtr = NodePtr<Stmt>;
+using ExprPtr = NodePtr<Expr>;
 
 }
 #endif //ALIEN_TYPEDEF_H
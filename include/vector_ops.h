@@ -0,0 +1,24 @@
+#ifndef ALIEN_VECTOR_OPS_H
+#define ALIEN_VECTOR_OPS_H
+
+#include <cstddef>
+
+namespace alien {
+
+// bulk operations on arrays of doubles, vectorised with avx2 when the cpu
+// has it. the results may differ from a sequential loop in the last bits,
+// the sums are added in a different order.
+void addVectors(const double* a, const double* b, double* out, size_t size);
+void multiplyVectors(const double* a, const double* b, double* out, size_t size);
+void scaleVector(const double* a, double k, double* out, size_t size);
+double sumVector(const double* a, size_t size);
+double dotVectors(const double* a, const double* b, size_t size);
+// `size` must not be 0.
+double minVector(const double* a, size_t size);
+double maxVector(const double* a, size_t size);
+// out[i] = a[0] + ... + a[i], `out` may be `a`.
+void prefixSum(const double* a, double* out, size_t size);
+
+}
+
+#endif //ALIEN_VECTOR_OPS_H
@@ -7,13 +7,19 @@
 
 #include <value.h>
 #include <object.h>
+#include <common.h>
 
 #include <string>
 #include <list>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace alien {
 
+class Compiler;
+struct CacheImage;
+
 enum InterpretResult {
   INTERPRET_OK,
   INTERPRET_PARSE_ERROR,
@@ -31,14 +37,54 @@ struct CallFrame {
 
 class Vm {
 public:
+  Vm();
+  explicit Vm(const Options& options);
+  const Options& options() const { return options_; }
   InterpretResult interpret(std::string_view source);
   void addObj(Obj* obj);
+
+  // the embedding api. a script is compiled once and its top-level code
+  // run once, then its functions can be called any number of times. the
+  // globals and the heap persist between the calls.
+  //
+  // the script of `source`, nullptr on a parse or compile error. it
+  // doesn't call `main` and it lives as long as the vm. the host may call
+  // and reassign any global, so no function is inlined or specialised.
+  // the functions `interpret` leaves behind can't be called this way, a
+  // function it never ran is a runtime error.
+  ObjFunction* compile(std::string_view source);
+  // runs the top-level code of `script`, which defines its globals.
+  InterpretResult execute(ObjFunction* script);
+  // false when there's no global `name`.
+  bool getGlobal(const std::string& name, Value& value) const;
+  void setGlobal(const std::string& name, const Value& value);
+  // calls a function, a class or a bound method with `args`. an object
+  // in `result` is only kept alive by the vm while it's reachable from
+  // a global, or until the next call. a native may call it as well, the
+  // frames of the script it was called from are left as they were.
+  InterpretResult call(const Value& callee, const std::vector<Value>& args, Value& result);
+  // defines the global `name` as a native. it takes any number of
+  // arguments when `arity` is negative.
+  void defineNative(const std::string& name, NativeFn function, int arity);
+  // the native defined as `name`, nullptr if there's none.
+  ObjNative* native(const std::string& name) const;
   ~Vm();
 private:
-  InterpretResult run();
+  // runs until the frames above the first `frames` have returned.
+  InterpretResult run(size_t frames = 0);
+  // calls the global `main`, once the top-level code has run.
+  InterpretResult runMain();
+  // executes the chunks of the register machine.
+  InterpretResult runRegister(size_t frames = 0);
   bool callValue(const Value& callee, int argCount);
   bool call(ObjFunction* callee, int argCount);
+  // compiles a stub before its first call.
+  bool compileFunction(ObjFunction* function);
   bool bindMethod(ObjClass* klass, const std::string& name);
+  // `object[index]` of an array or a map, false after reporting a
+  // runtime error. a key which isn't in a map is nil.
+  bool getIndex(const Value& object, const Value& index, Value& result);
+  bool setIndex(const Value& object, const Value& index, const Value& value);
 
 private:
   void collectGarbage();
@@ -52,6 +98,7 @@ private:
   Value peek(int depth);
 
 private:
+  Options options_;
   int nextGC = 50;
   // global definitions.
   std::unordered_map<std::string, Value> globals_;
@@ -60,6 +107,14 @@ private:
   // runtime stack.
   std::vector<Value> stack_;
   std::vector<CallFrame> callFrames_;
+  // the compiled scripts of the embedding api.
+  std::vector<ObjFunction*> scripts_;
+  // the natives by name, even when their globals are reassigned.
+  std::unordered_map<std::string, ObjNative*> natives_;
+  // compiles the stubs while the program runs.
+  Compiler* compiler_ = nullptr;
+  // the mapped cache the script was loaded from.
+  std::unique_ptr<CacheImage> image_;
 };
 
 }
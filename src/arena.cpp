@@ -0,0 +1,22 @@
+#include <arena.h>
+
+#include <algorithm>
+
+namespace alien {
+
+Arena::Arena(size_t firstBlock)
+: nextSize_(std::clamp<size_t>(firstBlock, 1, kBlockSize)) {}
+
+void* Arena::allocate(size_t size, size_t align) {
+  size_t start = (used_ + align - 1) & ~(align - 1);
+  if (start + size > size_) {
+    size_ = std::max(nextSize_, size);
+    nextSize_ = std::min(nextSize_ * 2, kBlockSize);
+    blocks_.emplace_back(new char[size_]);
+    start = 0;
+  }
+  used_ = start + size;
+  return blocks_.back().get() + start;
+}
+
+}
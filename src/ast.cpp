@@ -26,7 +26,9 @@ void FuncDecl::trace(std::ostream &os) const {
   }
   os << ")";
   os << " {\n";
-  body->trace(os);
+  if (body) {
+    body->trace(os);
+  }
   os << "}\n";
 }
 
@@ -207,4 +209,215 @@ void This::trace(std::ostream &os) const {
   os << "this";
 }
 
-}
\ No newline at end of file
+void Array::trace(std::ostream &os) const {
+  os << "[";
+  if (!elements.empty()) {
+    elements.front()->trace(os);
+  }
+  for (size_t i = 1; i < elements.size(); i++) {
+    os << ", ";
+    elements[i]->trace(os);
+  }
+  os << "]";
+}
+
+void Map::trace(std::ostream &os) const {
+  os << "{";
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i > 0) {
+      os << ", ";
+    }
+    keys[i]->trace(os);
+    os << ": ";
+    values[i]->trace(os);
+  }
+  os << "}";
+}
+
+void Index::trace(std::ostream &os) const {
+  object->trace(os);
+  os << "[";
+  index->trace(os);
+  os << "]";
+}
+
+void IndexSet::trace(std::ostream &os) const {
+  object->trace(os);
+  os << "[";
+  index->trace(os);
+  os << "] = ";
+  value->trace(os);
+}
+
+void AstWalker::visit(ClassDecl &decl) {
+  for (const auto& method : decl.methods) {
+    method->accept(*this);
+  }
+}
+
+void AstWalker::visit(FuncDecl &decl) {
+  if (decl.body) {
+    decl.body->accept(*this);
+  }
+}
+
+void AstWalker::visit(VarDecl &decl) {
+  if (decl.initializer) {
+    decl.initializer->accept(*this);
+  }
+}
+
+void AstWalker::visit(ConstDecl &decl) {
+  decl.initializer->accept(*this);
+}
+
+void AstWalker::visit(BlockStmt &stmt) {
+  for (const auto& s : stmt.stmts) {
+    s->accept(*this);
+  }
+}
+
+void AstWalker::visit(IfStmt &stmt) {
+  stmt.condition->accept(*this);
+  stmt.thenBranch->accept(*this);
+  if (stmt.elseBranch) {
+    stmt.elseBranch->accept(*this);
+  }
+}
+
+void AstWalker::visit(WhileStmt &stmt) {
+  stmt.condition->accept(*this);
+  stmt.body->accept(*this);
+}
+
+void AstWalker::visit(ForStmt &stmt) {
+  if (stmt.initializer) {
+    stmt.initializer->accept(*this);
+  }
+  if (stmt.condition) {
+    stmt.condition->accept(*this);
+  }
+  if (stmt.increment) {
+    stmt.increment->accept(*this);
+  }
+  stmt.body->accept(*this);
+}
+
+void AstWalker::visit(PrintStmt &stmt) {
+  stmt.expr->accept(*this);
+}
+
+void AstWalker::visit(ReturnStmt &stmt) {
+  if (stmt.expr) {
+    stmt.expr->accept(*this);
+  }
+}
+
+void AstWalker::visit(ExprStmt &stmt) {
+  stmt.expr->accept(*this);
+}
+
+void AstWalker::visit(Assign &expr) {
+  expr.value->accept(*this);
+}
+
+void AstWalker::visit(Binary &expr) {
+  expr.left->accept(*this);
+  expr.right->accept(*this);
+}
+
+void AstWalker::visit(Call &expr) {
+  expr.callee->accept(*this);
+  for (const auto& arg : expr.arguments) {
+    arg->accept(*this);
+  }
+}
+
+void AstWalker::visit(Get &expr) {
+  expr.object->accept(*this);
+}
+
+void AstWalker::visit(Grouping &expr) {
+  expr.expr->accept(*this);
+}
+
+void AstWalker::visit(Set &expr) {
+  expr.object->accept(*this);
+  expr.value->accept(*this);
+}
+
+void AstWalker::visit(Unary &expr) {
+  expr.right->accept(*this);
+}
+
+void AstWalker::visit(Variable &expr) {}
+
+void AstWalker::visit(Logical &expr) {
+  expr.left->accept(*this);
+  expr.right->accept(*this);
+}
+
+void AstWalker::visit(Number &expr) {}
+
+void AstWalker::visit(String &expr) {}
+
+void AstWalker::visit(Literal &expr) {}
+
+void AstWalker::visit(This &expr) {}
+
+void AstWalker::visit(Array &expr) {
+  for (const auto& element : expr.elements) {
+    element->accept(*this);
+  }
+}
+
+void AstWalker::visit(Map &expr) {
+  // in the order they're evaluated.
+  for (size_t i = 0; i < expr.keys.size(); i++) {
+    expr.keys[i]->accept(*this);
+    expr.values[i]->accept(*this);
+  }
+}
+
+void AstWalker::visit(Index &expr) {
+  expr.object->accept(*this);
+  expr.index->accept(*this);
+}
+
+void AstWalker::visit(IndexSet &expr) {
+  expr.object->accept(*this);
+  expr.index->accept(*this);
+  expr.value->accept(*this);
+}
+
+namespace {
+  class AssignFinder : public AstWalker {
+  public:
+    explicit AssignFinder(std::string_view name)
+    : name_(name) {}
+    using AstWalker::visit;
+    void visit(Assign& expr) override {
+      if (expr.name.lexeme_ == name_) {
+        found = true;
+      }
+      AstWalker::visit(expr);
+    }
+    bool found = false;
+  private:
+    std::string_view name_;
+  };
+} // namespace
+
+bool isAssigned(std::string_view name, Stmt &stmt) {
+  AssignFinder finder(name);
+  stmt.accept(finder);
+  return finder.found;
+}
+
+bool isAssigned(std::string_view name, Expr &expr) {
+  AssignFinder finder(name);
+  expr.accept(finder);
+  return finder.found;
+}
+
+}
@@ -0,0 +1,750 @@
+#include <bytecode_cache.h>
+#include <vm.h>
+
+#include <fstream>
+
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace alien {
+
+namespace {
+  // fnv-1a.
+  uint64_t hashBytes(std::string_view bytes) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : bytes) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+  }
+
+  template <typename T>
+  void append(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  CacheHeader makeHeader(std::string_view source, uint8_t flags) {
+    CacheHeader header{};
+    std::memcpy(header.magic, "ALNC", 4);
+    header.version = kCacheVersion;
+    header.hash = hashBytes(source);
+    header.size = source.size();
+    header.flags = flags;
+    return header;
+  }
+
+  bool matches(const CacheHeader& header, std::string_view source, uint8_t flags) {
+    return std::memcmp(header.magic, "ALNC", 4) == 0 && header.version == kCacheVersion &&
+           header.size == source.size() && header.flags == flags &&
+           header.hash == hashBytes(source);
+  }
+
+  // the runs of a script may race, the file is replaced as a whole.
+  bool replaceFile(const std::string& path, const std::string& contents) {
+    std::string temp = path + "." + std::to_string(getpid());
+    {
+      std::ofstream out(temp, std::ios::binary);
+      out << contents;
+      if (!out) {
+        std::remove(temp.c_str());
+        return false;
+      }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+      std::remove(temp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // numbers the objects reachable from the roots, then lays the sections
+  // out one after another. the sizes of all but the bytes are known once
+  // the objects are, so every offset is final when it's written.
+  class Writer {
+  public:
+    bool collect(const Value& value) {
+      return !std::holds_alternative<Obj*>(value) || collect(AS_OBJ(value));
+    }
+    bool collect(Obj* obj);
+    std::string write(CacheHeader header, const std::unordered_map<std::string, Value>& globals);
+  private:
+    // the offset of `bytes` in the image.
+    uint32_t addBytes(const void* bytes, size_t size);
+    ImageConstant constantOf(const Value& value);
+    void addField(std::string& table, const std::string& name, const Value& value);
+    uint32_t bytesStart_ = 0;
+    std::vector<Obj*> objs_;
+    std::unordered_map<Obj*, uint32_t> indices_;
+    std::string bytes_;
+  };
+
+  bool Writer::collect(Obj* obj) {
+    if (indices_.count(obj)) {
+      return true;
+    }
+    indices_[obj] = objs_.size();
+    objs_.push_back(obj);
+    bool ok = true;
+    switch (obj->getType()) {
+      case OBJ_FUNCTION:
+        if (!obj->asFunction()->isCompiled()) {
+          return false;
+        }
+        obj->asFunction()->chunk().forEachObj([&](Obj* constant) { ok = ok && collect(constant); });
+        return ok;
+      case OBJ_CLASS:
+        for (const auto& [name, method] : obj->asClass()->methods()) {
+          ok = ok && collect(method);
+        }
+        return ok;
+      case OBJ_INSTANCE:
+        ok = collect(obj->asInstance()->getClass());
+        for (const auto& [name, value] : obj->asInstance()->fields()) {
+          ok = ok && collect(value);
+        }
+        return ok;
+      case OBJ_BOUND_METHOD:
+        return collect(obj->asBoundMethod()->method_) && collect(obj->asBoundMethod()->receiver_);
+      case OBJ_NATIVE:
+        return true;
+      case OBJ_ARRAY:
+        for (const auto& value : obj->asArray()->elements()) {
+          ok = ok && collect(value);
+        }
+        return ok;
+      case OBJ_MAP:
+        obj->asMap()->table().forEach([&](const Table::Entry& entry) {
+          ok = ok && collect(entry.key) && collect(entry.value);
+        });
+        return ok;
+      case OBJ_FLOAT64_ARRAY:
+      case OBJ_SLICE:
+        return true;
+    }
+    return false;
+  }
+
+  uint32_t Writer::addBytes(const void* bytes, size_t size) {
+    uint32_t offset = bytesStart_ + bytes_.size();
+    bytes_.append(static_cast<const char*>(bytes), size);
+    return offset;
+  }
+
+  ImageConstant Writer::constantOf(const Value& value) {
+    ImageConstant constant{};
+    if (std::holds_alternative<std::monostate>(value)) {
+      constant.tag = IMAGE_NIL;
+    } else if (std::holds_alternative<bool>(value)) {
+      constant.tag = std::get<bool>(value) ? IMAGE_TRUE : IMAGE_FALSE;
+    } else if (std::holds_alternative<double>(value)) {
+      constant.tag = IMAGE_NUMBER;
+      std::memcpy(&constant.payload, &std::get<double>(value), sizeof(double));
+    } else if (std::holds_alternative<std::string>(value)) {
+      auto& str = std::get<std::string>(value);
+      constant.tag = IMAGE_STRING;
+      constant.size = str.size();
+      constant.payload = addBytes(str.data(), str.size());
+    } else {
+      constant.tag = IMAGE_OBJ;
+      constant.payload = indices_[AS_OBJ(value)];
+    }
+    return constant;
+  }
+
+  void Writer::addField(std::string& table, const std::string& name, const Value& value) {
+    CacheField field{};
+    field.name = addBytes(name.data(), name.size());
+    field.nameSize = name.size();
+    field.value = constantOf(value);
+    append(table, field);
+  }
+
+  std::string Writer::write(CacheHeader header,
+                            const std::unordered_map<std::string, Value>& globals) {
+    size_t constants = 0, fields = globals.size();
+    for (auto obj : objs_) {
+      switch (obj->getType()) {
+        case OBJ_FUNCTION: constants += obj->asFunction()->chunk().constants().size(); break;
+        case OBJ_CLASS: fields += obj->asClass()->methods().size(); break;
+        case OBJ_INSTANCE: fields += obj->asInstance()->fields().size(); break;
+        case OBJ_BOUND_METHOD: constants++; break;
+        case OBJ_NATIVE: break;
+        case OBJ_ARRAY: constants += obj->asArray()->elements().size(); break;
+        case OBJ_MAP: constants += obj->asMap()->table().size() * 2; break;
+        case OBJ_FLOAT64_ARRAY: break;
+        case OBJ_SLICE: break;
+      }
+    }
+    uint32_t poolStart = sizeof(CacheHeader) + objs_.size() * sizeof(CacheObject);
+    uint32_t fieldStart = poolStart + constants * sizeof(ImageConstant);
+    bytesStart_ = fieldStart + fields * sizeof(CacheField);
+    std::string table, pools, fieldTable;
+    for (auto obj : objs_) {
+      CacheObject entry{};
+      switch (obj->getType()) {
+        case OBJ_FUNCTION: {
+          auto function = obj->asFunction();
+          auto& chunk = function->chunk();
+          entry.kind = CACHE_FUNCTION;
+          entry.index = function->arity();
+          entry.name = addBytes(function->name().data(), function->name().size());
+          entry.nameSize = function->name().size();
+          entry.code = addBytes(chunk.code().data(), chunk.code().size());
+          entry.codeSize = chunk.code().size();
+          entry.pool = poolStart + pools.size();
+          entry.constants = chunk.constants().size();
+          for (const auto& value : chunk.constants()) {
+            append(pools, constantOf(value));
+          }
+          break;
+        }
+        case OBJ_CLASS: {
+          auto klass = obj->asClass();
+          entry.kind = CACHE_CLASS;
+          entry.name = addBytes(klass->name().data(), klass->name().size());
+          entry.nameSize = klass->name().size();
+          entry.code = fieldStart + fieldTable.size();
+          entry.codeSize = klass->methods().size();
+          for (const auto& [name, method] : klass->methods()) {
+            addField(fieldTable, name, Value(method));
+          }
+          break;
+        }
+        case OBJ_INSTANCE: {
+          auto instance = obj->asInstance();
+          entry.kind = CACHE_INSTANCE;
+          entry.index = indices_[instance->getClass()];
+          entry.code = fieldStart + fieldTable.size();
+          entry.codeSize = instance->fields().size();
+          for (const auto& [name, value] : instance->fields()) {
+            addField(fieldTable, name, value);
+          }
+          break;
+        }
+        case OBJ_BOUND_METHOD: {
+          auto boundMethod = obj->asBoundMethod();
+          entry.kind = CACHE_BOUND_METHOD;
+          entry.index = indices_[boundMethod->method_];
+          entry.pool = poolStart + pools.size();
+          entry.constants = 1;
+          append(pools, constantOf(boundMethod->receiver_));
+          break;
+        }
+        case OBJ_NATIVE: {
+          auto native = obj->asNative();
+          entry.kind = CACHE_NATIVE;
+          entry.name = addBytes(native->name().data(), native->name().size());
+          entry.nameSize = native->name().size();
+          break;
+        }
+        case OBJ_ARRAY: {
+          auto& elements = obj->asArray()->elements();
+          entry.kind = CACHE_ARRAY;
+          entry.pool = poolStart + pools.size();
+          entry.constants = elements.size();
+          for (const auto& value : elements) {
+            append(pools, constantOf(value));
+          }
+          break;
+        }
+        case OBJ_MAP: {
+          auto& table = obj->asMap()->table();
+          entry.kind = CACHE_MAP;
+          entry.pool = poolStart + pools.size();
+          entry.constants = table.size() * 2;
+          table.forEach([&](const Table::Entry& item) {
+            append(pools, constantOf(item.key));
+            append(pools, constantOf(item.value));
+          });
+          break;
+        }
+        case OBJ_FLOAT64_ARRAY: {
+          auto& elements = obj->asFloat64Array()->elements();
+          entry.kind = CACHE_FLOAT64_ARRAY;
+          entry.code = addBytes(elements.data(), elements.size() * sizeof(double));
+          entry.codeSize = elements.size() * sizeof(double);
+          break;
+        }
+        case OBJ_SLICE: {
+          auto view = obj->asSlice()->view();
+          entry.kind = CACHE_SLICE;
+          entry.code = addBytes(view.data(), view.size());
+          entry.codeSize = view.size();
+          break;
+        }
+      }
+      append(table, entry);
+    }
+    header.objects = objs_.size();
+    header.root = 0;
+    header.globals = globals.size();
+    header.globalTable = fieldStart + fieldTable.size();
+    for (const auto& [name, value] : globals) {
+      addField(fieldTable, name, value);
+    }
+    std::string body = table + pools + fieldTable + bytes_;
+    header.checksum = hashBytes(body);
+    std::string out;
+    append(out, header);
+    return out + body;
+  }
+
+  // the bytes of the operands of `code`, -1 when it isn't an opcode.
+  int operandBytes(uint8_t code) {
+    switch (code) {
+      case OP_CONSTANT:
+      case OP_CALL:
+      case OP_TAIL_CALL:
+      case OP_GET_LOCAL:
+      case OP_SET_LOCAL:
+      case OP_APPEND_LOCAL:
+      case OP_GET_GLOBAL:
+      case OP_SET_GLOBAL:
+      case OP_GET_PROPERTY:
+      case OP_SET_PROPERTY:
+      case OP_ARRAY:
+      case OP_MAP:
+      case OP_DEFINE_GLOBAL:
+      case OP_LOOP:
+      case OP_JUMP:
+      case OP_JUMP_IF_FALSE:
+      case OP_JUMP_IF_TRUE:
+        return 1;
+      case OP_FOR_PREP:
+        return 3;
+      case OP_FOR_LOOP:
+        return 4;
+      default:
+        return code <= OP_NEGATE_DOUBLE ? 0 : -1;
+    }
+  }
+
+  // checks every offset of the image once, so that nothing has to be
+  // checked while it runs. a truncated or corrupt file is a miss.
+  class Loader {
+  public:
+    explicit Loader(CacheImage& image)
+    : image_(image), data_(image.file.text().data()), size_(image.file.text().size()) {}
+    // creates the objects of the image and adds them to `vm`.
+    bool load(const CacheHeader& header, Vm& vm);
+    bool readValue(const ImageConstant& constant, Value& value) const;
+    const CacheField* fieldTable(uint32_t offset, uint32_t count) const;
+    std::string name(uint32_t offset, uint32_t size) const {
+      return std::string(data_ + offset, size);
+    }
+  private:
+    bool inBounds(uint64_t offset, uint64_t size) const {
+      return offset <= size_ && size <= size_ - offset;
+    }
+    template <typename T>
+    const T* array(uint32_t offset, uint32_t count) const {
+      if (offset % alignof(T) != 0 || !inBounds(offset, uint64_t(count) * sizeof(T))) {
+        return nullptr;
+      }
+      return reinterpret_cast<const T*>(data_ + offset);
+    }
+    bool checkConstant(const ImageConstant& constant) const;
+    bool checkCode(const CacheObject& entry, const ImageConstant* pool) const;
+    bool isA(uint32_t index, ObjType type) const {
+      return index < image_.objects.size() && image_.objects[index] &&
+             image_.objects[index]->getType() == type;
+    }
+    CacheImage& image_;
+    const char* data_;
+    size_t size_;
+  };
+
+  bool Loader::checkConstant(const ImageConstant& constant) const {
+    switch (constant.tag) {
+      case IMAGE_NIL:
+      case IMAGE_FALSE:
+      case IMAGE_TRUE:
+      case IMAGE_NUMBER:
+        return true;
+      case IMAGE_STRING:
+        return inBounds(constant.payload, constant.size);
+      case IMAGE_OBJ:
+        return constant.payload < image_.objects.size();
+    }
+    return false;
+  }
+
+  // follows every path through the code of a function with the height of
+  // the stack, so that the vm can run it unchecked. the operands and the
+  // jumps stay within the code and the jumps land on instructions, the
+  // constants exist and have the types the instructions read, the locals
+  // are below the top of the stack and nothing pops below the frame.
+  // no path runs off the end.
+  bool Loader::checkCode(const CacheObject& entry, const ImageConstant* pool) const {
+    auto code = reinterpret_cast<const uint8_t*>(data_ + entry.code);
+    size_t size = entry.codeSize;
+    // a function is called with at most 255 arguments.
+    if (size == 0 || entry.index > 0xff) {
+      return false;
+    }
+    std::vector<bool> starts(size);
+    for (size_t i = 0; i < size; i += operandBytes(code[i]) + 1) {
+      if (operandBytes(code[i]) < 0 || i + operandBytes(code[i]) >= size) {
+        return false;
+      }
+      starts[i] = true;
+    }
+    // the lowest height an instruction is reached with, -1 until it is.
+    std::vector<int> heights(size, -1);
+    std::vector<size_t> work;
+    auto reach = [&](size_t target, int height) {
+      if (target >= size || !starts[target]) {
+        return false;
+      }
+      if (heights[target] == -1 || height < heights[target]) {
+        heights[target] = height;
+        work.push_back(target);
+      }
+      return true;
+    };
+    auto isConstant = [&](uint8_t index, ImageTag tag) {
+      return index < entry.constants && pool[index].tag == tag;
+    };
+    // the function and its arguments.
+    reach(0, entry.index + 1);
+    while (!work.empty()) {
+      size_t i = work.back();
+      work.pop_back();
+      int height = heights[i];
+      uint8_t operand = i + 1 < size ? code[i + 1] : 0;
+      size_t next = i + operandBytes(code[i]) + 1;
+      int pops = 0, pushes = 0;
+      bool ok = true;
+      switch (code[i]) {
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+          pushes = 1;
+          break;
+        case OP_CONSTANT:
+          ok = operand < entry.constants;
+          pushes = 1;
+          break;
+        case OP_GET_GLOBAL:
+          ok = isConstant(operand, IMAGE_STRING);
+          pushes = 1;
+          break;
+        case OP_SET_GLOBAL:
+        case OP_GET_PROPERTY:
+          ok = isConstant(operand, IMAGE_STRING);
+          pops = pushes = 1;
+          break;
+        case OP_SET_PROPERTY:
+          ok = isConstant(operand, IMAGE_STRING);
+          pops = 2;
+          pushes = 1;
+          break;
+        case OP_DEFINE_GLOBAL:
+          ok = isConstant(operand, IMAGE_STRING);
+          pops = 1;
+          break;
+        case OP_PRINT:
+        case OP_POP:
+          pops = 1;
+          break;
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_NEGATE_DOUBLE:
+          pops = pushes = 1;
+          break;
+        case OP_GET_INDEX:
+          pops = 2;
+          pushes = 1;
+          break;
+        case OP_SET_INDEX:
+          pops = 3;
+          pushes = 1;
+          break;
+        case OP_CALL:
+        case OP_TAIL_CALL:
+          pops = operand + 1;
+          pushes = 1;
+          break;
+        case OP_ARRAY:
+          pops = operand;
+          pushes = 1;
+          break;
+        case OP_MAP:
+          pops = operand * 2;
+          pushes = 1;
+          break;
+        case OP_GET_LOCAL:
+          ok = operand < height;
+          pushes = 1;
+          break;
+        case OP_SET_LOCAL:
+          ok = operand < height;
+          pops = pushes = 1;
+          break;
+        case OP_APPEND_LOCAL:
+          ok = operand + 1 < height;
+          pops = 1;
+          break;
+        case OP_RETURN:
+          if (height < 1) return false;
+          continue;
+        case OP_JUMP:
+          if (!reach(next + operand, height)) return false;
+          continue;
+        case OP_LOOP:
+          if (operand > next || !reach(next - operand, height)) return false;
+          continue;
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+          ok = height >= 1 && reach(next + operand, height);
+          break;
+        case OP_FOR_PREP:
+          // the counter and the limit.
+          ok = operand + 1 < height && code[i + 2] <= FOR_GREATER_EQUAL &&
+               reach(next + code[i + 3], height);
+          break;
+        case OP_FOR_LOOP:
+          ok = operand + 1 < height && code[i + 2] <= FOR_GREATER_EQUAL &&
+               isConstant(code[i + 3], IMAGE_NUMBER) &&
+               code[i + 4] <= next && reach(next - code[i + 4], height);
+          break;
+        default:
+          // the arithmetic, comparisons and their quickened forms.
+          pops = 2;
+          pushes = 1;
+          break;
+      }
+      if (!ok || height < pops || !reach(next, height - pops + pushes)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Loader::readValue(const ImageConstant& constant, Value& value) const {
+    if (!checkConstant(constant)) {
+      return false;
+    }
+    value = imageValue(constant, data_, image_.objects.data());
+    return true;
+  }
+
+  const CacheField* Loader::fieldTable(uint32_t offset, uint32_t count) const {
+    auto fields = array<CacheField>(offset, count);
+    for (uint32_t i = 0; fields && i < count; i++) {
+      if (!inBounds(fields[i].name, fields[i].nameSize) || !checkConstant(fields[i].value)) {
+        return nullptr;
+      }
+    }
+    return fields;
+  }
+
+  bool Loader::load(const CacheHeader& header, Vm& vm) {
+    auto table = array<CacheObject>(sizeof(CacheHeader), header.objects);
+    if (!table) {
+      return false;
+    }
+    auto& objects = image_.objects;
+    // the objects refer to each other by index, they're all created before
+    // they're filled in. an instance is created with its class.
+    for (uint32_t i = 0; i < header.objects; i++) {
+      const auto& entry = table[i];
+      if (!inBounds(entry.name, entry.nameSize)) return false;
+      Obj* obj = nullptr;
+      if (entry.kind == CACHE_FUNCTION) {
+        obj = new ObjFunction(name(entry.name, entry.nameSize), Chunk(), entry.index);
+      } else if (entry.kind == CACHE_CLASS) {
+        obj = new ObjClass(name(entry.name, entry.nameSize));
+      } else if (entry.kind == CACHE_BOUND_METHOD) {
+        obj = new ObjBoundMethod(nullptr, Value());
+      } else if (entry.kind == CACHE_ARRAY) {
+        obj = new ObjArray();
+      } else if (entry.kind == CACHE_MAP) {
+        obj = new ObjMap();
+      } else if (entry.kind == CACHE_FLOAT64_ARRAY) {
+        // the bytes may not be aligned for doubles.
+        if (!inBounds(entry.code, entry.codeSize) || entry.codeSize % sizeof(double) != 0) {
+          return false;
+        }
+        std::vector<double> elements(entry.codeSize / sizeof(double));
+        std::memcpy(elements.data(), data_ + entry.code, entry.codeSize);
+        obj = new ObjFloat64Array(std::move(elements));
+      } else if (entry.kind == CACHE_SLICE) {
+        if (!inBounds(entry.code, entry.codeSize)) return false;
+        obj = new ObjSlice(std::string(data_ + entry.code, entry.codeSize));
+      } else if (entry.kind == CACHE_NATIVE) {
+        // the vm owns its natives.
+        auto native = vm.native(name(entry.name, entry.nameSize));
+        if (!native) return false;
+        objects.push_back(native);
+        continue;
+      } else if (entry.kind != CACHE_INSTANCE) {
+        return false;
+      }
+      objects.push_back(obj);
+      if (obj) vm.addObj(obj);
+    }
+    for (uint32_t i = 0; i < header.objects; i++) {
+      if (table[i].kind != CACHE_INSTANCE) continue;
+      if (!isA(table[i].index, OBJ_CLASS)) return false;
+      objects[i] = new ObjInstance(objects[table[i].index]->asClass());
+      vm.addObj(objects[i]);
+    }
+    for (uint32_t i = 0; i < header.objects; i++) {
+      const auto& entry = table[i];
+      switch (entry.kind) {
+        case CACHE_FUNCTION: {
+          auto pool = array<ImageConstant>(entry.pool, entry.constants);
+          if (!inBounds(entry.code, entry.codeSize) || !pool) return false;
+          for (uint32_t j = 0; j < entry.constants; j++) {
+            if (!checkConstant(pool[j])) return false;
+          }
+          if (!checkCode(entry, pool)) return false;
+          ImageChunk chunk;
+          chunk.code = reinterpret_cast<const OpCode*>(data_ + entry.code);
+          chunk.size = entry.codeSize;
+          chunk.pool = pool;
+          chunk.constants = entry.constants;
+          chunk.image = data_;
+          chunk.objects = objects.data();
+          objects[i]->asFunction()->chunk().mapImage(chunk);
+          break;
+        }
+        case CACHE_CLASS: {
+          auto methods = fieldTable(entry.code, entry.codeSize);
+          if (!methods) return false;
+          for (uint32_t j = 0; j < entry.codeSize; j++) {
+            if (methods[j].value.tag != IMAGE_OBJ ||
+                !isA(methods[j].value.payload, OBJ_FUNCTION)) {
+              return false;
+            }
+            objects[i]->asClass()->addMethod(name(methods[j].name, methods[j].nameSize),
+                                             objects[methods[j].value.payload]->asFunction());
+          }
+          break;
+        }
+        case CACHE_INSTANCE: {
+          auto fields = fieldTable(entry.code, entry.codeSize);
+          if (!fields) return false;
+          for (uint32_t j = 0; j < entry.codeSize; j++) {
+            Value value;
+            readValue(fields[j].value, value);
+            objects[i]->asInstance()->setField(name(fields[j].name, fields[j].nameSize), value);
+          }
+          break;
+        }
+        case CACHE_BOUND_METHOD: {
+          auto receiver = array<ImageConstant>(entry.pool, 1);
+          auto boundMethod = objects[i]->asBoundMethod();
+          if (!isA(entry.index, OBJ_FUNCTION) || !receiver ||
+              !readValue(*receiver, boundMethod->receiver_)) {
+            return false;
+          }
+          boundMethod->method_ = objects[entry.index]->asFunction();
+          break;
+        }
+        case CACHE_ARRAY: {
+          auto pool = array<ImageConstant>(entry.pool, entry.constants);
+          if (!pool) return false;
+          auto& elements = objects[i]->asArray()->elements();
+          elements.resize(entry.constants);
+          for (uint32_t j = 0; j < entry.constants; j++) {
+            if (!readValue(pool[j], elements[j])) return false;
+          }
+          break;
+        }
+        case CACHE_MAP: {
+          auto pool = array<ImageConstant>(entry.pool, entry.constants);
+          if (!pool || entry.constants % 2 != 0) return false;
+          for (uint32_t j = 0; j < entry.constants; j += 2) {
+            Value key, value;
+            if (!readValue(pool[j], key) || !readValue(pool[j + 1], value)) return false;
+            objects[i]->asMap()->table().set(key, value);
+          }
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    return true;
+  }
+
+  // maps the image at `path` and checks that it belongs to `source`
+  // and that it hasn't changed since it was written.
+  bool openImage(const std::string& path, std::string_view source, uint8_t flags,
+                 CacheImage& image, CacheHeader& header) {
+    auto text = image.file.open(path) ? image.file.text() : std::string_view();
+    if (text.size() < sizeof(CacheHeader)) {
+      return false;
+    }
+    std::memcpy(&header, text.data(), sizeof(header));
+    return matches(header, source, flags) &&
+           header.checksum == hashBytes(text.substr(sizeof(CacheHeader)));
+  }
+} // namespace
+
+uint8_t cacheFlags(const Options& options) {
+  return options.optimize ? 1 : 0;
+}
+
+ObjFunction* readCache(const std::string& path, std::string_view source,
+                       uint8_t flags, Vm& vm, CacheImage& image) {
+  CacheHeader header;
+  if (!openImage(path, source, flags, image, header) || !Loader(image).load(header, vm)) {
+    return nullptr;
+  }
+  // the script is called without arguments.
+  if (header.root >= image.objects.size() ||
+      image.objects[header.root]->getType() != OBJ_FUNCTION ||
+      image.objects[header.root]->asFunction()->arity() != 0) {
+    return nullptr;
+  }
+  return image.objects[header.root]->asFunction();
+}
+
+bool writeCache(const std::string& path, std::string_view source,
+                uint8_t flags, ObjFunction* script) {
+  Writer writer;
+  if (!writer.collect(script)) {
+    return false;
+  }
+  return replaceFile(path, writer.write(makeHeader(source, flags), {}));
+}
+
+bool readSnapshot(const std::string& path, std::string_view source, uint8_t flags,
+                  Vm& vm, CacheImage& image, std::unordered_map<std::string, Value>& globals) {
+  CacheHeader header;
+  if (!openImage(path, source, flags, image, header)) {
+    return false;
+  }
+  Loader loader(image);
+  if (!loader.load(header, vm)) {
+    return false;
+  }
+  auto table = loader.fieldTable(header.globalTable, header.globals);
+  if (!table) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header.globals; i++) {
+    Value value;
+    loader.readValue(table[i].value, value);
+    globals[loader.name(table[i].name, table[i].nameSize)] = std::move(value);
+  }
+  return true;
+}
+
+bool writeSnapshot(const std::string& path, std::string_view source, uint8_t flags,
+                   const std::unordered_map<std::string, Value>& globals) {
+  Writer writer;
+  for (const auto& [name, value] : globals) {
+    if (!writer.collect(value)) {
+      return false;
+    }
+  }
+  return replaceFile(path, writer.write(makeHeader(source, flags), globals));
+}
+
+}
@@ -5,16 +5,36 @@
 #include <chunk.h>
 
 #include <ostream>
+#include <string>
+
+#include <cstring>
 
 namespace alien {
 
+Value imageValue(const ImageConstant& constant, const char* image, Obj* const* objects) {
+  switch (constant.tag) {
+    case IMAGE_NIL: return Value();
+    case IMAGE_FALSE: return Value(false);
+    case IMAGE_TRUE: return Value(true);
+    case IMAGE_NUMBER: {
+      double number;
+      std::memcpy(&number, &constant.payload, sizeof(number));
+      return Value(number);
+    }
+    case IMAGE_STRING:
+      return Value(std::string(image + constant.payload, constant.size));
+    case IMAGE_OBJ: return Value(objects[constant.payload]);
+  }
+  return Value();
+}
+
 int Chunk::addConstant(const Value &value) {
   constants_.push_back(value);
   return constants_.size() - 1;
 }
 
 void Chunk::disassembleInstruction(int i, std::ostream &os) {
-  OpCode code = code_[i];
+  OpCode code = instructions()[i];
     switch (code) {
       case OP_NIL: {
         os << "OP_NIL\n";
@@ -29,9 +49,9 @@ void Chunk::disassembleInstruction(int i, std::ostream &os) {
         break;
       }
       case OP_CONSTANT: {
-        int index = code_[++i];
+        int index = instructions()[++i];
         os << "OP_CONSTANT " << index << "(";
-        printValue(constants_[index], os);
+        printValue(getConstant(index), os);
         os << ")\n";
         break;
       }
@@ -76,7 +96,11 @@ void Chunk::disassembleInstruction(int i, std::ostream &os) {
         break;
       }
       case OP_CALL: {
-        os << "OP_CALL " << code_[++i] << '\n';
+        os << "OP_CALL " << instructions()[++i] << '\n';
+        break;
+      }
+      case OP_TAIL_CALL: {
+        os << "OP_TAIL_CALL " << instructions()[++i] << '\n';
         break;
       }
       case OP_RETURN: {
@@ -84,68 +108,157 @@ void Chunk::disassembleInstruction(int i, std::ostream &os) {
         break;
       }
       case OP_GET_LOCAL: {
-        os << "OP_GET_LOCAL " << code_[++i] << '\n';
+        os << "OP_GET_LOCAL " << instructions()[++i] << '\n';
         break;
       }
       case OP_SET_LOCAL: {
-        os << "OP_SET_LOCAL " << code_[++i] << '\n';
+        os << "OP_SET_LOCAL " << instructions()[++i] << '\n';
+        break;
+      }
+      case OP_APPEND_LOCAL: {
+        os << "OP_APPEND_LOCAL " << instructions()[++i] << '\n';
         break;
       }
       case OP_GET_GLOBAL: {
-        int index = code_[++i];
+        int index = instructions()[++i];
         os << "OP_GET_GLOBAL " << index << "(";
-        printValue(constants_[index]);
+        printValue(getConstant(index));
         os << ")\n";
         break;
       }
       case OP_SET_GLOBAL: {
-        int index = code_[++i];
+        int index = instructions()[++i];
         os << "OP_SET_GLOBAL " << index << "(";
-        printValue(constants_[index]);
+        printValue(getConstant(index));
         os << ")\n";
         break;
       }
       case OP_GET_PROPERTY: {
-        int index = code_[++i];
+        int index = instructions()[++i];
         os << "OP_GET_PROPERTY " << index << "(";
-        printValue(constants_[index]);
+        printValue(getConstant(index));
         os << ")\n";
         break;
       }
       case OP_SET_PROPERTY: {
-        int index = code_[++i];
+        int index = instructions()[++i];
         os << "OP_SET_PROPERTY " << index << "(";
-        printValue(constants_[index]);
+        printValue(getConstant(index));
         os << ")\n";
         break;
       }
+      case OP_ARRAY: {
+        os << "OP_ARRAY " << instructions()[++i] << '\n';
+        break;
+      }
+      case OP_MAP: {
+        os << "OP_MAP " << instructions()[++i] << '\n';
+        break;
+      }
+      case OP_GET_INDEX: {
+        os << "OP_GET_INDEX\n";
+        break;
+      }
+      case OP_SET_INDEX: {
+        os << "OP_SET_INDEX\n";
+        break;
+      }
       case OP_DEFINE_GLOBAL: {
-        int index = code_[++i];
+        int index = instructions()[++i];
         os << "OP_DEFINE_GLOBAL " << index << "(";
-        printValue(constants_[index]);
+        printValue(getConstant(index));
         os << ")\n";
         break;
       }
       case OP_LOOP: {
-        os << "OP_LOOP " << code_[++i] << '\n';
+        os << "OP_LOOP " << instructions()[++i] << '\n';
         break;
       }
       case OP_JUMP: {
-        os << "OP_JUMP " << code_[++i] << '\n';
+        os << "OP_JUMP " << instructions()[++i] << '\n';
         break;
       }
       case OP_JUMP_IF_FALSE: {
-        os << "OP_JUMP_IF_FALSE " << code_[++i] << '\n';
+        os << "OP_JUMP_IF_FALSE " << instructions()[++i] << '\n';
         break;
       }
       case OP_JUMP_IF_TRUE: {
-        os << "OP_JUMP_IF_TRUE " << code_[++i] << '\n';
+        os << "OP_JUMP_IF_TRUE " << instructions()[++i] << '\n';
+        break;
+      }
+      case OP_FOR_PREP: {
+        os << "OP_FOR_PREP " << instructions()[i + 1] << ' '
+           << instructions()[i + 2] << ' ' << instructions()[i + 3] << '\n';
+        break;
+      }
+      case OP_FOR_LOOP: {
+        int index = instructions()[i + 3];
+        os << "OP_FOR_LOOP " << instructions()[i + 1] << ' ' << instructions()[i + 2] << ' '
+           << index << "(";
+        printValue(getConstant(index), os);
+        os << ") " << instructions()[i + 4] << '\n';
         break;
       }
       case OP_POP: {
         os << "OP_POP\n";
         break;
       }
+      case OP_ADD_NUM: {
+        os << "OP_ADD_NUM\n";
+        break;
+      }
+      case OP_ADD_STR: {
+        os << "OP_ADD_STR\n";
+        break;
+      }
+      case OP_SUBTRACT_NUM: {
+        os << "OP_SUBTRACT_NUM\n";
+        break;
+      }
+      case OP_MULTIPLY_NUM: {
+        os << "OP_MULTIPLY_NUM\n";
+        break;
+      }
+      case OP_DIVIDE_NUM: {
+        os << "OP_DIVIDE_NUM\n";
+        break;
+      }
+      case OP_GREATER_NUM: {
+        os << "OP_GREATER_NUM\n";
+        break;
+      }
+      case OP_LESS_NUM: {
+        os << "OP_LESS_NUM\n";
+        break;
+      }
+      case OP_ADD_DOUBLE: {
+        os << "OP_ADD_DOUBLE\n";
+        break;
+      }
+      case OP_SUBTRACT_DOUBLE: {
+        os << "OP_SUBTRACT_DOUBLE\n";
+        break;
+      }
+      case OP_MULTIPLY_DOUBLE: {
+        os << "OP_MULTIPLY_DOUBLE\n";
+        break;
+      }
+      case OP_DIVIDE_DOUBLE: {
+        os << "OP_DIVIDE_DOUBLE\n";
+        break;
+      }
+      case OP_GREATER_DOUBLE: {
+        os << "OP_GREATER_DOUBLE\n";
+        break;
+      }
+      case OP_LESS_DOUBLE: {
+        os << "OP_LESS_DOUBLE\n";
+        break;
+      }
+      case OP_NEGATE_DOUBLE: {
+        os << "OP_NEGATE_DOUBLE\n";
+        break;
+      }
     }
 }
 
@@ -3,13 +3,23 @@
 //
 
 #include <compiler.h>
+#include <parser.h>
 #include <vm.h>
 #include <ast.h>
 #include <value.h>
 #include <object.h>
+#include <ir_builder.h>
+#include <ir_passes.h>
+#include <ir_lowering.h>
+#include <ir_types.h>
+#include <parallel.h>
 
+#include <algorithm>
+#include <iostream>
+#include <memory>
 #include <vector>
 #include <string_view>
+#include <unordered_set>
 
 #include <cassert>
 
@@ -20,8 +30,207 @@ namespace {
   void compileTimeError(std::string_view message) {
     std::cerr << message << '\n';
   }
+
+  bool isVariable(Expr* expr, std::string_view name) {
+    if (!expr || expr->getType() != Expr::VARIABLE) {
+      return false;
+    }
+    return static_cast<Variable*>(expr)->name.lexeme_ == name;
+  }
+
+  // an inlined body is a single return of at most this many nodes,
+  // calls nest at most this deep.
+  const int kMaxInlineSize = 16;
+  const int kMaxInlineDepth = 4;
+
+  // the names which are referenced, assigned, set as a property
+  // or declared as a method anywhere.
+  class NameCollector : public AstWalker {
+  public:
+    using AstWalker::visit;
+    void visit(ClassDecl& decl) override {
+      for (const auto& method : decl.methods) {
+        methods.insert(static_cast<FuncDecl*>(method.get())->name.lexeme_);
+      }
+      AstWalker::visit(decl);
+    }
+    void visit(FuncDecl& decl) override {
+      // a body the pre-parser skipped.
+      assigned.insert(decl.assigned.begin(), decl.assigned.end());
+      properties.insert(decl.setProperties.begin(), decl.setProperties.end());
+      AstWalker::visit(decl);
+    }
+    void visit(Assign& expr) override {
+      assigned.insert(expr.name.lexeme_);
+      AstWalker::visit(expr);
+    }
+    void visit(Set& expr) override {
+      properties.insert(expr.name.lexeme_);
+      AstWalker::visit(expr);
+    }
+    void visit(Variable& expr) override {
+      references[expr.name.lexeme_]++;
+    }
+    std::unordered_map<std::string_view, int> references;
+    std::unordered_set<std::string_view> assigned;
+    std::unordered_set<std::string_view> properties;
+    std::unordered_set<std::string_view> methods;
+  };
+
+  // whether a top-level initializer may run a function.
+  class CallFinder : public AstWalker {
+  public:
+    using AstWalker::visit;
+    void visit(Call& expr) override { found = true; }
+    bool found = false;
+  };
+
+  bool isParameter(const FuncDecl& decl, std::string_view name) {
+    for (const auto& parameter : decl.parameters) {
+      if (parameter.lexeme_ == name) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // counts the nodes of a body and rejects what can't be substituted.
+  class InlineChecker : public AstWalker {
+  public:
+    explicit InlineChecker(const FuncDecl& decl)
+    : decl_(decl) {}
+    using AstWalker::visit;
+    void visit(Assign& expr) override {
+      size++;
+      if (isParameter(decl_, expr.name.lexeme_)) {
+        valid = false;
+      }
+      AstWalker::visit(expr);
+    }
+    void visit(Binary& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Call& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Get& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Grouping& expr) override { AstWalker::visit(expr); }
+    void visit(Set& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Unary& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Variable& expr) override { size++; }
+    void visit(Logical& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Number& expr) override { size++; }
+    void visit(String& expr) override { size++; }
+    void visit(Literal& expr) override { size++; }
+    void visit(This& expr) override { size++; usesThis = true; }
+    void visit(Array& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Map& expr) override { size++; AstWalker::visit(expr); }
+    void visit(Index& expr) override { size++; AstWalker::visit(expr); }
+    void visit(IndexSet& expr) override { size++; AstWalker::visit(expr); }
+    int size = 0;
+    bool usesThis = false;
+    bool valid = true;
+  private:
+    const FuncDecl& decl_;
+  };
+
+  // the returned expression if `decl` is small enough to be inlined.
+  Expr* inlineBody(FuncDecl& decl, bool isMethod) {
+    if (!Parser::parseBody(decl)) {
+      return nullptr;
+    }
+    auto block = dynamic_cast<BlockStmt*>(decl.body.get());
+    if (!block || block->stmts.size() != 1) {
+      return nullptr;
+    }
+    auto stmt = dynamic_cast<ReturnStmt*>(block->stmts[0].get());
+    if (!stmt || !stmt->expr) {
+      return nullptr;
+    }
+    for (size_t i = 0; i < decl.parameters.size(); i++) {
+      for (size_t j = 0; j < i; j++) {
+        if (decl.parameters[i].lexeme_ == decl.parameters[j].lexeme_) {
+          return nullptr;
+        }
+      }
+    }
+    InlineChecker checker(decl);
+    stmt->expr->accept(checker);
+    if (!checker.valid || checker.size > kMaxInlineSize || (checker.usesThis && !isMethod)) {
+      return nullptr;
+    }
+    return stmt->expr.get();
+  }
+
+  // the arguments replace the parameters in the inlined body, which must keep
+  // the order they are evaluated in. those which aren't simple must be used
+  // exactly once, in order, unconditionally and before anything else happens.
+  class OrderChecker : public AstWalker {
+  public:
+    OrderChecker(const FuncDecl& decl, const std::vector<std::string_view>& ordered)
+    : decl_(decl), ordered_(ordered) {}
+    using AstWalker::visit;
+    void visit(Assign& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(Binary& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(Call& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(Get& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(Set& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(Unary& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(Index& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(IndexSet& expr) override { AstWalker::visit(expr); effect_ = true; }
+    void visit(Logical& expr) override {
+      expr.left->accept(*this);
+      conditional_++;
+      expr.right->accept(*this);
+      conditional_--;
+    }
+    void visit(Variable& expr) override {
+      auto name = expr.name.lexeme_;
+      if (!isParameter(decl_, name)) {
+        // a global may be changed by an argument.
+        effect_ = true;
+        return;
+      }
+      if (std::find(ordered_.begin(), ordered_.end(), name) == ordered_.end()) {
+        return;
+      }
+      if (effect_ || conditional_ > 0 || next_ == ordered_.size() || ordered_[next_] != name) {
+        failed_ = true;
+        return;
+      }
+      next_++;
+    }
+    bool ok() const { return !failed_ && next_ == ordered_.size(); }
+  private:
+    const FuncDecl& decl_;
+    const std::vector<std::string_view>& ordered_;
+    size_t next_ = 0;
+    int conditional_ = 0;
+    bool effect_ = false;
+    bool failed_ = false;
+  };
 } // namespace
 
+// `s = s + e` whose value isn't used, where `s` is a local `e` doesn't
+// assign. the local is added to in place, a string isn't copied to the
+// stack and back, so building one piece by piece is linear.
+bool Compiler::compileAppend(Expr &expr) {
+  auto assign = dynamic_cast<Assign*>(&expr);
+  if (!assign) {
+    return false;
+  }
+  std::string_view name = assign->name.lexeme_;
+  auto sum = dynamic_cast<Binary*>(assign->value.get());
+  if (!sum || sum->op.type_ != TOKEN_PLUS || !isVariable(sum->left.get(), name) ||
+      inlineParameter(name) != -1) {
+    return false;
+  }
+  int index = resolveLocal(name);
+  if (index == -1 || isAssigned(name, *sum->right)) {
+    return false;
+  }
+  sum->right->accept(*this);
+  currentChunk_->write(OP_APPEND_LOCAL);
+  currentChunk_->write(static_cast<OpCode>(index));
+  return true;
+}
+
 void Compiler::fixJump(int offset) {
   assert(currentChunk_->code()[offset] == 0xff);
   // -1 to skip the offset itself.
@@ -36,12 +245,98 @@ void Compiler::emitLoop(int loopStart) {
   currentChunk_->write(static_cast<OpCode>(offset));
 }
 
+// for (var i = a; i < b; i = i + c) { ... }
+// where `b` is a number or a local which the loop never assigns,
+// and `c` is a number. the limit is evaluated once into a hidden local,
+// then OP_FOR_LOOP steps, compares and jumps back in one dispatch.
+bool Compiler::compileCountedLoop(ForStmt &stmt) {
+  auto decl = dynamic_cast<VarDecl*>(stmt.initializer.get());
+  auto cond = dynamic_cast<Binary*>(stmt.condition.get());
+  auto incr = dynamic_cast<Assign*>(stmt.increment.get());
+  if (!decl || !decl->initializer || !cond || !incr) {
+    return false;
+  }
+  std::string_view name = decl->name.lexeme_;
+  ForCompare compare;
+  switch (cond->op.type_) {
+    case TOKEN_LESS:          compare = FOR_LESS; break;
+    case TOKEN_LESS_EQUAL:    compare = FOR_LESS_EQUAL; break;
+    case TOKEN_GREATER:       compare = FOR_GREATER; break;
+    case TOKEN_GREATER_EQUAL: compare = FOR_GREATER_EQUAL; break;
+    default:
+      return false;
+  }
+  if (!isVariable(cond->left.get(), name) || incr->name.lexeme_ != name) {
+    return false;
+  }
+  // the limit must be loop-invariant.
+  Expr* limit = cond->right.get();
+  if (!dynamic_cast<Number*>(limit)) {
+    if (limit->getType() != Expr::VARIABLE) {
+      return false;
+    }
+    std::string_view bound = static_cast<Variable*>(limit)->name.lexeme_;
+    if (bound == name || resolveLocal(bound) == -1 ||
+        isAssigned(bound, *stmt.body) || isAssigned(bound, *incr)) {
+      return false;
+    }
+  }
+  // the step must be `i + c`, `c + i` or `i - c`.
+  auto step = dynamic_cast<Binary*>(incr->value.get());
+  if (!step) {
+    return false;
+  }
+  Number* delta = nullptr;
+  if (isVariable(step->left.get(), name)) {
+    delta = dynamic_cast<Number*>(step->right.get());
+  } else if (step->op.type_ == TOKEN_PLUS && isVariable(step->right.get(), name)) {
+    delta = dynamic_cast<Number*>(step->left.get());
+  }
+  if (!delta || (step->op.type_ != TOKEN_PLUS && step->op.type_ != TOKEN_MINUS)) {
+    return false;
+  }
+  if (isAssigned(name, *stmt.body)) {
+    return false;
+  }
+
+  beginScope();
+  decl->accept(*this);
+  int slot = locals_.size() - 1;
+  limit->accept(*this);
+  // can't be resolved, identifiers are never empty.
+  addLocal("");
+  double value = step->op.type_ == TOKEN_PLUS ? delta->value : -delta->value;
+  int constant = currentChunk_->addConstant(Value(value));
+
+  currentChunk_->write(OP_FOR_PREP);
+  currentChunk_->write(static_cast<OpCode>(slot));
+  currentChunk_->write(static_cast<OpCode>(compare));
+  int exitJump = currentChunk_->code().size();
+  currentChunk_->write(static_cast<OpCode>(0xff));
+  int loopStart = currentChunk_->code().size();
+  stmt.body->accept(*this);
+  currentChunk_->write(OP_FOR_LOOP);
+  currentChunk_->write(static_cast<OpCode>(slot));
+  currentChunk_->write(static_cast<OpCode>(compare));
+  currentChunk_->write(static_cast<OpCode>(constant));
+  // +1 to skip the loop's offset.
+  int offset = currentChunk_->code().size() + 1 - loopStart;
+  currentChunk_->write(static_cast<OpCode>(offset));
+  fixJump(exitJump);
+  endScope();
+  return true;
+}
+
 void Compiler::addLocal(std::string_view name) {
   locals_.push_back(Local{depth_, name});
 }
 
 // TODO: check this `var a = a;`
 int Compiler::resolveLocal(std::string_view name) {
+  // an inlined body only sees its parameters and the globals.
+  if (!inlineFrames_.empty()) {
+    return -1;
+  }
   for (int i = locals_.size() - 1; i >= 0; i--) {
     if (locals_[i].name == name) {
       return i;
@@ -74,25 +369,198 @@ void Compiler::initFunction(std::string_view name) {
   isInitializer = currentClass_ && name == "init";
 }
 
-ObjFunction* Compiler::compile(std::vector<StmtPtr>& stmts) {
+// the bodies are compiled into compiledChunks_ before the declarations are
+// visited, which then create the objects and define the globals in order.
+void Compiler::compileInParallel(std::vector<StmtPtr> &stmts, int jobs) {
+  struct Unit {
+    FuncDecl* decl;
+    ObjClass* klass;
+    Chunk chunk;
+  };
+  std::vector<Unit> units;
+  for (const auto& stmt : stmts) {
+    if (auto decl = dynamic_cast<FuncDecl*>(stmt.get())) {
+      units.push_back({decl, nullptr, Chunk()});
+    } else if (auto decl = dynamic_cast<ClassDecl*>(stmt.get())) {
+      auto klass = declareClass(*decl);
+      declaredClasses_.emplace(decl, klass);
+      for (const auto& method : decl->methods) {
+        units.push_back({static_cast<FuncDecl*>(method.get()), klass, Chunk()});
+      }
+    }
+  }
+  // the units are striped over the workers, each one has its own
+  // compiler with a copy of what the analysis found.
+  std::vector<std::unique_ptr<Compiler>> workers;
+  for (int i = 0; i < jobs; i++) {
+    auto worker = std::make_unique<Compiler>(vm_);
+    worker->inlineFunctions_ = inlineFunctions_;
+    worker->setProperties_ = setProperties_;
+    worker->methodNames_ = methodNames_;
+    worker->classInlineMethods_ = classInlineMethods_;
+    worker->signatures_ = signatures_;
+    workers.push_back(std::move(worker));
+  }
+  for (size_t i = 0; i < units.size(); i++) {
+    auto it = irFunctions_.find(units[i].decl);
+    if (it != irFunctions_.end()) {
+      workers[i % jobs]->irFunctions_.emplace(it->first, std::move(it->second));
+      irFunctions_.erase(it);
+    }
+  }
+  // the skipped bodies are all parsed first, inlining reads the others.
+  parallelFor(jobs, jobs, [&](int w) {
+    for (size_t i = w; i < units.size(); i += jobs) {
+      if (!Parser::parseBody(*units[i].decl)) {
+        workers[w]->hadError_ = true;
+      }
+    }
+  });
+  parallelFor(jobs, jobs, [&](int w) {
+    auto& worker = *workers[w];
+    for (size_t i = w; i < units.size(); i += jobs) {
+      worker.currentClass_ = units[i].klass;
+      worker.inlineMethods_ = worker.classInlineMethods_[units[i].klass];
+      worker.compileFunction(*units[i].decl, units[i].chunk);
+    }
+  });
+  for (const auto& worker : workers) {
+    hadError_ = hadError_ || worker->hadError_;
+  }
+  for (auto& unit : units) {
+    compiledChunks_.emplace(unit.decl, std::move(unit.chunk));
+  }
+}
+
+void Compiler::analyzeProgram(std::vector<StmtPtr> &stmts) {
+  NameCollector collector;
+  std::unordered_map<std::string_view, int> definitions;
+  for (const auto& stmt : stmts) {
+    stmt->accept(collector);
+    if (auto decl = dynamic_cast<FuncDecl*>(stmt.get())) {
+      definitions[decl->name.lexeme_]++;
+    } else if (auto decl = dynamic_cast<VarDecl*>(stmt.get())) {
+      definitions[decl->name.lexeme_]++;
+    } else if (auto decl = dynamic_cast<ConstDecl*>(stmt.get())) {
+      definitions[decl->name.lexeme_]++;
+    } else if (auto decl = dynamic_cast<ClassDecl*>(stmt.get())) {
+      definitions[decl->name.lexeme_]++;
+    }
+  }
+  // a function called by an initializer may call the functions
+  // declared after it before they're defined, they aren't inlined.
+  CallFinder calls;
+  for (const auto& stmt : stmts) {
+    auto decl = dynamic_cast<FuncDecl*>(stmt.get());
+    if (!decl) {
+      if (dynamic_cast<VarDecl*>(stmt.get()) || dynamic_cast<ConstDecl*>(stmt.get())) {
+        stmt->accept(calls);
+      }
+      continue;
+    }
+    if (calls.found || open_ || definitions[decl->name.lexeme_] != 1 ||
+        collector.assigned.count(decl->name.lexeme_)) {
+      continue;
+    }
+    // a skipped body is parsed when a call to it is compiled.
+    if (!decl->body || inlineBody(*decl, false)) {
+      inlineFunctions_.emplace(decl->name.lexeme_, decl);
+    }
+  }
+  setProperties_ = std::move(collector.properties);
+  methodNames_ = std::move(collector.methods);
+  if (!vm_.options().optimize) {
+    return;
+  }
+  // build the global functions up front, the types
+  // of the parameters come from the calls in the others.
+  std::vector<IrFunction*> funcs;
+  std::unordered_map<std::string, int> references;
+  std::unordered_set<std::string> escaped;
+  for (const auto& stmt : stmts) {
+    auto decl = dynamic_cast<FuncDecl*>(stmt.get());
+    if (!decl) {
+      continue;
+    }
+    IrBuilder builder;
+    auto func = builder.build(*decl, false);
+    if (!func) {
+      continue;
+    }
+    // count before the loads are merged, but after the
+    // trivial phis in front of the first slot are gone.
+    propagateCopies(*func);
+    countReferences(*func, references, escaped);
+    optimize(*func, methodNames_, vm_.options().dumpIr ? &std::cout : nullptr);
+    funcs.push_back(func.get());
+    irFunctions_.emplace(decl, std::move(func));
+  }
+  std::unordered_set<std::string> stable;
+  std::unordered_set<std::string> closed;
+  for (auto func : funcs) {
+    const auto& name = func->name;
+    if (open_ || definitions[name] != 1 || collector.assigned.count(name)) {
+      continue;
+    }
+    stable.insert(name);
+    // `main` is called by the script. otherwise every use of
+    // the name must be a call whose arguments we know.
+    if (name != "main" && !escaped.count(name) &&
+        collector.references[name] == references[name]) {
+      closed.insert(name);
+    }
+  }
+  signatures_ = inferSignatures(funcs, stable, closed);
+}
+
+ObjFunction* Compiler::compile(std::vector<StmtPtr>& stmts, bool callMain) {
+  analyzeProgram(stmts);
+  const auto& options = vm_.options();
+  if (options.jobs > 1 && !options.dumpIr && !options.dumpTypes) {
+    compileInParallel(stmts, options.jobs);
+  }
   for (const auto& stmt : stmts) {
     stmt->accept(*this);
   }
-  globalChunk_.write(OP_GET_GLOBAL);
-  std::string name("main");
-  int index = globalChunk_.addConstant(name);
-  globalChunk_.write(static_cast<OpCode>(index));
-  globalChunk_.write(OP_CALL);
-  globalChunk_.write(static_cast<OpCode>(0));
+  if (callMain) {
+    globalChunk_.write(OP_GET_GLOBAL);
+    std::string name("main");
+    int index = globalChunk_.addConstant(name);
+    globalChunk_.write(static_cast<OpCode>(index));
+    globalChunk_.write(OP_CALL);
+    globalChunk_.write(static_cast<OpCode>(0));
+  }
   globalChunk_.write(OP_NIL);
   globalChunk_.write(OP_RETURN);
   return new ObjFunction("script", globalChunk_, 0);
 }
 
+ObjClass* Compiler::declareClass(ClassDecl &decl) {
+  std::string name(decl.name.lexeme_.data(), decl.name.lexeme_.size());
+  auto klass = new ObjClass(name);
+  vm_.addObj(klass);
+  // a field of the same name would hide the method.
+  std::unordered_map<std::string_view, int> definitions;
+  for (const auto& method : decl.methods) {
+    definitions[static_cast<FuncDecl*>(method.get())->name.lexeme_]++;
+  }
+  auto& inlineMethods = classInlineMethods_[klass];
+  for (const auto& method : decl.methods) {
+    auto func = static_cast<FuncDecl*>(method.get());
+    auto methodName = func->name.lexeme_;
+    if (methodName != "init" && definitions[methodName] == 1 &&
+        !setProperties_.count(methodName) && (!func->body || inlineBody(*func, true))) {
+      inlineMethods.emplace(methodName, func);
+    }
+  }
+  return klass;
+}
+
 void Compiler::visit(ClassDecl &decl) {
   std::string name(decl.name.lexeme_.data(), decl.name.lexeme_.size());
-  currentClass_ = new ObjClass(name);
-  vm_.addObj(currentClass_);
+  auto declared = declaredClasses_.find(&decl);
+  currentClass_ = declared != declaredClasses_.end() ? declared->second : declareClass(decl);
+  inlineMethods_ = classInlineMethods_[currentClass_];
   for (const auto& method : decl.methods) {
     method->accept(*this);
   }
@@ -104,33 +572,28 @@ void Compiler::visit(ClassDecl &decl) {
   index = globalChunk_.addConstant(name);
   globalChunk_.write(static_cast<OpCode>(index));
   currentClass_ = nullptr;
+  inlineMethods_.clear();
 }
 
 void Compiler::visit(FuncDecl &decl) {
-  // let the variable declaration in this function
-  // not to be in the global.
-  beginScope();
-  Chunk chunk;
-  currentChunk_ = &chunk;
-  initFunction(decl.name.lexeme_);
-  // TODO: check whether the parameter is duplicated.
-  for (const auto& parameter : decl.parameters) {
-    addLocal(parameter.lexeme_);
-  }
-  // we want the arguments and the ObjFunction to be in the same scope.
-  auto blockStmt = dynamic_cast<BlockStmt*>(decl.body.get());
-  for (const auto& stmt : blockStmt->stmts) {
-    stmt->accept(*this);
-  }
-  if (decl.name.lexeme_ == "init" && currentClass_) {
-    currentChunk_->write(OP_GET_LOCAL);
-    currentChunk_->write(static_cast<OpCode>(0));
+  std::string name(decl.name.lexeme_.data(), decl.name.lexeme_.size());
+  ObjFunction* func;
+  // an initializer is compiled now, `return` in it is a compile error.
+  // a cached script has every function compiled.
+  bool lazy = lazy_ && !isInitializerDecl(decl) && vm_.options().cacheFile.empty() &&
+              vm_.options().snapshotFile.empty() &&
+              !vm_.options().dumpIr && !vm_.options().dumpTypes;
+  auto compiled = compiledChunks_.find(&decl);
+  if (compiled != compiledChunks_.end()) {
+    func = new ObjFunction(name, std::move(compiled->second), decl.parameters.size());
+  } else if (lazy) {
+    func = new ObjFunction(name, decl.parameters.size());
+    lazyFunctions_.emplace(func, LazyFunction{&decl, currentClass_});
   } else {
-    currentChunk_->write(OP_NIL);
+    Chunk chunk;
+    compileFunction(decl, chunk);
+    func = new ObjFunction(name, chunk, decl.parameters.size());
   }
-  currentChunk_->write(OP_RETURN);
-  std::string name(decl.name.lexeme_.data(), decl.name.lexeme_.size());
-  auto func = new ObjFunction(name, chunk, decl.parameters.size());
   // for garbage collection.
   vm_.addObj(func);
   if (currentClass_) {
@@ -144,11 +607,94 @@ void Compiler::visit(FuncDecl &decl) {
     globalChunk_.write(OP_DEFINE_GLOBAL);
     globalChunk_.write(static_cast<OpCode>(index));
   }
+}
+
+bool Compiler::compileLazily(ObjFunction *func) {
+  auto it = lazyFunctions_.find(func);
+  assert(it != lazyFunctions_.end());
+  auto [decl, klass] = it->second;
+  lazyFunctions_.erase(it);
+  // the program has finished compiling, only the class matters.
+  currentClass_ = klass;
+  std::swap(inlineMethods_, classInlineMethods_[klass]);
+  Chunk chunk;
+  compileFunction(*decl, chunk);
+  func->setChunk(std::move(chunk));
+  std::swap(inlineMethods_, classInlineMethods_[klass]);
+  currentClass_ = nullptr;
+  return !hadError_;
+}
+
+bool Compiler::isInitializerDecl(FuncDecl &decl) const {
+  return currentClass_ && decl.name.lexeme_ == "init";
+}
+
+void Compiler::compileFunction(FuncDecl &decl, Chunk &chunk) {
+  if (!Parser::parseBody(decl)) {
+    hadError_ = true;
+    return;
+  }
+  // let the variable declaration in this function
+  // not to be in the global.
+  beginScope();
+  currentChunk_ = &chunk;
+  // the top-level code compiled after the body mustn't see its locals.
+  auto enclosing = std::move(locals_);
+  initFunction(decl.name.lexeme_);
+  // TODO: check whether the parameter is duplicated.
+  for (const auto& parameter : decl.parameters) {
+    addLocal(parameter.lexeme_);
+  }
+  if (!vm_.options().optimize || !compileOptimized(decl, chunk)) {
+    // we want the arguments and the ObjFunction to be in the same scope.
+    auto blockStmt = static_cast<BlockStmt*>(decl.body.get());
+    for (const auto& stmt : blockStmt->stmts) {
+      stmt->accept(*this);
+    }
+    if (decl.name.lexeme_ == "init" && currentClass_) {
+      currentChunk_->write(OP_GET_LOCAL);
+      currentChunk_->write(static_cast<OpCode>(0));
+    } else {
+      currentChunk_->write(OP_NIL);
+    }
+    currentChunk_->write(OP_RETURN);
+  }
   // we don't generate a series of OP_POP;
   depth_--;
+  locals_ = std::move(enclosing);
   currentChunk_ = &globalChunk_;
 }
 
+bool Compiler::compileOptimized(FuncDecl &decl, Chunk &chunk) {
+  std::unique_ptr<IrFunction> func;
+  auto it = irFunctions_.find(&decl);
+  if (it != irFunctions_.end()) {
+    func = std::move(it->second);
+    irFunctions_.erase(it);
+  } else {
+    IrBuilder builder;
+    func = builder.build(decl, currentClass_ != nullptr);
+    if (!func) {
+      return false;
+    }
+    optimize(*func, methodNames_, vm_.options().dumpIr ? &std::cout : nullptr);
+  }
+  std::vector<Type> parameters(func->arity, TYPE_ANY);
+  auto found = signatures_.find(func->name);
+  if (!currentClass_ && found != signatures_.end()) {
+    parameters = found->second.parameters;
+  }
+  auto types = inferTypes(*func, parameters, &signatures_);
+  if (vm_.options().dumpTypes) {
+    dumpTypes(*func, types, std::cout);
+  }
+  if (lowerToChunk(*func, chunk, types)) {
+    return true;
+  }
+  chunk = Chunk();
+  return false;
+}
+
 void Compiler::visit(VarDecl &decl) {
   if (depth_ == 0) {
     std::string name(decl.name.lexeme_.data(), decl.name.lexeme_.size());
@@ -214,6 +760,9 @@ void Compiler::visit(WhileStmt &stmt) {
 }
 
 void Compiler::visit(ForStmt &stmt) {
+  if (compileCountedLoop(stmt)) {
+    return;
+  }
   // the initializer's scope.
   beginScope();
   if (stmt.initializer) {
@@ -232,7 +781,7 @@ void Compiler::visit(ForStmt &stmt) {
     currentChunk_->write(OP_POP);
   }
   stmt.body->accept(*this);
-  if (stmt.increment) {
+  if (stmt.increment && !compileAppend(*stmt.increment)) {
     stmt.increment->accept(*this);
     currentChunk_->write(OP_POP);
   }
@@ -255,7 +804,10 @@ void Compiler::visit(ReturnStmt &stmt) {
     compileTimeError("can't use `return` keyword in a initializer.");
     hadError_ = true;
   }
-  if (stmt.expr) {
+  if (auto call = dynamic_cast<Call*>(stmt.expr.get())) {
+    // the callee takes over the frame.
+    emitCall(*call, true);
+  } else if (stmt.expr) {
     stmt.expr->accept(*this);
   } else {
     currentChunk_->write(OP_NIL);
@@ -264,6 +816,9 @@ void Compiler::visit(ReturnStmt &stmt) {
 }
 
 void Compiler::visit(ExprStmt &stmt) {
+  if (compileAppend(*stmt.expr)) {
+    return;
+  }
   stmt.expr->accept(*this);
   currentChunk_->write(OP_POP);
 }
@@ -334,12 +889,112 @@ void Compiler::visit(Binary &expr) {
   }
 }
 
+bool Compiler::inlineCall(Call &expr) {
+  // calls in the script may run before the callee is defined.
+  if (currentChunk_ == &globalChunk_ || inlineFrames_.size() >= kMaxInlineDepth) {
+    return false;
+  }
+  FuncDecl* callee = nullptr;
+  Expr* receiver = nullptr;
+  if (auto variable = dynamic_cast<Variable*>(expr.callee.get())) {
+    auto name = variable->name.lexeme_;
+    auto it = inlineFunctions_.find(name);
+    if (it != inlineFunctions_.end() &&
+        inlineParameter(name) == -1 && resolveLocal(name) == -1) {
+      callee = it->second;
+    }
+  } else if (auto get = dynamic_cast<Get*>(expr.callee.get())) {
+    auto it = inlineMethods_.find(get->name.lexeme_);
+    if (it != inlineMethods_.end() && dynamic_cast<This*>(get->object.get())) {
+      callee = it->second;
+      receiver = get->object.get();
+    }
+  }
+  // a wrong number of arguments is reported at runtime.
+  if (!callee || callee->parameters.size() != expr.arguments.size()) {
+    return false;
+  }
+  for (const auto& frame : inlineFrames_) {
+    if (frame.decl == callee) {
+      return false;
+    }
+  }
+  std::vector<std::string_view> ordered;
+  for (size_t i = 0; i < expr.arguments.size(); i++) {
+    if (!isSimpleArgument(*expr.arguments[i], expr.arguments)) {
+      ordered.push_back(callee->parameters[i].lexeme_);
+    }
+  }
+  auto body = inlineBody(*callee, receiver != nullptr);
+  if (!body) {
+    // the callee's skipped body has a syntax error.
+    hadError_ = hadError_ || !callee->body;
+    return false;
+  }
+  OrderChecker checker(*callee, ordered);
+  body->accept(checker);
+  if (!checker.ok()) {
+    return false;
+  }
+  inlineFrames_.push_back({callee, &expr.arguments, receiver});
+  body->accept(*this);
+  inlineFrames_.pop_back();
+  return true;
+}
+
+// constants, `this` and locals no argument assigns
+// can be evaluated any number of times, in any order.
+bool Compiler::isSimpleArgument(Expr &arg, std::vector<ExprPtr> &arguments) {
+  if (dynamic_cast<Number*>(&arg) || dynamic_cast<String*>(&arg) ||
+      dynamic_cast<Literal*>(&arg) || dynamic_cast<This*>(&arg)) {
+    return true;
+  }
+  auto variable = dynamic_cast<Variable*>(&arg);
+  if (!variable || resolveLocal(variable->name.lexeme_) == -1) {
+    return false;
+  }
+  for (const auto& argument : arguments) {
+    if (isAssigned(variable->name.lexeme_, *argument)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Compiler::inlineParameter(std::string_view name) {
+  if (inlineFrames_.empty()) {
+    return -1;
+  }
+  const auto& parameters = inlineFrames_.back().decl->parameters;
+  for (size_t i = 0; i < parameters.size(); i++) {
+    if (parameters[i].lexeme_ == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// the arguments belong to the caller's scope.
+void Compiler::emitArgument(Expr &arg) {
+  auto frame = inlineFrames_.back();
+  inlineFrames_.pop_back();
+  arg.accept(*this);
+  inlineFrames_.push_back(frame);
+}
+
 void Compiler::visit(Call &expr) {
+  emitCall(expr, false);
+}
+
+void Compiler::emitCall(Call &expr, bool tail) {
+  if (inlineCall(expr)) {
+    return;
+  }
   expr.callee->accept(*this);
   for (const auto& arg : expr.arguments) {
     arg->accept(*this);
   }
-  currentChunk_->write(OP_CALL);
+  currentChunk_->write(tail ? OP_TAIL_CALL : OP_CALL);
   currentChunk_->write(static_cast<OpCode>(expr.arguments.size()));
 }
 
@@ -371,6 +1026,11 @@ void Compiler::visit(Unary &expr) {
 }
 
 void Compiler::visit(Variable &expr) {
+  int parameter = inlineParameter(expr.name.lexeme_);
+  if (parameter != -1) {
+    emitArgument(*(*inlineFrames_.back().arguments)[parameter]);
+    return;
+  }
   int index = resolveLocal(expr.name.lexeme_);
   if (index != -1) {
     currentChunk_->write(OP_GET_LOCAL);
@@ -442,8 +1102,52 @@ void Compiler::visit(Literal &expr) {
 }
 
 void Compiler::visit(This &expr) {
+  if (!inlineFrames_.empty()) {
+    emitArgument(*inlineFrames_.back().receiver);
+    return;
+  }
   currentChunk_->write(OP_GET_LOCAL);
   currentChunk_->write(static_cast<OpCode>(0));
 }
 
-}
\ No newline at end of file
+void Compiler::visit(Array &expr) {
+  if (expr.elements.size() > UINT8_MAX) {
+    compileTimeError("too many elements in an array literal.");
+    hadError_ = true;
+    return;
+  }
+  for (const auto& element : expr.elements) {
+    element->accept(*this);
+  }
+  currentChunk_->write(OP_ARRAY);
+  currentChunk_->write(static_cast<OpCode>(expr.elements.size()));
+}
+
+void Compiler::visit(Map &expr) {
+  if (expr.keys.size() > UINT8_MAX) {
+    compileTimeError("too many entries in a map literal.");
+    hadError_ = true;
+    return;
+  }
+  for (size_t i = 0; i < expr.keys.size(); i++) {
+    expr.keys[i]->accept(*this);
+    expr.values[i]->accept(*this);
+  }
+  currentChunk_->write(OP_MAP);
+  currentChunk_->write(static_cast<OpCode>(expr.keys.size()));
+}
+
+void Compiler::visit(Index &expr) {
+  expr.object->accept(*this);
+  expr.index->accept(*this);
+  currentChunk_->write(OP_GET_INDEX);
+}
+
+void Compiler::visit(IndexSet &expr) {
+  expr.object->accept(*this);
+  expr.index->accept(*this);
+  expr.value->accept(*this);
+  currentChunk_->write(OP_SET_INDEX);
+}
+
+}
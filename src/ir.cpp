@@ -0,0 +1,401 @@
+#include <ir.h>
+#include <value.h>
+
+#include <algorithm>
+#include <ostream>
+#include <unordered_set>
+
+#include <cassert>
+
+namespace alien {
+
+namespace {
+  bool isNumber(const IrInstr* instr) {
+    switch (instr->op) {
+      case IR_CONSTANT:
+        return std::holds_alternative<double>(instr->constant);
+      // they can't produce anything else without a runtime error.
+      case IR_SUBTRACT:
+      case IR_MULTIPLY:
+      case IR_DIVIDE:
+      case IR_NEGATE:
+        return true;
+      case IR_ADD:
+        return isNumber(instr->operands[0]) && isNumber(instr->operands[1]);
+      case IR_COPY:
+        return isNumber(instr->operands[0]);
+      default:
+        return false;
+    }
+  }
+
+  bool isString(const IrInstr* instr) {
+    switch (instr->op) {
+      case IR_CONSTANT:
+        return std::holds_alternative<std::string>(instr->constant);
+      case IR_ADD:
+        return isString(instr->operands[0]) && isString(instr->operands[1]);
+      case IR_COPY:
+        return isString(instr->operands[0]);
+      default:
+        return false;
+    }
+  }
+} // namespace
+
+bool IrInstr::isTerminator() const {
+  return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+}
+
+bool IrInstr::canTrap() const {
+  switch (op) {
+    case IR_PARAM:
+    case IR_CONSTANT:
+    case IR_COPY:
+    case IR_PHI:
+    case IR_EQUAL:
+    case IR_NOT:
+    case IR_JUMP:
+    case IR_BRANCH:
+    case IR_RETURN:
+    case IR_PRINT:
+      return false;
+    case IR_ADD:
+      return !(isNumber(operands[0]) && isNumber(operands[1])) &&
+             !(isString(operands[0]) && isString(operands[1]));
+    case IR_SUBTRACT:
+    case IR_MULTIPLY:
+    case IR_DIVIDE:
+    case IR_GREATER:
+    case IR_LESS:
+      return !isNumber(operands[0]) || !isNumber(operands[1]);
+    case IR_NEGATE:
+      return !isNumber(operands[0]);
+    default:
+      return true;
+  }
+}
+
+bool IrInstr::hasSideEffects() const {
+  switch (op) {
+    case IR_SET_GLOBAL:
+    case IR_SET_PROPERTY:
+    case IR_SET_INDEX:
+    case IR_CALL:
+    case IR_PRINT:
+    case IR_JUMP:
+    case IR_BRANCH:
+    case IR_RETURN:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IrInstr::isPure() const {
+  switch (op) {
+    case IR_CONSTANT:
+    case IR_ADD:
+    case IR_SUBTRACT:
+    case IR_MULTIPLY:
+    case IR_DIVIDE:
+    case IR_EQUAL:
+    case IR_GREATER:
+    case IR_LESS:
+    case IR_NOT:
+    case IR_NEGATE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IrInstr::producesValue() const {
+  return op != IR_PRINT && !isTerminator();
+}
+
+void IrInstr::print(std::ostream &os) const {
+  if (producesValue()) {
+    os << 'v' << id << " = ";
+  }
+  os << op;
+  const char* separator = " ";
+  auto next = [&]() -> std::ostream& {
+    os << separator;
+    separator = ", ";
+    return os;
+  };
+  for (size_t i = 0; i < operands.size(); i++) {
+    next() << 'v' << operands[i]->id;
+    if (op == IR_PHI) {
+      os << " b" << block->preds[i]->id;
+    }
+  }
+  switch (op) {
+    case IR_PARAM: {
+      next() << slot;
+      break;
+    }
+    case IR_CONSTANT: {
+      if (std::holds_alternative<std::string>(constant)) {
+        next() << '"' << std::get<std::string>(constant) << '"';
+      } else {
+        printValue(constant, next());
+      }
+      break;
+    }
+    case IR_GET_GLOBAL:
+    case IR_SET_GLOBAL:
+    case IR_GET_PROPERTY:
+    case IR_SET_PROPERTY: {
+      next() << name;
+      break;
+    }
+    case IR_JUMP: {
+      next() << 'b' << block->succs[0]->id;
+      break;
+    }
+    case IR_BRANCH: {
+      next() << 'b' << block->succs[0]->id;
+      next() << 'b' << block->succs[1]->id;
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+IrInstr* IrBlock::terminator() const {
+  if (instrs.empty() || !instrs.back()->isTerminator()) {
+    return nullptr;
+  }
+  return instrs.back();
+}
+
+int IrBlock::predIndex(IrBlock *pred) const {
+  auto it = std::find(preds.begin(), preds.end(), pred);
+  assert(it != preds.end());
+  return it - preds.begin();
+}
+
+IrBlock* IrFunction::newBlock() {
+  blocks.push_back(std::make_unique<IrBlock>(blocks.size()));
+  return blocks.back().get();
+}
+
+IrInstr* IrFunction::newInstr(IrOp op) {
+  instrs_.push_back(std::make_unique<IrInstr>(op, instrs_.size()));
+  return instrs_.back().get();
+}
+
+void IrFunction::addEdge(IrBlock *from, IrBlock *to) {
+  from->succs.push_back(to);
+  to->preds.push_back(from);
+}
+
+void IrFunction::splitCriticalEdges() {
+  // new blocks are appended, take a snapshot.
+  int count = blocks.size();
+  for (int i = 0; i < count; i++) {
+    IrBlock* from = blocks[i].get();
+    if (from->succs.size() < 2) {
+      continue;
+    }
+    for (auto& to : from->succs) {
+      if (to->preds.size() < 2) {
+        continue;
+      }
+      IrBlock* edge = newBlock();
+      *std::find(to->preds.begin(), to->preds.end(), from) = edge;
+      edge->preds.push_back(from);
+      edge->succs.push_back(to);
+      auto jump = newInstr(IR_JUMP);
+      jump->block = edge;
+      edge->instrs.push_back(jump);
+      to = edge;
+    }
+  }
+}
+
+void IrFunction::removeUnreachableBlocks() {
+  std::unordered_set<IrBlock*> reachable;
+  for (auto block : reversePostorder()) {
+    reachable.insert(block);
+  }
+  for (auto& block : blocks) {
+    if (reachable.count(block.get())) {
+      continue;
+    }
+    for (auto succ : block->succs) {
+      if (!reachable.count(succ)) {
+        continue;
+      }
+      int index = succ->predIndex(block.get());
+      succ->preds.erase(succ->preds.begin() + index);
+      for (auto phi : succ->phis) {
+        phi->operands.erase(phi->operands.begin() + index);
+      }
+    }
+    block->preds.clear();
+    block->succs.clear();
+    block->phis.clear();
+    block->instrs.clear();
+  }
+  blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                              [&](const std::unique_ptr<IrBlock>& block) {
+                                return !reachable.count(block.get());
+                              }), blocks.end());
+}
+
+void IrFunction::replaceAllUses(IrInstr *from, IrInstr *to) {
+  for (auto& block : blocks) {
+    for (auto phi : block->phis) {
+      std::replace(phi->operands.begin(), phi->operands.end(), from, to);
+    }
+    for (auto instr : block->instrs) {
+      std::replace(instr->operands.begin(), instr->operands.end(), from, to);
+    }
+  }
+}
+
+void IrFunction::removeInstr(IrInstr *instr) {
+  auto& list = instr->op == IR_PHI ? instr->block->phis : instr->block->instrs;
+  list.erase(std::find(list.begin(), list.end(), instr));
+  instr->block = nullptr;
+}
+
+std::vector<IrBlock*> IrFunction::reversePostorder() {
+  std::vector<IrBlock*> order;
+  std::unordered_set<IrBlock*> visited;
+  // iterative dfs, the pair is the block and the next successor to visit.
+  std::vector<std::pair<IrBlock*, int>> stack;
+  stack.emplace_back(entry, entry->succs.size());
+  visited.insert(entry);
+  while (!stack.empty()) {
+    auto& top = stack.back();
+    if (top.second == 0) {
+      order.push_back(top.first);
+      stack.pop_back();
+      continue;
+    }
+    // visit the successors backwards so that the first one ends up first.
+    IrBlock* succ = top.first->succs[--top.second];
+    if (visited.insert(succ).second) {
+      stack.emplace_back(succ, succ->succs.size());
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+// "A Simple, Fast Dominance Algorithm", Cooper, Harvey and Kennedy.
+void IrFunction::computeDominators() {
+  auto order = reversePostorder();
+  for (auto& block : blocks) {
+    block->idom = nullptr;
+    block->order = -1;
+  }
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i]->order = i;
+  }
+  entry->idom = entry;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1; i < order.size(); i++) {
+      IrBlock* block = order[i];
+      IrBlock* idom = nullptr;
+      for (auto pred : block->preds) {
+        if (!pred->idom) {
+          continue;
+        }
+        if (!idom) {
+          idom = pred;
+          continue;
+        }
+        IrBlock* a = pred;
+        IrBlock* b = idom;
+        while (a != b) {
+          while (a->order > b->order) a = a->idom;
+          while (b->order > a->order) b = b->idom;
+        }
+        idom = a;
+      }
+      if (block->idom != idom) {
+        block->idom = idom;
+        changed = true;
+      }
+    }
+  }
+}
+
+bool IrFunction::dominates(IrBlock *a, IrBlock *b) const {
+  for (;;) {
+    if (a == b) {
+      return true;
+    }
+    if (b == entry) {
+      return false;
+    }
+    b = b->idom;
+  }
+}
+
+void IrFunction::dump(std::ostream &os) {
+  os << "func " << name << '/' << arity << " {\n";
+  for (auto block : reversePostorder()) {
+    os << 'b' << block->id << ':';
+    if (!block->preds.empty()) {
+      os << " ; preds";
+      for (auto pred : block->preds) {
+        os << " b" << pred->id;
+      }
+    }
+    os << '\n';
+    for (auto phi : block->phis) {
+      os << "  ";
+      phi->print(os);
+      os << '\n';
+    }
+    for (auto instr : block->instrs) {
+      os << "  ";
+      instr->print(os);
+      os << '\n';
+    }
+  }
+  os << "}\n";
+}
+
+std::ostream& operator<<(std::ostream& os, IrOp op) {
+  switch (op) {
+    case IR_PARAM:        return os << "param";
+    case IR_CONSTANT:     return os << "const";
+    case IR_COPY:         return os << "copy";
+    case IR_PHI:          return os << "phi";
+    case IR_ADD:          return os << "add";
+    case IR_SUBTRACT:     return os << "sub";
+    case IR_MULTIPLY:     return os << "mul";
+    case IR_DIVIDE:       return os << "div";
+    case IR_EQUAL:        return os << "eq";
+    case IR_GREATER:      return os << "gt";
+    case IR_LESS:         return os << "lt";
+    case IR_NOT:          return os << "not";
+    case IR_NEGATE:       return os << "neg";
+    case IR_GET_GLOBAL:   return os << "getglobal";
+    case IR_SET_GLOBAL:   return os << "setglobal";
+    case IR_GET_PROPERTY: return os << "getprop";
+    case IR_SET_PROPERTY: return os << "setprop";
+    case IR_ARRAY:        return os << "array";
+    case IR_MAP:          return os << "map";
+    case IR_GET_INDEX:    return os << "getindex";
+    case IR_SET_INDEX:    return os << "setindex";
+    case IR_CALL:         return os << "call";
+    case IR_PRINT:        return os << "print";
+    case IR_JUMP:         return os << "jump";
+    case IR_BRANCH:       return os << "branch";
+    case IR_RETURN:       return os << "return";
+  }
+  return os;
+}
+
+}
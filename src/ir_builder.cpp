@@ -0,0 +1,459 @@
+#include <ir_builder.h>
+#include <ir.h>
+#include <ast.h>
+
+#include <string>
+#include <utility>
+
+#include <cassert>
+
+namespace alien {
+
+std::unique_ptr<IrFunction> IrBuilder::build(FuncDecl &decl, bool isMethod) {
+  std::string name(decl.name.lexeme_.data(), decl.name.lexeme_.size());
+  func_ = std::make_unique<IrFunction>(name, decl.parameters.size());
+  func_->isMethod = isMethod;
+  func_->isInitializer = isMethod && name == "init";
+  failed_ = false;
+  depth_ = 1;
+  variables_ = 0;
+  locals_.clear();
+  definitions_.clear();
+  incompletePhis_.clear();
+  sealed_.clear();
+
+  block_ = func_->entry = func_->newBlock();
+  sealBlock(block_);
+  // the same layout as the frame, the first slot is
+  // `this` in methods or the function itself.
+  addLocal(isMethod ? "this" : decl.name.lexeme_);
+  for (const auto& parameter : decl.parameters) {
+    addLocal(parameter.lexeme_);
+  }
+  for (size_t i = 0; i < locals_.size(); i++) {
+    auto param = emit(IR_PARAM);
+    param->slot = i;
+    writeVariable(locals_[i].variable, block_, param);
+  }
+  auto blockStmt = dynamic_cast<BlockStmt*>(decl.body.get());
+  for (const auto& stmt : blockStmt->stmts) {
+    stmt->accept(*this);
+  }
+  if (!block_->terminator()) {
+    auto result = func_->isInitializer ? readVariable(0, block_) : constant(Value());
+    emit(IR_RETURN, {result});
+  }
+  if (failed_) {
+    return nullptr;
+  }
+  func_->removeUnreachableBlocks();
+  return std::move(func_);
+}
+
+IrInstr* IrBuilder::expr(Expr &expr) {
+  expr.accept(*this);
+  return value_;
+}
+
+IrInstr* IrBuilder::emit(IrOp op, std::vector<IrInstr*> operands) {
+  auto instr = func_->newInstr(op);
+  instr->operands = std::move(operands);
+  instr->block = block_;
+  block_->instrs.push_back(instr);
+  return instr;
+}
+
+IrInstr* IrBuilder::constant(const Value &value) {
+  auto instr = emit(IR_CONSTANT);
+  instr->constant = value;
+  return instr;
+}
+
+void IrBuilder::jump(IrBlock *target) {
+  emit(IR_JUMP);
+  func_->addEdge(block_, target);
+}
+
+void IrBuilder::branch(IrInstr *condition, IrBlock *ifTrue, IrBlock *ifFalse) {
+  emit(IR_BRANCH, {condition});
+  func_->addEdge(block_, ifTrue);
+  func_->addEdge(block_, ifFalse);
+}
+
+void IrBuilder::loop(Expr *condition, Stmt &body, Expr *increment) {
+  auto preheader = func_->newBlock();
+  auto header = func_->newBlock();
+  auto exit = func_->newBlock();
+  if (condition) {
+    branch(expr(*condition), preheader, exit);
+  } else {
+    jump(preheader);
+  }
+  sealBlock(preheader);
+  block_ = preheader;
+  jump(header);
+  block_ = header;
+  body.accept(*this);
+  if (increment) {
+    expr(*increment);
+  }
+  if (condition) {
+    branch(expr(*condition), header, exit);
+  } else {
+    jump(header);
+  }
+  sealBlock(header);
+  sealBlock(exit);
+  block_ = exit;
+}
+
+void IrBuilder::addLocal(std::string_view name) {
+  locals_.push_back(Local{depth_, name, variables_++});
+}
+
+int IrBuilder::resolveLocal(std::string_view name) {
+  for (int i = locals_.size() - 1; i >= 0; i--) {
+    if (locals_[i].name == name) {
+      return locals_[i].variable;
+    }
+  }
+  return -1;
+}
+
+void IrBuilder::beginScope() {
+  depth_++;
+}
+
+void IrBuilder::endScope() {
+  while (!locals_.empty() && locals_.back().depth == depth_) {
+    locals_.pop_back();
+  }
+  depth_--;
+}
+
+void IrBuilder::writeVariable(int variable, IrBlock *block, IrInstr *value) {
+  definitions_[block][variable] = value;
+}
+
+IrInstr* IrBuilder::readVariable(int variable, IrBlock *block) {
+  auto& definitions = definitions_[block];
+  auto it = definitions.find(variable);
+  if (it != definitions.end()) {
+    return it->second;
+  }
+  return readVariableRecursive(variable, block);
+}
+
+IrInstr* IrBuilder::readVariableRecursive(int variable, IrBlock *block) {
+  IrInstr* value;
+  if (!sealed_.count(block)) {
+    // the predecessors are not known yet.
+    value = newPhi(block);
+    incompletePhis_[block].emplace_back(variable, value);
+  } else if (block->preds.size() == 1) {
+    value = readVariable(variable, block->preds[0]);
+  } else if (block->preds.empty()) {
+    // unreachable code, e.g. after a return.
+    auto instr = func_->newInstr(IR_CONSTANT);
+    instr->block = block;
+    block->instrs.insert(block->instrs.begin(), instr);
+    value = instr;
+  } else {
+    // break the cycles in loops.
+    value = newPhi(block);
+    writeVariable(variable, block, value);
+    addPhiOperands(variable, value);
+  }
+  writeVariable(variable, block, value);
+  return value;
+}
+
+void IrBuilder::addPhiOperands(int variable, IrInstr *phi) {
+  for (auto pred : phi->block->preds) {
+    phi->operands.push_back(readVariable(variable, pred));
+  }
+}
+
+IrInstr* IrBuilder::newPhi(IrBlock *block) {
+  auto phi = func_->newInstr(IR_PHI);
+  phi->block = block;
+  block->phis.push_back(phi);
+  return phi;
+}
+
+void IrBuilder::sealBlock(IrBlock *block) {
+  for (const auto& item : incompletePhis_[block]) {
+    addPhiOperands(item.first, item.second);
+  }
+  incompletePhis_.erase(block);
+  sealed_.insert(block);
+}
+
+// functions and classes are only declared at the top level.
+void IrBuilder::visit(ClassDecl &decl) {
+  failed_ = true;
+}
+
+void IrBuilder::visit(FuncDecl &decl) {
+  failed_ = true;
+}
+
+void IrBuilder::visit(VarDecl &decl) {
+  IrInstr* value;
+  if (decl.initializer) {
+    value = expr(*decl.initializer);
+    if (decl.initializer->getType() == Expr::VARIABLE &&
+        value->op != IR_GET_GLOBAL) {
+      value = emit(IR_COPY, {value});
+    }
+  } else {
+    value = constant(Value());
+  }
+  addLocal(decl.name.lexeme_);
+  writeVariable(locals_.back().variable, block_, value);
+}
+
+// the bytecode generator doesn't support constants either.
+void IrBuilder::visit(ConstDecl &decl) {}
+
+void IrBuilder::visit(BlockStmt &stmts) {
+  beginScope();
+  for (const auto& stmt : stmts.stmts) {
+    stmt->accept(*this);
+  }
+  endScope();
+}
+
+void IrBuilder::visit(IfStmt &stmt) {
+  auto condition = expr(*stmt.condition);
+  auto thenBlock = func_->newBlock();
+  auto join = func_->newBlock();
+  auto elseBlock = stmt.elseBranch ? func_->newBlock() : join;
+  branch(condition, thenBlock, elseBlock);
+  sealBlock(thenBlock);
+  block_ = thenBlock;
+  stmt.thenBranch->accept(*this);
+  jump(join);
+  if (stmt.elseBranch) {
+    sealBlock(elseBlock);
+    block_ = elseBlock;
+    stmt.elseBranch->accept(*this);
+    jump(join);
+  }
+  sealBlock(join);
+  block_ = join;
+}
+
+void IrBuilder::visit(WhileStmt &stmt) {
+  loop(stmt.condition.get(), *stmt.body, nullptr);
+}
+
+void IrBuilder::visit(ForStmt &stmt) {
+  beginScope();
+  if (stmt.initializer) {
+    stmt.initializer->accept(*this);
+  }
+  loop(stmt.condition.get(), *stmt.body, stmt.increment.get());
+  endScope();
+}
+
+void IrBuilder::visit(PrintStmt &stmt) {
+  emit(IR_PRINT, {expr(*stmt.expr)});
+}
+
+void IrBuilder::visit(ReturnStmt &stmt) {
+  if (func_->isInitializer) {
+    // let the bytecode generator report it.
+    failed_ = true;
+    return;
+  }
+  auto value = stmt.expr ? expr(*stmt.expr) : constant(Value());
+  emit(IR_RETURN, {value});
+  // the rest of the block is unreachable.
+  block_ = func_->newBlock();
+  sealBlock(block_);
+}
+
+void IrBuilder::visit(ExprStmt &stmt) {
+  expr(*stmt.expr);
+}
+
+void IrBuilder::visit(Assign &expr) {
+  int variable = resolveLocal(expr.name.lexeme_);
+  auto value = this->expr(*expr.value);
+  if (variable != -1) {
+    if (expr.value->getType() == Expr::VARIABLE &&
+        value->op != IR_GET_GLOBAL) {
+      value = emit(IR_COPY, {value});
+    }
+    writeVariable(variable, block_, value);
+  } else {
+    auto set = emit(IR_SET_GLOBAL, {value});
+    set->name.assign(expr.name.lexeme_.data(), expr.name.lexeme_.size());
+  }
+  value_ = value;
+}
+
+void IrBuilder::visit(Binary &expr) {
+  auto left = this->expr(*expr.left);
+  auto right = this->expr(*expr.right);
+  switch (expr.op.type_) {
+    case TOKEN_PLUS:          value_ = emit(IR_ADD, {left, right}); break;
+    case TOKEN_MINUS:         value_ = emit(IR_SUBTRACT, {left, right}); break;
+    case TOKEN_STAR:          value_ = emit(IR_MULTIPLY, {left, right}); break;
+    case TOKEN_SLASH:         value_ = emit(IR_DIVIDE, {left, right}); break;
+    case TOKEN_EQUAL_EQUAL:   value_ = emit(IR_EQUAL, {left, right}); break;
+    case TOKEN_GREATER:       value_ = emit(IR_GREATER, {left, right}); break;
+    case TOKEN_LESS:          value_ = emit(IR_LESS, {left, right}); break;
+    // the same lowering as the bytecode generator, NaN compares the same way.
+    case TOKEN_BANG_EQUAL: {
+      value_ = emit(IR_NOT, {emit(IR_EQUAL, {left, right})});
+      break;
+    }
+    case TOKEN_GREATER_EQUAL: {
+      value_ = emit(IR_NOT, {emit(IR_LESS, {left, right})});
+      break;
+    }
+    case TOKEN_LESS_EQUAL: {
+      value_ = emit(IR_NOT, {emit(IR_GREATER, {left, right})});
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+void IrBuilder::visit(Call &expr) {
+  std::vector<IrInstr*> operands;
+  operands.push_back(this->expr(*expr.callee));
+  for (const auto& arg : expr.arguments) {
+    operands.push_back(this->expr(*arg));
+  }
+  value_ = emit(IR_CALL, std::move(operands));
+}
+
+void IrBuilder::visit(Get &expr) {
+  auto object = this->expr(*expr.object);
+  value_ = emit(IR_GET_PROPERTY, {object});
+  value_->name.assign(expr.name.lexeme_.data(), expr.name.lexeme_.size());
+}
+
+void IrBuilder::visit(Grouping &expr) {
+  this->expr(*expr.expr);
+}
+
+void IrBuilder::visit(Set &expr) {
+  auto object = this->expr(*expr.object);
+  auto value = this->expr(*expr.value);
+  auto set = emit(IR_SET_PROPERTY, {object, value});
+  set->name.assign(expr.name.lexeme_.data(), expr.name.lexeme_.size());
+  value_ = value;
+}
+
+void IrBuilder::visit(Unary &expr) {
+  auto right = this->expr(*expr.right);
+  value_ = emit(expr.op.type_ == TOKEN_BANG ? IR_NOT : IR_NEGATE, {right});
+}
+
+void IrBuilder::visit(Variable &expr) {
+  int variable = resolveLocal(expr.name.lexeme_);
+  if (variable != -1) {
+    value_ = readVariable(variable, block_);
+  } else {
+    value_ = emit(IR_GET_GLOBAL);
+    value_->name.assign(expr.name.lexeme_.data(), expr.name.lexeme_.size());
+  }
+}
+
+// a and b => a ? b : a.
+// a or b => a ? a : b.
+void IrBuilder::visit(Logical &expr) {
+  auto left = this->expr(*expr.left);
+  auto leftBlock = block_;
+  auto right = func_->newBlock();
+  auto join = func_->newBlock();
+  if (expr.op.type_ == TOKEN_AND) {
+    branch(left, right, join);
+  } else {
+    branch(left, join, right);
+  }
+  sealBlock(right);
+  block_ = right;
+  auto value = this->expr(*expr.right);
+  jump(join);
+  sealBlock(join);
+  block_ = join;
+  auto phi = newPhi(join);
+  for (auto pred : join->preds) {
+    phi->operands.push_back(pred == leftBlock ? left : value);
+  }
+  value_ = phi;
+}
+
+void IrBuilder::visit(Number &expr) {
+  value_ = constant(Value(expr.value));
+}
+
+void IrBuilder::visit(String &expr) {
+  value_ = constant(Value(std::in_place_type<std::string>,
+                          expr.str.data(), expr.str.size()));
+}
+
+void IrBuilder::visit(Literal &expr) {
+  switch (expr.literal) {
+    case TOKEN_NIL:   value_ = constant(Value()); break;
+    case TOKEN_FALSE: value_ = constant(Value(false)); break;
+    case TOKEN_TRUE:  value_ = constant(Value(true)); break;
+    default:
+      assert(false);
+  }
+}
+
+void IrBuilder::visit(This &expr) {
+  value_ = readVariable(0, block_);
+}
+
+void IrBuilder::visit(Array &expr) {
+  if (expr.elements.size() > UINT8_MAX) {
+    // let the bytecode generator report it.
+    failed_ = true;
+    value_ = constant(Value());
+    return;
+  }
+  std::vector<IrInstr*> elements;
+  for (const auto& element : expr.elements) {
+    elements.push_back(this->expr(*element));
+  }
+  value_ = emit(IR_ARRAY, std::move(elements));
+}
+
+void IrBuilder::visit(Map &expr) {
+  if (expr.keys.size() > UINT8_MAX) {
+    failed_ = true;
+    value_ = constant(Value());
+    return;
+  }
+  // the keys and the values alternate.
+  std::vector<IrInstr*> entries;
+  for (size_t i = 0; i < expr.keys.size(); i++) {
+    entries.push_back(this->expr(*expr.keys[i]));
+    entries.push_back(this->expr(*expr.values[i]));
+  }
+  value_ = emit(IR_MAP, std::move(entries));
+}
+
+void IrBuilder::visit(Index &expr) {
+  auto object = this->expr(*expr.object);
+  auto index = this->expr(*expr.index);
+  value_ = emit(IR_GET_INDEX, {object, index});
+}
+
+void IrBuilder::visit(IndexSet &expr) {
+  auto object = this->expr(*expr.object);
+  auto index = this->expr(*expr.index);
+  auto value = this->expr(*expr.value);
+  emit(IR_SET_INDEX, {object, index, value});
+  value_ = value;
+}
+
+}
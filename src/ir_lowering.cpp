@@ -0,0 +1,856 @@
+#include <ir_lowering.h>
+#include <ir.h>
+#include <ir_types.h>
+#include <chunk.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <cassert>
+
+namespace alien {
+
+namespace {
+
+// values live either on the stack of the vm or in frame slots.
+// an instruction with a single use later in the same block is emitted
+// as part of its user's expression tree when nothing else with effects
+// lies in between, every other value is stored in a slot. constants and
+// parameters are loaded again at each use. a phi shares the slot of its
+// operands when none of them is live at the same time, like the variable
+// it came from, so nothing is copied on the edges. `s = s + e` where the
+// old value of s isn't used afterwards appends to the slot of s in place.
+class Lowering {
+public:
+  Lowering(IrFunction& func, Chunk& chunk, const TypeMap& types)
+  : func_(func), chunk_(chunk), types_(types) {}
+  bool run();
+
+private:
+  bool isRematerializable(const IrInstr* instr) const {
+    return instr->op == IR_PARAM || instr->op == IR_CONSTANT;
+  }
+  bool isForwarding(IrBlock* block);
+  IrBlock* resolve(IrBlock* block);
+  void countUses();
+  void selectTrees(IrBlock* block);
+  void computeLiveness();
+  bool hasSlot(IrInstr* value);
+  bool isLiveAfter(IrInstr* value, IrInstr* def);
+  bool interferes(IrInstr* a, IrInstr* b);
+  IrInstr* find(IrInstr* value);
+  bool merge(IrInstr* a, IrInstr* b);
+  void coalesce(bool params);
+  bool needsCopy(IrInstr* phi, IrInstr* operand);
+  void findCountedLoops();
+  void assignSlots();
+
+private:
+  void emitBlock(IrBlock* block, IrBlock* next);
+  void emitRoot(IrInstr* instr);
+  void emitTree(IrInstr* instr);
+  void emitOperand(IrInstr* operand);
+  void emitInstr(IrInstr* instr);
+  void emitPhiCopies(IrBlock* from, IrBlock* to);
+  void emitForLoop(IrBlock* block, IrBlock* next);
+  void emitJump(IrBlock* target, IrBlock* next);
+  void emitBranch(IrBlock* block, IrBlock* next);
+  void load(IrInstr* value);
+
+private:
+  void write(OpCode code) { chunk_.write(code); }
+  void writeByte(int byte);
+  int  constant(const Value& value);
+  // a forward jump within the code of one block.
+  int  writeJump(OpCode code);
+  void fixJump(int offset);
+
+private:
+  // `i = i + step` then `i < limit` at the end of a loop.
+  struct CountedLoop {
+    IrInstr* counter;
+    IrInstr* limit;
+    ForCompare compare;
+    double step;
+    IrBlock* header;
+  };
+
+  IrFunction& func_;
+  Chunk& chunk_;
+  const TypeMap& types_;
+  bool failed_ = false;
+  std::unordered_map<IrInstr*, int> uses_;
+  std::unordered_map<IrInstr*, IrInstr*> user_;
+  std::unordered_set<IrInstr*> inlined_;
+  std::unordered_map<IrInstr*, int> slots_;
+  int slotCount_ = 0;
+  // the values sharing a slot, by the first one of them.
+  std::unordered_map<IrInstr*, IrInstr*> leaders_;
+  std::unordered_map<IrInstr*, std::vector<IrInstr*>> classes_;
+  // the adds which append to the slot of their left operand.
+  std::unordered_set<IrInstr*> appends_;
+  // by the block ending the loop, and its preheader.
+  std::unordered_map<IrBlock*, CountedLoop> loops_;
+  std::unordered_map<IrBlock*, IrBlock*> preheaders_;
+  // the classes of counters, the limit is in the slot after theirs.
+  std::unordered_set<IrInstr*> counters_;
+  std::unordered_map<IrBlock*, std::unordered_set<IrInstr*>> liveIn_;
+  std::unordered_map<IrBlock*, std::unordered_set<IrInstr*>> liveOut_;
+  // of the instructions in their blocks.
+  std::unordered_map<IrInstr*, int> positions_;
+  std::unordered_map<IrBlock*, int> labels_;
+  // forward jumps to blocks, patched at the end.
+  std::vector<std::pair<int, IrBlock*>> patches_;
+};
+
+bool Lowering::run() {
+  func_.splitCriticalEdges();
+  countUses();
+  for (auto& block : func_.blocks) {
+    selectTrees(block.get());
+  }
+  computeLiveness();
+  coalesce(false);
+  findCountedLoops();
+  // the slot after a counter is its limit, it can't be a parameter's.
+  coalesce(true);
+  assignSlots();
+  if (failed_) {
+    return false;
+  }
+  std::vector<IrBlock*> order;
+  for (auto block : func_.reversePostorder()) {
+    if (!isForwarding(block)) {
+      order.push_back(block);
+    }
+  }
+  // the frame starts with the function and the arguments.
+  for (int i = 0; i < slotCount_; i++) {
+    write(OP_NIL);
+  }
+  for (size_t i = 0; i < order.size(); i++) {
+    labels_[order[i]] = chunk_.code().size();
+    emitBlock(order[i], i + 1 < order.size() ? order[i + 1] : nullptr);
+  }
+  for (const auto& patch : patches_) {
+    int target = labels_[resolve(patch.second)];
+    int offset = target - patch.first - 1;
+    if (offset > 0xff) {
+      return false;
+    }
+    chunk_.code()[patch.first] = static_cast<OpCode>(offset);
+  }
+  return !failed_;
+}
+
+// an empty block on a split edge with nothing to copy,
+// jumps go straight to its successor.
+bool Lowering::isForwarding(IrBlock *block) {
+  if (block == func_.entry || !block->phis.empty() || block->instrs.size() != 1 ||
+      block->instrs[0]->op != IR_JUMP || block->succs[0] == block ||
+      preheaders_.count(block)) {
+    return false;
+  }
+  auto succ = block->succs[0];
+  int index = succ->predIndex(block);
+  for (auto phi : succ->phis) {
+    if (needsCopy(phi, phi->operands[index])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+IrBlock* Lowering::resolve(IrBlock *block) {
+  // bounded, in case of a cycle of empty blocks.
+  for (size_t i = 0; i < func_.blocks.size() && isForwarding(block); i++) {
+    block = block->succs[0];
+  }
+  return block;
+}
+
+void Lowering::countUses() {
+  for (auto& block : func_.blocks) {
+    auto count = [&](IrInstr* instr) {
+      for (auto operand : instr->operands) {
+        uses_[operand]++;
+        user_[operand] = instr;
+      }
+    };
+    std::for_each(block->phis.begin(), block->phis.end(), count);
+    std::for_each(block->instrs.begin(), block->instrs.end(), count);
+  }
+}
+
+void Lowering::selectTrees(IrBlock *block) {
+  for (auto instr : block->instrs) {
+    if (!instr->producesValue() || isRematerializable(instr) || uses_[instr] != 1) {
+      continue;
+    }
+    auto user = user_[instr];
+    if (user->block == block && user->op != IR_PHI) {
+      inlined_.insert(instr);
+    }
+  }
+  // simulate the stack of pending trees, an operand can only be
+  // part of its user's tree if it's on the top of the stack when the user
+  // is reached. a tree can't be pending while a root is emitted either,
+  // that would move it after the root. give up on the conflicting trees
+  // until there are none left.
+  for (;;) {
+    std::vector<IrInstr*> pending;
+    std::vector<IrInstr*> conflicts;
+    for (auto instr : block->instrs) {
+      if (isRematerializable(instr)) {
+        continue;
+      }
+      std::vector<IrInstr*> operands;
+      for (auto operand : instr->operands) {
+        if (inlined_.count(operand)) {
+          operands.push_back(operand);
+        }
+      }
+      if (pending.size() < operands.size() ||
+          !std::equal(operands.begin(), operands.end(),
+                      pending.end() - operands.size())) {
+        conflicts = operands;
+        break;
+      }
+      pending.resize(pending.size() - operands.size());
+      if (inlined_.count(instr)) {
+        pending.push_back(instr);
+      } else if (!pending.empty()) {
+        conflicts = pending;
+        break;
+      }
+    }
+    if (conflicts.empty()) {
+      return;
+    }
+    for (auto instr : conflicts) {
+      inlined_.erase(instr);
+    }
+  }
+}
+
+// the values live at the start and the end of each block, phi
+// operands count as live at the end of the predecessor they come from.
+void Lowering::computeLiveness() {
+  auto order = func_.reversePostorder();
+  for (auto block : order) {
+    for (size_t i = 0; i < block->instrs.size(); i++) {
+      positions_[block->instrs[i]] = i;
+    }
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      auto block = *it;
+      std::unordered_set<IrInstr*> live;
+      for (auto succ : block->succs) {
+        int index = succ->predIndex(block);
+        for (auto phi : succ->phis) {
+          live.insert(phi->operands[index]);
+        }
+        live.insert(liveIn_[succ].begin(), liveIn_[succ].end());
+      }
+      liveOut_[block] = live;
+      for (auto instr = block->instrs.rbegin(); instr != block->instrs.rend(); ++instr) {
+        live.erase(*instr);
+        live.insert((*instr)->operands.begin(), (*instr)->operands.end());
+      }
+      for (auto phi : block->phis) {
+        live.erase(phi);
+      }
+      if (live != liveIn_[block]) {
+        liveIn_[block] = std::move(live);
+        changed = true;
+      }
+    }
+  }
+}
+
+// parameters live in their slots, the other values need one
+// unless they're loaded again or part of a tree.
+bool Lowering::hasSlot(IrInstr *value) {
+  if (value->op == IR_PARAM) {
+    return true;
+  }
+  auto uses = uses_.find(value);
+  return value->op != IR_CONSTANT && !inlined_.count(value) && value->producesValue() &&
+         uses != uses_.end() && uses->second > 0;
+}
+
+// whether `value` is still needed once `def` is computed.
+bool Lowering::isLiveAfter(IrInstr *value, IrInstr *def) {
+  auto block = def->block;
+  if (value == def) {
+    return false;
+  }
+  if (def->op == IR_PHI) {
+    // the phis of a block are computed at once.
+    return (value->op == IR_PHI && value->block == block) || liveIn_[block].count(value);
+  }
+  int position = positions_[def];
+  if (value->block == block && value->op != IR_PHI && positions_[value] > position) {
+    return false;
+  }
+  for (size_t i = position + 1; i < block->instrs.size(); i++) {
+    auto& operands = block->instrs[i]->operands;
+    if (std::find(operands.begin(), operands.end(), value) != operands.end()) {
+      return true;
+    }
+  }
+  return liveOut_[block].count(value);
+}
+
+// in ssa form two values are live at the same
+// time when one is live where the other is defined.
+bool Lowering::interferes(IrInstr *a, IrInstr *b) {
+  return isLiveAfter(a, b) || isLiveAfter(b, a);
+}
+
+IrInstr* Lowering::find(IrInstr *value) {
+  for (;;) {
+    auto it = leaders_.find(value);
+    if (it == leaders_.end()) {
+      return value;
+    }
+    value = it->second;
+  }
+}
+
+// puts the values of a and b in one slot, unless two of
+// them are live at the same time or both are parameters.
+bool Lowering::merge(IrInstr *a, IrInstr *b) {
+  a = find(a);
+  b = find(b);
+  if (a == b) {
+    return true;
+  }
+  auto& left = classes_[a];
+  auto& right = classes_[b];
+  auto isParam = [](IrInstr* value) { return value->op == IR_PARAM; };
+  if (std::any_of(left.begin(), left.end(), isParam) &&
+      std::any_of(right.begin(), right.end(), isParam)) {
+    return false;
+  }
+  for (auto x : left) {
+    for (auto y : right) {
+      if (interferes(x, y)) {
+        return false;
+      }
+    }
+  }
+  left.insert(left.end(), right.begin(), right.end());
+  classes_.erase(b);
+  leaders_[b] = a;
+  return true;
+}
+
+// first the phis with the other values, then with the parameters.
+void Lowering::coalesce(bool params) {
+  auto order = func_.reversePostorder();
+  if (params) {
+    for (auto block : order) {
+      for (auto phi : block->phis) {
+        for (auto operand : phi->operands) {
+          if (hasSlot(phi) && operand->op == IR_PARAM && !counters_.count(find(phi))) {
+            merge(phi, operand);
+          }
+        }
+      }
+    }
+    return;
+  }
+  for (auto block : order) {
+    auto add = [&](IrInstr* value) {
+      if (hasSlot(value)) {
+        classes_[value] = {value};
+      }
+    };
+    std::for_each(block->phis.begin(), block->phis.end(), add);
+    std::for_each(block->instrs.begin(), block->instrs.end(), add);
+  }
+  // the sum takes over the slot of its left operand, which isn't needed
+  // any more, so a string isn't copied out of the slot and back, and a
+  // number is added in one instruction.
+  for (auto block : order) {
+    for (auto instr : block->instrs) {
+      if (instr->op == IR_ADD && hasSlot(instr) &&
+          hasSlot(instr->operands[0]) && merge(instr, instr->operands[0])) {
+        appends_.insert(instr);
+      }
+    }
+  }
+  for (auto block : order) {
+    for (auto phi : block->phis) {
+      if (!hasSlot(phi)) {
+        continue;
+      }
+      for (auto operand : phi->operands) {
+        if (hasSlot(operand) && operand->op != IR_PARAM) {
+          merge(phi, operand);
+        }
+      }
+    }
+  }
+}
+
+// a value already in the slot of its phi isn't copied.
+bool Lowering::needsCopy(IrInstr *phi, IrInstr *operand) {
+  return hasSlot(phi) && (!hasSlot(operand) || find(phi) != find(operand));
+}
+
+// a loop ending in `i = i + c` and a branch back on `i < n` steps,
+// compares and jumps in one OP_FOR_LOOP when both are numbers, the
+// counter stays in the slot of its phi and n is defined before the
+// loop. the limit is copied next to the counter in the preheader. the
+// ir tests the condition once before the loop, OP_FOR_PREP isn't needed.
+// when the types aren't known, that test of the first value of the
+// counter against the same limit only passes if both are numbers.
+void Lowering::findCountedLoops() {
+  func_.computeDominators();
+  for (auto block : func_.reversePostorder()) {
+    auto branch = block->terminator();
+    if (!branch || branch->op != IR_BRANCH || block->succs.size() != 2) {
+      continue;
+    }
+    auto cond = branch->operands[0];
+    if ((cond->op != IR_LESS && cond->op != IR_GREATER) || !inlined_.count(cond)) {
+      continue;
+    }
+    // the back edge is split, the phis of the header get nothing new.
+    auto edge = block->succs[0];
+    if (edge->preds.size() != 1 || !edge->phis.empty() || edge->instrs.size() != 1 ||
+        edge->instrs[0]->op != IR_JUMP) {
+      continue;
+    }
+    auto header = edge->succs[0];
+    if (header->preds.size() != 2 || !func_.dominates(header, block)) {
+      continue;
+    }
+    int index = header->predIndex(edge);
+    auto preheader = header->preds[1 - index];
+    if (preheader->terminator()->op != IR_JUMP || preheaders_.count(preheader) ||
+        std::any_of(header->phis.begin(), header->phis.end(), [&](IrInstr* phi) {
+          return needsCopy(phi, phi->operands[index]);
+        })) {
+      continue;
+    }
+    // `i < n` or `n > i`.
+    bool counterFirst = !isRematerializable(cond->operands[0]) &&
+                        cond->operands[0]->block == block;
+    auto counter = cond->operands[counterFirst ? 0 : 1];
+    auto limit = cond->operands[counterFirst ? 1 : 0];
+    ForCompare compare = (cond->op == IR_LESS) == counterFirst ? FOR_LESS : FOR_GREATER;
+    if ((counter->op != IR_ADD && counter->op != IR_SUBTRACT) || counter->block != block ||
+        !hasSlot(counter)) {
+      continue;
+    }
+    auto last = block->instrs.begin() + positions_[counter] + 1;
+    if (!std::all_of(last, block->instrs.end(), [&](IrInstr* instr) {
+          return isRematerializable(instr) || instr == cond || instr == branch;
+        })) {
+      continue;
+    }
+    // `i + c`, `c + i` or `i - c`.
+    auto isStep = [](IrInstr* value) {
+      return value->op == IR_CONSTANT && std::holds_alternative<double>(value->constant);
+    };
+    int stepIndex = isStep(counter->operands[1]) ? 1 : 0;
+    auto previous = counter->operands[1 - stepIndex];
+    if (!isStep(counter->operands[stepIndex]) ||
+        (counter->op == IR_SUBTRACT && stepIndex != 1) ||
+        !hasSlot(previous) || find(previous) != find(counter)) {
+      continue;
+    }
+    auto isGuarded = [&]() {
+      if (previous->op != IR_PHI || previous->block != header ||
+          preheader->preds.size() != 1) {
+        return false;
+      }
+      auto guard = preheader->preds[0];
+      auto test = guard->terminator();
+      if (test->op != IR_BRANCH || guard->succs[0] != preheader) {
+        return false;
+      }
+      auto tested = test->operands[0];
+      auto first = previous->operands[header->predIndex(preheader)];
+      return tested->op == cond->op &&
+             tested->operands[counterFirst ? 0 : 1] == first &&
+             tested->operands[counterFirst ? 1 : 0] == limit;
+    };
+    if (!(isNumberOp(cond, types_) && isNumberOp(counter, types_)) && !isGuarded()) {
+      continue;
+    }
+    auto& values = classes_[find(counter)];
+    if (std::any_of(values.begin(), values.end(),
+                    [](IrInstr* value) { return value->op == IR_PARAM; })) {
+      continue;
+    }
+    if (!isRematerializable(limit) &&
+        (limit->block == header || !func_.dominates(limit->block, header))) {
+      continue;
+    }
+    double step = std::get<double>(counter->operands[stepIndex]->constant);
+    loops_[block] = CountedLoop{counter, limit, compare,
+                                counter->op == IR_ADD ? step : -step, header};
+    preheaders_[preheader] = block;
+    counters_.insert(find(counter));
+  }
+}
+
+void Lowering::assignSlots() {
+  int next = func_.arity + 1;
+  std::unordered_map<IrInstr*, int> classSlots;
+  for (auto block : func_.reversePostorder()) {
+    auto assign = [&](IrInstr* instr) {
+      if (instr->op == IR_PARAM || !hasSlot(instr)) {
+        return;
+      }
+      auto leader = find(instr);
+      auto it = classSlots.find(leader);
+      if (it == classSlots.end()) {
+        int slot = -1;
+        for (auto value : classes_[leader]) {
+          if (value->op == IR_PARAM) {
+            slot = value->slot;
+          }
+        }
+        if (slot == -1) {
+          slot = next++;
+          if (counters_.count(leader)) {
+            next++;
+          }
+        }
+        it = classSlots.emplace(leader, slot).first;
+      }
+      slots_[instr] = it->second;
+    };
+    std::for_each(block->phis.begin(), block->phis.end(), assign);
+    std::for_each(block->instrs.begin(), block->instrs.end(), assign);
+  }
+  slotCount_ = next - (func_.arity + 1);
+  if (next > 0x100) {
+    failed_ = true;
+  }
+}
+
+void Lowering::emitBlock(IrBlock *block, IrBlock *next) {
+  auto loop = loops_.find(block);
+  IrInstr* counter = loop != loops_.end() ? loop->second.counter : nullptr;
+  for (auto instr : block->instrs) {
+    if (instr->isTerminator() || isRematerializable(instr) || inlined_.count(instr) ||
+        instr == counter) {
+      continue;
+    }
+    emitRoot(instr);
+  }
+  auto terminator = block->terminator();
+  assert(terminator);
+  switch (terminator->op) {
+    case IR_JUMP: {
+      emitPhiCopies(block, block->succs[0]);
+      auto preheader = preheaders_.find(block);
+      if (preheader != preheaders_.end()) {
+        auto& entered = loops_[preheader->second];
+        load(entered.limit);
+        write(OP_SET_LOCAL);
+        writeByte(slots_[entered.counter] + 1);
+        write(OP_POP);
+      }
+      emitJump(block->succs[0], next);
+      break;
+    }
+    case IR_BRANCH: {
+      if (counter) {
+        emitForLoop(block, next);
+        break;
+      }
+      emitOperand(terminator->operands[0]);
+      emitBranch(block, next);
+      break;
+    }
+    case IR_RETURN: {
+      auto value = terminator->operands[0];
+      if (value->op == IR_CALL && inlined_.count(value)) {
+        // nothing runs between the call and the return.
+        for (auto operand : value->operands) {
+          emitOperand(operand);
+        }
+        write(OP_TAIL_CALL);
+        writeByte(value->operands.size() - 1);
+      } else {
+        emitOperand(value);
+      }
+      write(OP_RETURN);
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+void Lowering::emitRoot(IrInstr *instr) {
+  if (appends_.count(instr)) {
+    emitOperand(instr->operands[1]);
+    write(OP_APPEND_LOCAL);
+    writeByte(slots_[instr]);
+    return;
+  }
+  emitTree(instr);
+  if (!instr->producesValue()) {
+    return;
+  }
+  auto it = slots_.find(instr);
+  if (it != slots_.end()) {
+    write(OP_SET_LOCAL);
+    writeByte(it->second);
+  }
+  write(OP_POP);
+}
+
+void Lowering::emitTree(IrInstr *instr) {
+  for (auto operand : instr->operands) {
+    emitOperand(operand);
+  }
+  emitInstr(instr);
+}
+
+void Lowering::emitOperand(IrInstr *operand) {
+  if (inlined_.count(operand)) {
+    emitTree(operand);
+  } else {
+    load(operand);
+  }
+}
+
+void Lowering::emitInstr(IrInstr *instr) {
+  if (isNumberOp(instr, types_)) {
+    switch (instr->op) {
+      case IR_ADD:      write(OP_ADD_DOUBLE); break;
+      case IR_SUBTRACT: write(OP_SUBTRACT_DOUBLE); break;
+      case IR_MULTIPLY: write(OP_MULTIPLY_DOUBLE); break;
+      case IR_DIVIDE:   write(OP_DIVIDE_DOUBLE); break;
+      case IR_GREATER:  write(OP_GREATER_DOUBLE); break;
+      case IR_LESS:     write(OP_LESS_DOUBLE); break;
+      case IR_NEGATE:   write(OP_NEGATE_DOUBLE); break;
+      default:
+        assert(false);
+    }
+    return;
+  }
+  switch (instr->op) {
+    case IR_ADD:      write(OP_ADD); break;
+    case IR_SUBTRACT: write(OP_SUBTRACT); break;
+    case IR_MULTIPLY: write(OP_MULTIPLY); break;
+    case IR_DIVIDE:   write(OP_DIVIDE); break;
+    case IR_EQUAL:    write(OP_EQUAL); break;
+    case IR_GREATER:  write(OP_GREATER); break;
+    case IR_LESS:     write(OP_LESS); break;
+    case IR_NOT:      write(OP_NOT); break;
+    case IR_NEGATE:   write(OP_NEGATE); break;
+    case IR_PRINT:    write(OP_PRINT); break;
+    case IR_GET_GLOBAL: {
+      write(OP_GET_GLOBAL);
+      writeByte(constant(Value(instr->name)));
+      break;
+    }
+    case IR_SET_GLOBAL: {
+      write(OP_SET_GLOBAL);
+      writeByte(constant(Value(instr->name)));
+      break;
+    }
+    case IR_GET_PROPERTY: {
+      write(OP_GET_PROPERTY);
+      writeByte(constant(Value(instr->name)));
+      break;
+    }
+    case IR_SET_PROPERTY: {
+      write(OP_SET_PROPERTY);
+      writeByte(constant(Value(instr->name)));
+      break;
+    }
+    case IR_ARRAY: {
+      write(OP_ARRAY);
+      writeByte(instr->operands.size());
+      break;
+    }
+    case IR_MAP: {
+      write(OP_MAP);
+      writeByte(instr->operands.size() / 2);
+      break;
+    }
+    case IR_GET_INDEX:  write(OP_GET_INDEX); break;
+    case IR_SET_INDEX:  write(OP_SET_INDEX); break;
+    case IR_CALL: {
+      write(OP_CALL);
+      writeByte(instr->operands.size() - 1);
+      break;
+    }
+    default:
+      // copies are propagated, phis and terminators are handled by the block.
+      assert(false);
+  }
+}
+
+// a parallel copy: load every incoming value first, then store them.
+void Lowering::emitPhiCopies(IrBlock *from, IrBlock *to) {
+  if (to->phis.empty()) {
+    return;
+  }
+  int index = to->predIndex(from);
+  std::vector<IrInstr*> phis;
+  for (auto phi : to->phis) {
+    if (needsCopy(phi, phi->operands[index])) {
+      phis.push_back(phi);
+    }
+  }
+  for (auto phi : phis) {
+    load(phi->operands[index]);
+  }
+  for (auto it = phis.rbegin(); it != phis.rend(); ++it) {
+    write(OP_SET_LOCAL);
+    writeByte(slots_[*it]);
+    write(OP_POP);
+  }
+}
+
+// the header was laid out first, OP_FOR_LOOP jumps back to it.
+void Lowering::emitForLoop(IrBlock *block, IrBlock *next) {
+  auto& loop = loops_[block];
+  auto header = labels_.find(resolve(loop.header));
+  if (header == labels_.end()) {
+    failed_ = true;
+    return;
+  }
+  write(OP_FOR_LOOP);
+  writeByte(slots_[loop.counter]);
+  writeByte(loop.compare);
+  writeByte(constant(Value(loop.step)));
+  // +1 to skip the loop's offset.
+  writeByte(chunk_.code().size() + 1 - header->second);
+  emitJump(block->succs[1], next);
+}
+
+void Lowering::emitJump(IrBlock *target, IrBlock *next) {
+  target = resolve(target);
+  if (target == next) {
+    return;
+  }
+  auto it = labels_.find(target);
+  if (it != labels_.end()) {
+    write(OP_LOOP);
+    // +1 to skip the loop's offset.
+    writeByte(chunk_.code().size() + 1 - it->second);
+    return;
+  }
+  write(OP_JUMP);
+  patches_.emplace_back(chunk_.code().size(), target);
+  write(static_cast<OpCode>(0xff));
+}
+
+// the condition stays on the stack after the jump, pop it on both paths.
+void Lowering::emitBranch(IrBlock *block, IrBlock *next) {
+  auto ifTrue = resolve(block->succs[0]);
+  auto ifFalse = resolve(block->succs[1]);
+  if (ifTrue == next) {
+    int jump = writeJump(OP_JUMP_IF_TRUE);
+    write(OP_POP);
+    emitJump(ifFalse, nullptr);
+    fixJump(jump);
+    write(OP_POP);
+  } else {
+    int jump = writeJump(OP_JUMP_IF_FALSE);
+    write(OP_POP);
+    emitJump(ifTrue, nullptr);
+    fixJump(jump);
+    write(OP_POP);
+    emitJump(ifFalse, next);
+  }
+}
+
+void Lowering::load(IrInstr *value) {
+  switch (value->op) {
+    case IR_PARAM: {
+      write(OP_GET_LOCAL);
+      writeByte(value->slot);
+      break;
+    }
+    case IR_CONSTANT: {
+      const Value& constant = value->constant;
+      if (std::holds_alternative<std::monostate>(constant)) {
+        write(OP_NIL);
+      } else if (std::holds_alternative<bool>(constant)) {
+        write(std::get<bool>(constant) ? OP_TRUE : OP_FALSE);
+      } else {
+        write(OP_CONSTANT);
+        writeByte(this->constant(constant));
+      }
+      break;
+    }
+    default: {
+      auto it = slots_.find(value);
+      assert(it != slots_.end());
+      write(OP_GET_LOCAL);
+      writeByte(it->second);
+    }
+  }
+}
+
+void Lowering::writeByte(int byte) {
+  if (byte < 0 || byte > 0xff) {
+    failed_ = true;
+  }
+  chunk_.write(static_cast<OpCode>(byte));
+}
+
+int Lowering::constant(const Value &value) {
+  auto& constants = chunk_.constants();
+  for (size_t i = 0; i < constants.size(); i++) {
+    if (constants[i].index() != value.index()) {
+      continue;
+    }
+    // compare the bits of numbers, 0 and -0 are different constants.
+    if (std::holds_alternative<double>(value)) {
+      double a = std::get<double>(value);
+      double b = std::get<double>(constants[i]);
+      if (std::memcmp(&a, &b, sizeof(double)) == 0) {
+        return i;
+      }
+    } else if (constants[i] == value) {
+      return i;
+    }
+  }
+  return chunk_.addConstant(value);
+}
+
+int Lowering::writeJump(OpCode code) {
+  write(code);
+  write(static_cast<OpCode>(0xff));
+  return chunk_.code().size() - 1;
+}
+
+void Lowering::fixJump(int offset) {
+  // -1 to skip the offset itself.
+  int jump = chunk_.code().size() - offset - 1;
+  if (jump > 0xff) {
+    failed_ = true;
+  }
+  chunk_.code()[offset] = static_cast<OpCode>(jump);
+}
+
+} // namespace
+
+bool lowerToChunk(IrFunction &func, Chunk &chunk, const TypeMap& types) {
+  Lowering lowering(func, chunk, types);
+  return lowering.run();
+}
+
+}
@@ -0,0 +1,367 @@
+#include <ir_passes.h>
+#include <ir.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace alien {
+
+namespace {
+  // the key of value numbering, equal keys compute equal values.
+  std::string valueKey(const IrInstr* instr) {
+    std::ostringstream key;
+    key << static_cast<int>(instr->op);
+    if (instr->op == IR_CONSTANT) {
+      const Value& value = instr->constant;
+      key << ':' << value.index() << ':';
+      if (std::holds_alternative<double>(value)) {
+        // compare the bits, printing would lose precision.
+        double d = std::get<double>(value);
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        key << bits;
+      } else if (std::holds_alternative<bool>(value)) {
+        key << std::get<bool>(value);
+      } else if (std::holds_alternative<std::string>(value)) {
+        key << std::get<std::string>(value);
+      }
+    }
+    for (auto operand : instr->operands) {
+      key << ",v" << operand->id;
+    }
+    return key.str();
+  }
+
+  struct Loop {
+    IrBlock* header;
+    IrBlock* preheader;
+    std::unordered_set<IrBlock*> blocks;
+  };
+
+  std::vector<Loop> findLoops(IrFunction& func) {
+    func.computeDominators();
+    std::vector<Loop> loops;
+    for (auto header : func.reversePostorder()) {
+      Loop loop{header, nullptr, {header}};
+      std::vector<IrBlock*> worklist;
+      for (auto pred : header->preds) {
+        // a back edge.
+        if (func.dominates(header, pred) && loop.blocks.insert(pred).second) {
+          worklist.push_back(pred);
+        }
+      }
+      if (loop.blocks.size() == 1 &&
+          std::find(header->preds.begin(), header->preds.end(), header) == header->preds.end()) {
+        continue;
+      }
+      while (!worklist.empty()) {
+        auto block = worklist.back();
+        worklist.pop_back();
+        for (auto pred : block->preds) {
+          if (loop.blocks.insert(pred).second) {
+            worklist.push_back(pred);
+          }
+        }
+      }
+      for (auto pred : header->preds) {
+        if (loop.blocks.count(pred)) {
+          continue;
+        }
+        // the loop is entered from more than one place, leave it alone.
+        if (loop.preheader || pred->succs.size() != 1) {
+          loop.preheader = nullptr;
+          break;
+        }
+        loop.preheader = pred;
+      }
+      if (loop.preheader) {
+        loops.push_back(std::move(loop));
+      }
+    }
+    // inner loops first, what they hoist can be hoisted again.
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) {
+      return a.blocks.size() < b.blocks.size();
+    });
+    return loops;
+  }
+
+  // what the stores and calls of a region may have changed,
+  // stores to a property are assumed to alias every object.
+  struct Clobbers {
+    void add(const IrInstr* instr) {
+      switch (instr->op) {
+        case IR_CALL: calls = true; break;
+        case IR_SET_GLOBAL: globals.insert(instr->name); break;
+        case IR_SET_PROPERTY: properties.insert(instr->name); break;
+        default: break;
+      }
+    }
+    bool clobbers(const IrInstr* load) const {
+      if (calls) {
+        return true;
+      }
+      return load->op == IR_GET_GLOBAL ? globals.count(load->name) > 0
+                                       : properties.count(load->name) > 0;
+    }
+    bool calls = false;
+    std::unordered_set<std::string> globals;
+    std::unordered_set<std::string> properties;
+  };
+
+  bool isMethodLoad(const IrInstr* instr,
+                    const std::unordered_set<std::string_view>& methods) {
+    return instr->op == IR_GET_PROPERTY && methods.count(instr->name);
+  }
+
+  void hoistLoop(IrFunction& func, Loop& loop,
+                 const std::unordered_set<std::string_view>& methods) {
+    auto isInvariant = [&](IrInstr* instr) {
+      for (auto operand : instr->operands) {
+        if (loop.blocks.count(operand->block)) {
+          return false;
+        }
+      }
+      return true;
+    };
+    Clobbers clobbers;
+    for (auto block : loop.blocks) {
+      for (auto instr : block->instrs) {
+        clobbers.add(instr);
+      }
+    }
+    auto isMovable = [&](IrInstr* instr) {
+      if (instr->isLoad()) {
+        return !isMethodLoad(instr, methods) && !clobbers.clobbers(instr);
+      }
+      return instr->isPure();
+    };
+    auto& target = loop.preheader->instrs;
+    for (auto block : func.reversePostorder()) {
+      if (!loop.blocks.count(block)) {
+        continue;
+      }
+      // the header runs whenever the loop is entered, what it evaluates before
+      // the first possible error or effect can be hoisted even if it may trap.
+      bool guaranteed = block == loop.header;
+      std::vector<IrInstr*> remaining;
+      for (auto instr : block->instrs) {
+        bool hoist = isMovable(instr) && isInvariant(instr) &&
+                     (guaranteed || !instr->canTrap());
+        if (hoist) {
+          instr->block = loop.preheader;
+          target.insert(target.end() - 1, instr);
+          continue;
+        }
+        if (instr->canTrap() || instr->hasSideEffects()) {
+          guaranteed = false;
+        }
+        remaining.push_back(instr);
+      }
+      block->instrs = std::move(remaining);
+    }
+  }
+} // namespace
+
+void propagateCopies(IrFunction &func) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto& block : func.blocks) {
+      for (auto instr : std::vector<IrInstr*>(block->instrs)) {
+        if (instr->op == IR_COPY) {
+          func.replaceAllUses(instr, instr->operands[0]);
+          func.removeInstr(instr);
+          changed = true;
+        }
+      }
+      for (auto phi : std::vector<IrInstr*>(block->phis)) {
+        // phi(x, x, phi) is just x.
+        IrInstr* same = nullptr;
+        bool trivial = true;
+        for (auto operand : phi->operands) {
+          if (operand == phi || operand == same) {
+            continue;
+          }
+          if (same) {
+            trivial = false;
+            break;
+          }
+          same = operand;
+        }
+        if (trivial && same) {
+          func.replaceAllUses(phi, same);
+          func.removeInstr(phi);
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+void eliminateCommonSubexpressions(IrFunction &func) {
+  func.computeDominators();
+  std::unordered_map<IrBlock*, std::vector<IrBlock*>> children;
+  for (auto block : func.reversePostorder()) {
+    if (block != func.entry) {
+      children[block->idom].push_back(block);
+    }
+  }
+  // the values available in the dominators of the visited block.
+  std::unordered_map<std::string, IrInstr*> available;
+  // walk the dominator tree, forget the keys of a block when leaving it.
+  std::vector<std::pair<IrBlock*, bool>> worklist{{func.entry, false}};
+  std::vector<std::vector<std::string>> scopes;
+  while (!worklist.empty()) {
+    auto [block, leaving] = worklist.back();
+    worklist.pop_back();
+    if (leaving) {
+      for (const auto& key : scopes.back()) {
+        available.erase(key);
+      }
+      scopes.pop_back();
+      continue;
+    }
+    scopes.emplace_back();
+    worklist.emplace_back(block, true);
+    for (auto instr : std::vector<IrInstr*>(block->instrs)) {
+      if (!instr->isPure()) {
+        continue;
+      }
+      auto key = valueKey(instr);
+      auto it = available.find(key);
+      if (it != available.end()) {
+        func.replaceAllUses(instr, it->second);
+        func.removeInstr(instr);
+      } else {
+        available.emplace(key, instr);
+        scopes.back().push_back(key);
+      }
+    }
+    auto& list = children[block];
+    for (auto it = list.rbegin(); it != list.rend(); ++it) {
+      worklist.emplace_back(*it, false);
+    }
+  }
+}
+
+void eliminateRedundantLoads(IrFunction &func,
+                             const std::unordered_set<std::string_view>& methods) {
+  for (auto& block : func.blocks) {
+    // the known values of the globals, and of the properties by object.
+    std::unordered_map<std::string, IrInstr*> globals;
+    std::unordered_map<std::string, std::unordered_map<IrInstr*, IrInstr*>> properties;
+    for (auto instr : std::vector<IrInstr*>(block->instrs)) {
+      switch (instr->op) {
+        case IR_GET_GLOBAL:
+        case IR_GET_PROPERTY: {
+          if (isMethodLoad(instr, methods)) {
+            break;
+          }
+          auto& known = instr->op == IR_GET_GLOBAL ? globals[instr->name]
+                                                   : properties[instr->name][instr->operands[0]];
+          if (known) {
+            func.replaceAllUses(instr, known);
+            func.removeInstr(instr);
+          } else {
+            known = instr;
+          }
+          break;
+        }
+        case IR_SET_GLOBAL: {
+          globals[instr->name] = instr->operands[0];
+          break;
+        }
+        case IR_SET_PROPERTY: {
+          // another object may be the same one.
+          auto& known = properties[instr->name];
+          known.clear();
+          if (!methods.count(instr->name)) {
+            known[instr->operands[0]] = instr->operands[1];
+          }
+          break;
+        }
+        case IR_CALL: {
+          globals.clear();
+          properties.clear();
+          break;
+        }
+        default:
+          break;
+      }
+    }
+  }
+}
+
+void hoistLoopInvariants(IrFunction &func,
+                         const std::unordered_set<std::string_view>& methods) {
+  for (auto& loop : findLoops(func)) {
+    hoistLoop(func, loop, methods);
+  }
+}
+
+void eliminateDeadCode(IrFunction &func) {
+  std::unordered_set<IrInstr*> live;
+  std::vector<IrInstr*> worklist;
+  for (auto& block : func.blocks) {
+    for (auto instr : block->instrs) {
+      if (instr->hasSideEffects() || instr->canTrap()) {
+        live.insert(instr);
+        worklist.push_back(instr);
+      }
+    }
+  }
+  while (!worklist.empty()) {
+    auto instr = worklist.back();
+    worklist.pop_back();
+    for (auto operand : instr->operands) {
+      if (live.insert(operand).second) {
+        worklist.push_back(operand);
+      }
+    }
+  }
+  for (auto& block : func.blocks) {
+    auto dead = [&](IrInstr* instr) {
+      if (live.count(instr)) {
+        return false;
+      }
+      instr->block = nullptr;
+      return true;
+    };
+    block->phis.erase(std::remove_if(block->phis.begin(), block->phis.end(), dead),
+                      block->phis.end());
+    block->instrs.erase(std::remove_if(block->instrs.begin(), block->instrs.end(), dead),
+                        block->instrs.end());
+  }
+}
+
+void optimize(IrFunction &func,
+              const std::unordered_set<std::string_view>& methods,
+              std::ostream *dump) {
+  auto pass = [&](const char* name, auto run) {
+    run(func);
+    if (dump) {
+      *dump << "; after " << name << '\n';
+      func.dump(*dump);
+    }
+  };
+  if (dump) {
+    *dump << "; built\n";
+    func.dump(*dump);
+  }
+  pass("copy propagation", propagateCopies);
+  pass("common subexpression elimination", eliminateCommonSubexpressions);
+  pass("redundant load elimination", [&](IrFunction& func) {
+    eliminateRedundantLoads(func, methods);
+  });
+  pass("loop-invariant code motion", [&](IrFunction& func) {
+    hoistLoopInvariants(func, methods);
+  });
+  pass("dead code elimination", eliminateDeadCode);
+}
+
+}
@@ -0,0 +1,343 @@
+#include <ir_types.h>
+#include <ir.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace alien {
+
+namespace {
+  bool isArithmetic(IrOp op) {
+    switch (op) {
+      case IR_ADD:
+      case IR_SUBTRACT:
+      case IR_MULTIPLY:
+      case IR_DIVIDE:
+      case IR_GREATER:
+      case IR_LESS:
+      case IR_NEGATE:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  Type typeOf(const Value& value) {
+    if (std::holds_alternative<std::monostate>(value)) {
+      return TYPE_NIL;
+    } else if (std::holds_alternative<bool>(value)) {
+      return TYPE_BOOL;
+    } else if (std::holds_alternative<double>(value)) {
+      return TYPE_NUMBER;
+    } else if (std::holds_alternative<std::string>(value)) {
+      return TYPE_STRING;
+    }
+    return TYPE_OBJECT;
+  }
+
+  class Inference {
+  public:
+    Inference(IrFunction& func, const std::vector<Type>& parameters,
+              const Signatures* signatures)
+    : func_(func), parameters_(parameters), signatures_(signatures) {}
+    TypeMap run() {
+      auto order = func_.reversePostorder();
+      bool changed = true;
+      // every transfer is monotone, loops reach a fixpoint.
+      while (changed) {
+        changed = false;
+        for (auto block : order) {
+          for (auto phi : block->phis) {
+            changed |= update(phi);
+          }
+          for (auto instr : block->instrs) {
+            changed |= update(instr);
+          }
+        }
+      }
+      return std::move(types_);
+    }
+
+  private:
+    bool update(IrInstr* instr) {
+      if (!instr->producesValue()) {
+        return false;
+      }
+      Type type = transfer(instr);
+      Type& current = types_[instr];
+      if ((current | type) == current) {
+        return false;
+      }
+      current |= type;
+      return true;
+    }
+
+    Type operand(const IrInstr* instr, int index) {
+      auto it = types_.find(instr->operands[index]);
+      return it == types_.end() ? TYPE_NONE : it->second;
+    }
+
+    // what an instruction produces if it doesn't run into an error.
+    Type transfer(IrInstr* instr) {
+      switch (instr->op) {
+        case IR_PARAM: {
+          if (instr->slot == 0) {
+            return TYPE_OBJECT;
+          }
+          size_t index = instr->slot - 1;
+          return index < parameters_.size() ? parameters_[index] : TYPE_ANY;
+        }
+        case IR_CONSTANT:
+          return typeOf(instr->constant);
+        case IR_COPY:
+          return operand(instr, 0);
+        case IR_PHI: {
+          Type type = TYPE_NONE;
+          for (size_t i = 0; i < instr->operands.size(); i++) {
+            type |= operand(instr, i);
+          }
+          return type;
+        }
+        case IR_ADD: {
+          Type a = operand(instr, 0);
+          Type b = operand(instr, 1);
+          // two numbers or two strings.
+          return (a & b) & (TYPE_NUMBER | TYPE_STRING);
+        }
+        case IR_SUBTRACT:
+        case IR_MULTIPLY:
+        case IR_DIVIDE:
+        case IR_GREATER:
+        case IR_LESS:
+        case IR_NEGATE: {
+          for (size_t i = 0; i < instr->operands.size(); i++) {
+            if (!(operand(instr, i) & TYPE_NUMBER)) {
+              return TYPE_NONE;
+            }
+          }
+          return instr->op == IR_GREATER || instr->op == IR_LESS ? TYPE_BOOL : TYPE_NUMBER;
+        }
+        case IR_EQUAL:
+        case IR_NOT: {
+          for (size_t i = 0; i < instr->operands.size(); i++) {
+            if (operand(instr, i) == TYPE_NONE) {
+              return TYPE_NONE;
+            }
+          }
+          return TYPE_BOOL;
+        }
+        case IR_CALL: {
+          if (!signatures_) {
+            return TYPE_ANY;
+          }
+          auto it = signatures_->find(directCallee(func_, instr));
+          if (it == signatures_->end()) {
+            return TYPE_ANY;
+          }
+          const auto& signature = it->second;
+          // a wrong number of arguments is an error.
+          return signature.parameters.size() + 1 == instr->operands.size() ? signature.result
+                                                                           : TYPE_NONE;
+        }
+        case IR_SET_GLOBAL:
+          return operand(instr, 0);
+        case IR_SET_PROPERTY:
+          return operand(instr, 1);
+        case IR_ARRAY:
+        case IR_MAP:
+          return TYPE_OBJECT;
+        case IR_SET_INDEX:
+          return operand(instr, 2);
+        default:
+          return TYPE_ANY;
+      }
+    }
+
+  private:
+    IrFunction& func_;
+    const std::vector<Type>& parameters_;
+    const Signatures* signatures_;
+    TypeMap types_;
+  };
+} // namespace
+
+std::string typeName(Type type) {
+  if (type == TYPE_NONE) {
+    return "none";
+  }
+  if (type == TYPE_ANY) {
+    return "any";
+  }
+  static const char* names[] = {"nil", "bool", "number", "string", "object"};
+  std::string name;
+  for (int i = 0; i < 5; i++) {
+    if (type & (1 << i)) {
+      if (!name.empty()) {
+        name += '|';
+      }
+      name += names[i];
+    }
+  }
+  return name;
+}
+
+TypeMap inferTypes(IrFunction &func, const std::vector<Type>& parameters,
+                   const Signatures* signatures) {
+  Inference inference(func, parameters, signatures);
+  return inference.run();
+}
+
+std::string directCallee(const IrFunction &func, const IrInstr *call) {
+  auto callee = call->operands[0];
+  if (callee->op == IR_GET_GLOBAL) {
+    return callee->name;
+  }
+  if (callee->op == IR_PARAM && callee->slot == 0 && !func.isMethod) {
+    return func.name;
+  }
+  return "";
+}
+
+void countReferences(const IrFunction &func,
+                     std::unordered_map<std::string, int> &references,
+                     std::unordered_set<std::string> &escaped) {
+  // the global function an instruction refers to.
+  auto referenced = [&](const IrInstr* instr) -> std::string {
+    if (instr->op == IR_GET_GLOBAL) {
+      return instr->name;
+    }
+    if (instr->op == IR_PARAM && instr->slot == 0 && !func.isMethod) {
+      return func.name;
+    }
+    return "";
+  };
+  for (const auto& block : func.blocks) {
+    auto count = [&](const IrInstr* instr) {
+      if (instr->op == IR_GET_GLOBAL) {
+        references[instr->name]++;
+      }
+      for (size_t i = 0; i < instr->operands.size(); i++) {
+        auto name = referenced(instr->operands[i]);
+        if (name.empty()) {
+          continue;
+        }
+        // the first slot has a use for each reference.
+        if (instr->operands[i]->op == IR_PARAM) {
+          references[name]++;
+        }
+        if (instr->op != IR_CALL || i != 0) {
+          escaped.insert(name);
+        }
+      }
+    };
+    std::for_each(block->phis.begin(), block->phis.end(), count);
+    std::for_each(block->instrs.begin(), block->instrs.end(), count);
+  }
+}
+
+Signatures inferSignatures(const std::vector<IrFunction*>& funcs,
+                           const std::unordered_set<std::string>& stable,
+                           const std::unordered_set<std::string>& closed) {
+  Signatures signatures;
+  for (auto func : funcs) {
+    if (stable.count(func->name)) {
+      Type initial = closed.count(func->name) ? TYPE_NONE : TYPE_ANY;
+      signatures[func->name].parameters.assign(func->arity, initial);
+    }
+  }
+  auto grow = [](Type& type, Type more) {
+    if ((type | more) == type) {
+      return false;
+    }
+    type |= more;
+    return true;
+  };
+  // the arguments of a call depend on the parameters of the caller,
+  // and the results on the parameters of the callee.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto func : funcs) {
+      auto self = signatures.find(func->name);
+      std::vector<Type> parameters(func->arity, TYPE_ANY);
+      if (self != signatures.end()) {
+        parameters = self->second.parameters;
+      }
+      auto types = inferTypes(*func, parameters, &signatures);
+      for (const auto& block : func->blocks) {
+        for (auto instr : block->instrs) {
+          if (instr->op == IR_RETURN && self != signatures.end()) {
+            changed |= grow(self->second.result, types[instr->operands[0]]);
+          }
+          if (instr->op != IR_CALL) {
+            continue;
+          }
+          auto callee = directCallee(*func, instr);
+          auto it = signatures.find(callee);
+          // a wrong number of arguments never gets into the callee.
+          if (!closed.count(callee) || it == signatures.end() ||
+              it->second.parameters.size() + 1 != instr->operands.size()) {
+            continue;
+          }
+          for (size_t i = 0; i < it->second.parameters.size(); i++) {
+            changed |= grow(it->second.parameters[i], types[instr->operands[i + 1]]);
+          }
+        }
+      }
+    }
+  }
+  return signatures;
+}
+
+bool isNumberOp(const IrInstr *instr, const TypeMap &types) {
+  if (!isArithmetic(instr->op)) {
+    return false;
+  }
+  for (auto operand : instr->operands) {
+    auto it = types.find(operand);
+    if (it == types.end() || it->second != TYPE_NUMBER) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void dumpTypes(IrFunction &func, const TypeMap &types, std::ostream &os) {
+  auto typeAt = [&](const IrInstr* instr) {
+    auto it = types.find(instr);
+    return it == types.end() ? TYPE_NONE : it->second;
+  };
+  os << "types " << func.name << '/' << func.arity << " {\n";
+  for (auto block : func.reversePostorder()) {
+    auto print = [&](const IrInstr* instr) {
+      if (!instr->producesValue()) {
+        return;
+      }
+      os << "  ";
+      instr->print(os);
+      os << " : " << typeName(typeAt(instr));
+      if (isArithmetic(instr->op)) {
+        if (isNumberOp(instr, types)) {
+          os << " ; specialised";
+        } else {
+          for (auto operand : instr->operands) {
+            if (typeAt(operand) != TYPE_NUMBER) {
+              os << " ; v" << operand->id << " is " << typeName(typeAt(operand));
+              break;
+            }
+          }
+        }
+      }
+      os << '\n';
+    };
+    for (auto phi : block->phis) {
+      print(phi);
+    }
+    for (auto instr : block->instrs) {
+      print(instr);
+    }
+  }
+  os << "}\n";
+}
+
+}
@@ -244,4 +244,55 @@ void JsonGenerator::visit(This& expr) {
 
 }
 
+void JsonGenerator::visit(Array& expr) {
+    visit_begin(Array, array);
+    for (const auto& exp : expr.elements) {
+        visit_one(exp);
+    }
+    visit_end();
+}
+
+void JsonGenerator::visit(Map& expr) {
+    visit_begin(Map, array);
+    for (size_t i = 0; i < expr.keys.size(); i++) {
+        auto entry = nlohmann::json::object();
+        push();
+        jCurrent_ = &entry;
+        visit_begin(key, object);
+        expr.keys[i]->accept(*this);
+        visit_end();
+        visit_begin(value, object);
+        expr.values[i]->accept(*this);
+        visit_end();
+        pop();
+        jCurrent_->push_back(entry);
+    }
+    visit_end();
+}
+
+void JsonGenerator::visit(Index& expr) {
+    visit_begin(Index, object);
+    visit_begin(object, object);
+    expr.object->accept(*this);
+    visit_end();
+    visit_begin(index, object);
+    expr.index->accept(*this);
+    visit_end();
+    visit_end();
+}
+
+void JsonGenerator::visit(IndexSet& expr) {
+    visit_begin(IndexSet, object);
+    visit_begin(object, object);
+    expr.object->accept(*this);
+    visit_end();
+    visit_begin(index, object);
+    expr.index->accept(*this);
+    visit_end();
+    visit_begin(value, object);
+    expr.value->accept(*this);
+    visit_end();
+    visit_end();
+}
+
 } // namespace alien
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <parser.h>
 #include <common.h>
 #include <json_generator.h>
+#include <source_file.h>
 
 #include <fstream>
 
@@ -14,9 +15,9 @@ int main(int argc, const char* argv[]) {
         return EX_USAGE;
     }
     std::string script(argv[1]), jsonfile(argv[2]);
-    std::ifstream iscript(script);
+    SourceFile source;
     std::ofstream ojsonfile(jsonfile);
-    if (!iscript) {
+    if (!source.open(script)) {
         std::cerr << "Couldn't open file " << std::quoted(script);
         return EX_UNAVAILABLE;
     }
@@ -24,9 +25,7 @@ int main(int argc, const char* argv[]) {
         std::cerr << "Couldn't open file " << std::quoted(jsonfile);
         return EX_UNAVAILABLE;
     }
-    std::string source(std::istreambuf_iterator<char>(iscript.rdbuf()),
-                     std::istreambuf_iterator<char>());
-    Parser parser(source);
+    Parser parser(source.text());
     auto program = parser.parse();
     if (parser.hadError()) {
         return EX_UNAVAILABLE;
@@ -5,31 +5,176 @@
 #include <lexer.h>
 #include <token.h>
 
+#include <algorithm>
+#include <array>
 #include <string_view>
-#include <unordered_map>
 
 #include <cassert>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace alien {
 
-std::unordered_map<std::string_view, TokenType> Lexer::keywords_{
-    { "if",     TOKEN_IF },
-    { "else",   TOKEN_ELSE },
-    { "while",  TOKEN_WHILE },
-    { "for",    TOKEN_FOR },
-    { "func",   TOKEN_FUNC },
-    { "class",  TOKEN_CLASS },
-    { "var",    TOKEN_VAR},
-    { "const",  TOKEN_CONST},
-    { "true",   TOKEN_TRUE },
-    { "false",  TOKEN_FALSE },
-    { "nil",    TOKEN_NIL },
-    { "print",  TOKEN_PRINT },
-    { "return", TOKEN_RETURN },
-    { "this",   TOKEN_THIS },
-    { "or",     TOKEN_OR },
-    { "and",    TOKEN_AND }
-};
+namespace {
+  // keywords are told apart by their length and first letter.
+  TokenType keyword(std::string_view name) {
+    switch (name.size()) {
+      case 2:
+        if (name == "if") return TOKEN_IF;
+        if (name == "or") return TOKEN_OR;
+        break;
+      case 3:
+        switch (name[0]) {
+          case 'f': if (name == "for") return TOKEN_FOR; break;
+          case 'v': if (name == "var") return TOKEN_VAR; break;
+          case 'n': if (name == "nil") return TOKEN_NIL; break;
+          case 'a': if (name == "and") return TOKEN_AND; break;
+        }
+        break;
+      case 4:
+        switch (name[0]) {
+          case 'e': if (name == "else") return TOKEN_ELSE; break;
+          case 'f': if (name == "func") return TOKEN_FUNC; break;
+          case 't':
+            if (name == "true") return TOKEN_TRUE;
+            if (name == "this") return TOKEN_THIS;
+            break;
+        }
+        break;
+      case 5:
+        switch (name[0]) {
+          case 'w': if (name == "while") return TOKEN_WHILE; break;
+          case 'c':
+            if (name == "class") return TOKEN_CLASS;
+            if (name == "const") return TOKEN_CONST;
+            break;
+          case 'f': if (name == "false") return TOKEN_FALSE; break;
+          case 'p': if (name == "print") return TOKEN_PRINT; break;
+        }
+        break;
+      case 6:
+        if (name == "return") return TOKEN_RETURN;
+        break;
+    }
+    return TOKEN_IDENTIFIER;
+  }
+
+  enum CharClass : uint8_t {
+    CHAR_NAME = 1,
+    CHAR_DIGIT = 2,
+    CHAR_SPACE = 4,
+  };
+
+  constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    for (int c = 'a'; c <= 'z'; c++) classes[c] = CHAR_NAME;
+    for (int c = 'A'; c <= 'Z'; c++) classes[c] = CHAR_NAME;
+    for (int c = '0'; c <= '9'; c++) classes[c] = CHAR_NAME | CHAR_DIGIT;
+    classes['_'] = CHAR_NAME;
+    classes[' '] = classes['\t'] = classes['\r'] = classes['\n'] = CHAR_SPACE;
+    return classes;
+  }
+
+  constexpr auto kCharClasses = makeCharClasses();
+
+  bool isClass(char c, uint8_t charClass) {
+    return kCharClasses[static_cast<uint8_t>(c)] & charClass;
+  }
+
+  // most runs are a few bytes, so the first kVector bytes are taken one
+  // by one and only the rest of a long run is taken kVector bytes at a time.
+  constexpr size_t kVector = 16;
+
+#ifdef __SSE2__
+  __m128i load(const char* s) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+  }
+
+  // the bytes of `c` in [lo, hi] as 0xff, non-ascii bytes are negative.
+  __m128i inRange(__m128i c, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+  }
+
+  __m128i equals(__m128i c, char byte) {
+    return _mm_cmpeq_epi8(c, _mm_set1_epi8(byte));
+  }
+
+  // a bit for each byte of the run in `c`.
+  unsigned nameMask(__m128i c) {
+    // 'a'..'z' and 'A'..'Z' are the same range with 0x20 set.
+    __m128i name = _mm_or_si128(inRange(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z'),
+                                _mm_or_si128(inRange(c, '0', '9'), equals(c, '_')));
+    return _mm_movemask_epi8(name);
+  }
+
+  unsigned spaceMask(__m128i c) {
+    __m128i space = _mm_or_si128(_mm_or_si128(equals(c, ' '), equals(c, '\t')),
+                                 _mm_or_si128(equals(c, '\r'), equals(c, '\n')));
+    return _mm_movemask_epi8(space);
+  }
+#endif
+
+  // the length of the run of `charClass` at the start of `s`.
+  size_t runLength(const char* s, size_t size, uint8_t charClass) {
+    size_t i = 0;
+    for (size_t n = std::min(size, kVector); i < n; i++) {
+      if (!isClass(s[i], charClass)) return i;
+    }
+#ifdef __SSE2__
+    for (; i + kVector <= size; i += kVector) {
+      __m128i c = load(s + i);
+      unsigned mask = charClass == CHAR_NAME ? nameMask(c)
+                    : charClass == CHAR_SPACE ? spaceMask(c)
+                    : _mm_movemask_epi8(inRange(c, '0', '9'));
+      if (mask != 0xffff) {
+        return i + __builtin_ctz(~mask);
+      }
+    }
+#endif
+    while (i < size && isClass(s[i], charClass)) {
+      i++;
+    }
+    return i;
+  }
+
+  int countNewlines(const char* s, size_t size) {
+    int lines = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + kVector <= size; i += kVector) {
+      lines += __builtin_popcount(_mm_movemask_epi8(equals(load(s + i), '\n')));
+    }
+#endif
+    for (; i < size; i++) {
+      if (s[i] == '\n') lines++;
+    }
+    return lines;
+  }
+
+  // the length up to the closing '"'.
+  size_t stringLength(const char* s, size_t size) {
+    size_t i = 0;
+    for (size_t n = std::min(size, kVector); i < n; i++) {
+      if (s[i] == '"') return i;
+    }
+#ifdef __SSE2__
+    for (; i + kVector <= size; i += kVector) {
+      unsigned mask = _mm_movemask_epi8(equals(load(s + i), '"'));
+      if (mask) {
+        return i + __builtin_ctz(mask);
+      }
+    }
+#endif
+    while (i < size && s[i] != '"') {
+      i++;
+    }
+    return i;
+  }
+} // namespace
 
 Token Lexer::nextToken() {
   skipWhitespace();
@@ -53,9 +198,12 @@ Token Lexer::nextToken() {
     case ')': return Token(TOKEN_RIGHT_PAREN, line_);
     case '{': return Token(TOKEN_LEFT_BRACE, line_);
     case '}': return Token(TOKEN_RIGHT_BRACE, line_);
+    case '[': return Token(TOKEN_LEFT_BRACKET, line_);
+    case ']': return Token(TOKEN_RIGHT_BRACKET, line_);
     case ',': return Token(TOKEN_COMMA, line_);
     case ';': return Token(TOKEN_SEMICOLON, line_);
     case '.': return Token(TOKEN_DOT, line_);
+    case ':': return Token(TOKEN_COLON, line_);
     case '>':
       return Token(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER, line_);
     case '<':
@@ -99,56 +247,33 @@ char Lexer::advance() {
 }
 
 void Lexer::skipWhitespace() {
-  for (;;) {
-    // we have to use peek in case of that c is not a whitespace.
-    char c = peek();
-    switch (c) {
-      case ' ':
-      case'\r':
-      case'\t':
-        advance();
-        break;
-      case '\n':
-        line_++;
-        advance();
-        break;
-      default:
-        return;
-    }
-  }
+  const char* start = source_.data() + pos_;
+  size_t length = runLength(start, source_.size() - pos_, CHAR_SPACE);
+  line_ += countNewlines(start, length);
+  pos_ += length;
 }
 
 Token Lexer::identifier() {
-  while (isName(peek()) || isDigit(peek())) {
-    advance();
-  }
+  pos_ += runLength(source_.data() + pos_, source_.size() - pos_, CHAR_NAME);
   auto lexeme = source_.substr(tokenStart_, pos_ - tokenStart_);
-  if (keywords_.find(lexeme) != keywords_.end()) {
-    return Token(keywords_[lexeme], lexeme, line_);
-  }
-  return Token(TOKEN_IDENTIFIER, lexeme, line_);
+  return Token(keyword(lexeme), lexeme, line_);
 }
 
 Token Lexer::number() {
-  while (isDigit(peek())) {
-    advance();
-  }
+  pos_ += runLength(source_.data() + pos_, source_.size() - pos_, CHAR_DIGIT);
   if (peek() == '.' && isDigit(peek(1))) {
     advance();
-    while (isDigit(peek())) {
-      advance();
-    }
+    pos_ += runLength(source_.data() + pos_, source_.size() - pos_, CHAR_DIGIT);
   }
   auto lexeme = source_.substr(tokenStart_, pos_ - tokenStart_);
   return Token(TOKEN_NUMBER, lexeme, line_);
 }
 
 Token Lexer::string() {
-  // '"' appears first, in most cases.
-  while (peek() != '"' && !isAtEnd()) {
-    if (peek() == '\n') line_++;
-    advance();
-  }
+  const char* start = source_.data() + pos_;
+  size_t length = stringLength(start, source_.size() - pos_);
+  line_ += countNewlines(start, length);
+  pos_ += length;
   if (isAtEnd()) {
     return Token(TOKEN_ERROR, "Unterminated string.", line_);
   }
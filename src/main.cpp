@@ -1,32 +1,26 @@
 #include <vm.h>
 #include <common.h>
+#include <source_file.h>
 
-#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <string>
 
 #include <cassert>
+#include <cstdlib>
 
 using namespace alien;
 
 namespace {
 
-std::string readFile(const std::string& file) {
-  std::ifstream in_(file);
-  if (!in_) {
+void runScript(const std::string& file, const Options& options) {
+  SourceFile source;
+  if (!source.open(file)) {
     std::cerr << "Couldn't open file " << std::quoted(file);
     exit(EX_UNAVAILABLE);
   }
-  std::string source(std::istreambuf_iterator<char>(in_.rdbuf()),
-                     std::istreambuf_iterator<char>());
-  return source;
-}
-
-void runScript(const std::string& file) {
-  std::string source(readFile(file));
-  alien::Vm vm;
-  auto result = vm.interpret(source);
+  alien::Vm vm(options);
+  auto result = vm.interpret(source.text());
   switch (result) {
     case INTERPRET_OK: {
       break;
@@ -48,13 +42,56 @@ void runScript(const std::string& file) {
   }
 }
 
+// the cache of `file`, next to it or in `dir`.
+std::string cacheFile(const std::string& file, const std::string& dir) {
+  if (dir.empty()) {
+    return file + "c";
+  }
+  return dir + "/" + file.substr(file.find_last_of('/') + 1) + "c";
+}
+
 } // namespace
 
 int main(int argc, const char* argv[]) {
-  if (argc != 2) {
-    std::cerr << "Usage: alien file";
+  Options options;
+  std::string file;
+  bool cache = false;
+  std::string cacheDir;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-O") {
+      options.optimize = true;
+    } else if (arg == "--dump-ir") {
+      options.dumpIr = true;
+    } else if (arg == "--dump-types") {
+      options.dumpTypes = true;
+    } else if (arg == "--register") {
+      options.registers = true;
+    } else if (arg == "--lazy-parse") {
+      options.lazyParse = true;
+    } else if (arg.rfind("--jobs=", 0) == 0 && std::atoi(arg.c_str() + 7) > 0) {
+      options.jobs = std::atoi(arg.c_str() + 7);
+    } else if (arg == "--cache") {
+      cache = true;
+    } else if (arg.rfind("--cache=", 0) == 0 && arg.size() > 8) {
+      cache = true;
+      cacheDir = arg.substr(8);
+    } else if (arg.rfind("--snapshot=", 0) == 0 && arg.size() > 11) {
+      options.snapshotFile = arg.substr(11);
+    } else if (file.empty() && arg[0] != '-') {
+      file = arg;
+    } else {
+      file.clear();
+      break;
+    }
+  }
+  if (file.empty()) {
+    std::cerr << "Usage: alien [-O] [--dump-ir] [--dump-types] [--register] [--lazy-parse] [--jobs=n] [--cache[=dir]] [--snapshot=file] file";
     return EX_USAGE;
   }
-  runScript(argv[1]);
+  if (cache) {
+    options.cacheFile = cacheFile(file, cacheDir);
+  }
+  runScript(file, options);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include <native.h>
+#include <vm.h>
+#include <vector_ops.h>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace alien {
+
+namespace {
+  void runtimeError(std::string_view message) {
+    std::cerr << message << '\n';
+  }
+
+  ObjArray* asArray(const Value& value) {
+    auto obj = std::get_if<Obj*>(&value);
+    return obj ? (*obj)->asArray() : nullptr;
+  }
+
+  ObjMap* asMap(const Value& value) {
+    auto obj = std::get_if<Obj*>(&value);
+    return obj ? (*obj)->asMap() : nullptr;
+  }
+
+  ObjFloat64Array* asFloat64Array(const Value& value) {
+    auto obj = std::get_if<Obj*>(&value);
+    return obj ? (*obj)->asFloat64Array() : nullptr;
+  }
+
+  // a small slice of a huge text is copied, so that it doesn't keep
+  // the text alive.
+  const size_t kFlattenRoot = 1 << 20;
+  const size_t kFlattenSlice = 64;
+
+  Value newSlice(Vm& vm, ObjSlice* root, size_t start, size_t size) {
+    auto text = root->view();
+    if (text.size() >= kFlattenRoot && size <= kFlattenSlice) {
+      return Value(std::string(text.substr(start, size)));
+    }
+    auto slice = new ObjSlice(root, start, size);
+    vm.addObj(slice);
+    return slice;
+  }
+
+  // a range of a string or a slice. a string is copied, only the range
+  // of it, a slice is shared.
+  Value rangeOf(Vm& vm, const Value& value, size_t start, size_t size) {
+    auto obj = std::get_if<Obj*>(&value);
+    if (!obj) {
+      return Value(std::get<std::string>(value).substr(start, size));
+    }
+    auto slice = (*obj)->asSlice();
+    return newSlice(vm, slice->root(), slice->start() + start, size);
+  }
+
+  ObjFloat64Array* newFloat64Array(Vm& vm, std::vector<double> elements) {
+    auto array = new ObjFloat64Array(std::move(elements));
+    vm.addObj(array);
+    return array;
+  }
+
+  // the seconds since an arbitrary point, to time the code in between.
+  bool clock(Vm& vm, NativeArgs args, Value& result) {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    result = Value(std::chrono::duration<double>(now).count());
+    return true;
+  }
+
+  // the number of elements of an array, the entries of a map
+  // or the bytes of a string.
+  bool len(Vm& vm, NativeArgs args, Value& result) {
+    if (auto array = asArray(args[0])) {
+      result = Value(static_cast<double>(array->elements().size()));
+      return true;
+    }
+    if (auto array = asFloat64Array(args[0])) {
+      result = Value(static_cast<double>(array->elements().size()));
+      return true;
+    }
+    if (auto map = asMap(args[0])) {
+      result = Value(static_cast<double>(map->table().size()));
+      return true;
+    }
+    std::string_view text;
+    if (stringView(args[0], text)) {
+      result = Value(static_cast<double>(text.size()));
+      return true;
+    }
+    runtimeError("len needs an array, a map or a string.");
+    return false;
+  }
+
+  bool push(Vm& vm, NativeArgs args, Value& result) {
+    auto array = asArray(args[0]);
+    if (!array) {
+      runtimeError("push needs an array.");
+      return false;
+    }
+    array->elements().push_back(args[1]);
+    return true;
+  }
+
+  // removes the last element and returns it.
+  bool pop(Vm& vm, NativeArgs args, Value& result) {
+    auto array = asArray(args[0]);
+    if (!array) {
+      runtimeError("pop needs an array.");
+      return false;
+    }
+    if (array->elements().empty()) {
+      runtimeError("pop from an empty array.");
+      return false;
+    }
+    result = std::move(array->elements().back());
+    array->elements().pop_back();
+    return true;
+  }
+
+  bool has(Vm& vm, NativeArgs args, Value& result) {
+    auto map = asMap(args[0]);
+    if (!map) {
+      runtimeError("has needs a map.");
+      return false;
+    }
+    result = Value(map->table().find(args[1]) != nullptr);
+    return true;
+  }
+
+  // whether the key was in the map.
+  bool remove(Vm& vm, NativeArgs args, Value& result) {
+    auto map = asMap(args[0]);
+    if (!map) {
+      runtimeError("remove needs a map.");
+      return false;
+    }
+    result = Value(map->table().erase(args[1]));
+    return true;
+  }
+
+  // the elements of an array joined by a separator, the way to build a
+  // string from many pieces. the other values are written as print does.
+  bool join(Vm& vm, NativeArgs args, Value& result) {
+    auto array = asArray(args[0]);
+    std::string_view separator;
+    if (!array || !stringView(args[1], separator)) {
+      runtimeError("join needs an array and a string.");
+      return false;
+    }
+    std::string out;
+    size_t size = 0;
+    std::string_view text;
+    for (const auto& value : array->elements()) {
+      size += (stringView(value, text) ? text.size() : 0) + separator.size();
+    }
+    out.reserve(size);
+    std::ostringstream os;
+    for (size_t i = 0; i < array->elements().size(); i++) {
+      if (i > 0) {
+        out += separator;
+      }
+      const auto& value = array->elements()[i];
+      if (stringView(value, text)) {
+        out += text;
+      } else {
+        os.str("");
+        printValue(value, os);
+        out += os.str();
+      }
+    }
+    result = Value(std::move(out));
+    return true;
+  }
+
+  // substring(s, start, end) is the bytes of s from start up to end.
+  bool substring(Vm& vm, NativeArgs args, Value& result) {
+    std::string_view text;
+    auto start = std::get_if<double>(&args[1]);
+    auto end = std::get_if<double>(&args[2]);
+    if (!stringView(args[0], text) || !start || !end) {
+      runtimeError("substring needs a string and two indices.");
+      return false;
+    }
+    if (!(*start >= 0) || *start != std::trunc(*start) || *end != std::trunc(*end) ||
+        !(*start <= *end) || *end > text.size()) {
+      runtimeError("substring needs 0 <= start <= end <= len.");
+      return false;
+    }
+    auto from = static_cast<size_t>(*start);
+    result = rangeOf(vm, args[0], from, static_cast<size_t>(*end) - from);
+    return true;
+  }
+
+  // the string without the whitespace at either end.
+  bool trim(Vm& vm, NativeArgs args, Value& result) {
+    std::string_view text;
+    if (!stringView(args[0], text)) {
+      runtimeError("trim needs a string.");
+      return false;
+    }
+    const char* space = " \t\n\r\f\v";
+    size_t first = text.find_first_not_of(space);
+    if (first == std::string_view::npos) {
+      result = Value(std::string());
+      return true;
+    }
+    size_t last = text.find_last_not_of(space);
+    result = rangeOf(vm, args[0], first, last + 1 - first);
+    return true;
+  }
+
+  // the pieces of a string between the separators, as slices of it.
+  // a string is copied once into the text they share.
+  bool split(Vm& vm, NativeArgs args, Value& result) {
+    std::string_view text, separator;
+    if (!stringView(args[0], text) || !stringView(args[1], separator)) {
+      runtimeError("split needs two strings.");
+      return false;
+    }
+    if (separator.empty()) {
+      runtimeError("split needs a separator which isn't empty.");
+      return false;
+    }
+    ObjSlice* root;
+    size_t offset = 0;
+    if (auto str = std::get_if<std::string>(&args[0])) {
+      root = new ObjSlice(*str);
+      vm.addObj(root);
+    } else {
+      auto slice = AS_OBJ(args[0])->asSlice();
+      root = slice->root();
+      offset = slice->start();
+    }
+    auto array = new ObjArray();
+    vm.addObj(array);
+    for (size_t start = 0; ; ) {
+      size_t end = text.find(separator, start);
+      if (end == std::string_view::npos) {
+        array->elements().push_back(newSlice(vm, root, offset + start, text.size() - start));
+        break;
+      }
+      array->elements().push_back(newSlice(vm, root, offset + start, end - start));
+      start = end + separator.size();
+    }
+    result = array;
+    return true;
+  }
+
+  // a string with the text of a slice, or what print writes for a value.
+  bool str(Vm& vm, NativeArgs args, Value& result) {
+    std::string_view text;
+    if (stringView(args[0], text)) {
+      result = Value(std::string(text));
+      return true;
+    }
+    std::ostringstream os;
+    printValue(args[0], os);
+    result = Value(os.str());
+    return true;
+  }
+
+  // an array of the keys or the values of a map, in the same order.
+  template <bool keys>
+  bool entries(Vm& vm, NativeArgs args, Value& result) {
+    auto map = asMap(args[0]);
+    if (!map) {
+      runtimeError(keys ? "keys needs a map." : "values needs a map.");
+      return false;
+    }
+    auto array = new ObjArray();
+    vm.addObj(array);
+    array->elements().reserve(map->table().size());
+    map->table().forEach([&](const Table::Entry& entry) {
+      array->elements().push_back(keys ? entry.key : entry.value);
+    });
+    result = array;
+    return true;
+  }
+
+  // float64(n) is n zeros, float64(array) converts an array of numbers.
+  bool float64(Vm& vm, NativeArgs args, Value& result) {
+    if (auto n = std::get_if<double>(&args[0])) {
+      if (!(*n >= 0) || *n != std::trunc(*n)) {
+        runtimeError("the length must be a non-negative integer.");
+        return false;
+      }
+      result = newFloat64Array(vm, std::vector<double>(static_cast<size_t>(*n)));
+      return true;
+    }
+    auto array = asArray(args[0]);
+    if (!array) {
+      runtimeError("float64 needs a length or an array.");
+      return false;
+    }
+    std::vector<double> elements;
+    elements.reserve(array->elements().size());
+    for (const auto& value : array->elements()) {
+      auto number = std::get_if<double>(&value);
+      if (!number) {
+        runtimeError("a float64 array only holds numbers.");
+        return false;
+      }
+      elements.push_back(*number);
+    }
+    result = newFloat64Array(vm, std::move(elements));
+    return true;
+  }
+
+  // the two float64 arrays of a binary operation, of the same length.
+  bool operands(NativeArgs args, const char* name,
+                ObjFloat64Array*& a, ObjFloat64Array*& b) {
+    a = asFloat64Array(args[0]);
+    b = asFloat64Array(args[1]);
+    if (!a || !b) {
+      runtimeError(std::string(name) + " needs two float64 arrays.");
+      return false;
+    }
+    if (a->elements().size() != b->elements().size()) {
+      runtimeError(std::string(name) + " needs arrays of the same length.");
+      return false;
+    }
+    return true;
+  }
+
+  template <void (*op)(const double*, const double*, double*, size_t)>
+  bool elementwise(Vm& vm, NativeArgs args, Value& result, const char* name) {
+    ObjFloat64Array *a, *b;
+    if (!operands(args, name, a, b)) {
+      return false;
+    }
+    std::vector<double> elements(a->elements().size());
+    op(a->elements().data(), b->elements().data(), elements.data(), elements.size());
+    result = newFloat64Array(vm, std::move(elements));
+    return true;
+  }
+
+  bool vadd(Vm& vm, NativeArgs args, Value& result) {
+    return elementwise<addVectors>(vm, args, result, "vadd");
+  }
+
+  bool vmul(Vm& vm, NativeArgs args, Value& result) {
+    return elementwise<multiplyVectors>(vm, args, result, "vmul");
+  }
+
+  bool vscale(Vm& vm, NativeArgs args, Value& result) {
+    auto a = asFloat64Array(args[0]);
+    auto k = std::get_if<double>(&args[1]);
+    if (!a || !k) {
+      runtimeError("vscale needs a float64 array and a number.");
+      return false;
+    }
+    std::vector<double> elements(a->elements().size());
+    scaleVector(a->elements().data(), *k, elements.data(), elements.size());
+    result = newFloat64Array(vm, std::move(elements));
+    return true;
+  }
+
+  bool vdot(Vm& vm, NativeArgs args, Value& result) {
+    ObjFloat64Array *a, *b;
+    if (!operands(args, "vdot", a, b)) {
+      return false;
+    }
+    result = Value(dotVectors(a->elements().data(), b->elements().data(), a->elements().size()));
+    return true;
+  }
+
+  bool vsum(Vm& vm, NativeArgs args, Value& result) {
+    auto a = asFloat64Array(args[0]);
+    if (!a) {
+      runtimeError("vsum needs a float64 array.");
+      return false;
+    }
+    result = Value(sumVector(a->elements().data(), a->elements().size()));
+    return true;
+  }
+
+  template <double (*op)(const double*, size_t)>
+  bool extreme(Vm& vm, NativeArgs args, Value& result, const char* name) {
+    auto a = asFloat64Array(args[0]);
+    if (!a) {
+      runtimeError(std::string(name) + " needs a float64 array.");
+      return false;
+    }
+    if (a->elements().empty()) {
+      runtimeError(std::string(name) + " of an empty array.");
+      return false;
+    }
+    result = Value(op(a->elements().data(), a->elements().size()));
+    return true;
+  }
+
+  bool vmin(Vm& vm, NativeArgs args, Value& result) {
+    return extreme<minVector>(vm, args, result, "vmin");
+  }
+
+  bool vmax(Vm& vm, NativeArgs args, Value& result) {
+    return extreme<maxVector>(vm, args, result, "vmax");
+  }
+
+  // the running totals.
+  bool vcumsum(Vm& vm, NativeArgs args, Value& result) {
+    auto a = asFloat64Array(args[0]);
+    if (!a) {
+      runtimeError("vcumsum needs a float64 array.");
+      return false;
+    }
+    std::vector<double> elements(a->elements().size());
+    prefixSum(a->elements().data(), elements.data(), elements.size());
+    result = newFloat64Array(vm, std::move(elements));
+    return true;
+  }
+} // namespace
+
+void defineBuiltins(Vm& vm) {
+  vm.defineNative("clock", clock, 0);
+  vm.defineNative("len", len, 1);
+  vm.defineNative("push", push, 2);
+  vm.defineNative("pop", pop, 1);
+  vm.defineNative("has", has, 2);
+  vm.defineNative("remove", remove, 2);
+  vm.defineNative("keys", entries<true>, 1);
+  vm.defineNative("values", entries<false>, 1);
+  vm.defineNative("join", join, 2);
+  vm.defineNative("substring", substring, 3);
+  vm.defineNative("trim", trim, 1);
+  vm.defineNative("split", split, 2);
+  vm.defineNative("str", str, 1);
+  vm.defineNative("float64", float64, 1);
+  vm.defineNative("vadd", vadd, 2);
+  vm.defineNative("vmul", vmul, 2);
+  vm.defineNative("vscale", vscale, 2);
+  vm.defineNative("vdot", vdot, 2);
+  vm.defineNative("vsum", vsum, 1);
+  vm.defineNative("vmin", vmin, 1);
+  vm.defineNative("vmax", vmax, 1);
+  vm.defineNative("vcumsum", vcumsum, 1);
+}
+
+}
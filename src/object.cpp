@@ -6,4 +6,29 @@
 
 namespace alien {
 
-}
\ No newline at end of file
+bool stringView(const Value& value, std::string_view& view) {
+  if (auto str = std::get_if<std::string>(&value)) {
+    view = *str;
+    return true;
+  }
+  auto obj = std::get_if<Obj*>(&value);
+  if (obj && (*obj)->getType() == OBJ_SLICE) {
+    view = (*obj)->asSlice()->view();
+    return true;
+  }
+  return false;
+}
+
+bool concatenate(const Value& a, const Value& b, Value& result) {
+  std::string_view left, right;
+  if (!stringView(a, left) || !stringView(b, right)) {
+    return false;
+  }
+  std::string text;
+  text.reserve(left.size() + right.size());
+  text.append(left).append(right);
+  result = Value(std::move(text));
+  return true;
+}
+
+}
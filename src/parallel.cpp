@@ -0,0 +1,28 @@
+#include <parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace alien {
+
+void parallelFor(int count, int threads, const std::function<void(int)>& body) {
+  std::atomic<int> next{0};
+  auto work = [&]() {
+    for (int i = next++; i < count; i = next++) {
+      body(i);
+    }
+  };
+  // the calling thread is one of them.
+  std::vector<std::thread> pool;
+  for (int i = 1; i < std::min(threads, count); i++) {
+    pool.emplace_back(work);
+  }
+  work();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+}
+
+}
@@ -6,13 +6,18 @@
 #include <parser.h>
 #include <typedef.h>
 
+#include <array>
+#include <memory>
+#include <string>
 #include <vector>
 #include <utility>
 
+#include <cstdlib>
+
 namespace alien {
 
-Parser::Parser(std::string_view source)
-: lexer_(source) {}
+Parser::Parser(std::string_view source, bool preParse, int line)
+: preParse_(preParse), lexer_(source, line) {}
 
 std::vector<StmtPtr> Parser::parse() {
   advance();
@@ -41,7 +46,7 @@ StmtPtr Parser::parseDecl() {
 }
 
 StmtPtr Parser::parseClassDecl() {
-  auto classDecl = std::make_unique<ClassDecl>();
+  auto classDecl = make<ClassDecl>();
   consume(TOKEN_IDENTIFIER, "Expect class name.");
   classDecl->name = previous_;
   consume(TOKEN_LEFT_BRACE, "Expect '{' after class name.");
@@ -53,7 +58,7 @@ StmtPtr Parser::parseClassDecl() {
 }
 
 StmtPtr Parser::parseFuncDecl(FunctionType type) {
-  auto funcDecl = std::make_unique<FuncDecl>();
+  auto funcDecl = make<FuncDecl>();
   if (type == TYPE_METHOD) {
     consume(TOKEN_FUNC, "Expect 'func' before function declaration.");
   }
@@ -68,12 +73,68 @@ StmtPtr Parser::parseFuncDecl(FunctionType type) {
   }
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
   consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
-  funcDecl->body = parseBlock();
+  if (preParse_) {
+    skipBody(*funcDecl);
+  } else {
+    funcDecl->body = parseBlock();
+  }
   return funcDecl;
 }
 
+void Parser::skipBody(FuncDecl& decl) {
+  std::string_view source = lexer_.source();
+  int start = lexer_.tokenStart();
+  decl.line = current_.line_;
+  // the assignments are what the compiler needs to know before the body
+  // is parsed, `name =` and `object.name =`.
+  TokenType beforeName = TOKEN_EOF;
+  int depth = 1;
+  while (depth > 0 && !check(TOKEN_EOF)) {
+    if (check(TOKEN_LEFT_BRACE)) {
+      depth++;
+    } else if (check(TOKEN_RIGHT_BRACE)) {
+      depth--;
+    } else if (check(TOKEN_EQUAL) && previous_.type_ == TOKEN_IDENTIFIER) {
+      if (beforeName == TOKEN_DOT) {
+        decl.setProperties.push_back(previous_.lexeme_);
+      } else {
+        decl.assigned.push_back(previous_.lexeme_);
+      }
+    }
+    beforeName = previous_.type_;
+    advance();
+  }
+  if (depth > 0) {
+    errorAtCurrent("Expect '}' after block.");
+  }
+  decl.source = source.substr(start, lexer_.tokenStart() - start);
+}
+
+bool Parser::parseBody(FuncDecl& decl) {
+  if (decl.body) {
+    return true;
+  }
+  // it failed before, the error was reported.
+  if (decl.source.empty()) {
+    return false;
+  }
+  Parser parser(decl.source, false, decl.line);
+  // the nodes of a body take about 7 bytes per character of its source,
+  // its arena starts with a block of that size rather than a full one.
+  parser.arena_ = std::make_unique<Arena>(decl.source.size() * 8);
+  parser.advance();
+  auto body = parser.parseBlock();
+  decl.source = {};
+  if (parser.hadError()) {
+    return false;
+  }
+  decl.arena = std::move(parser.arena_);
+  decl.body = std::move(body);
+  return true;
+}
+
 StmtPtr Parser::parseVarDecl() {
-  auto varDecl = std::make_unique<VarDecl>();
+  auto varDecl = make<VarDecl>();
   consume(TOKEN_IDENTIFIER, "Expect variable name.");
   varDecl->name = previous_;
   if (match(TOKEN_EQUAL)) {
@@ -84,7 +145,7 @@ StmtPtr Parser::parseVarDecl() {
 }
 
 StmtPtr Parser::parseConstDecl() {
-  auto constDecl = std::make_unique<ConstDecl>();
+  auto constDecl = make<ConstDecl>();
   consume(TOKEN_IDENTIFIER, "Expect variable name.");
   constDecl->name = previous_;
   consume(TOKEN_EQUAL, "Expect '=' after constant name.");
@@ -112,7 +173,7 @@ StmtPtr Parser::parseStmt() {
 }
 
 StmtPtr Parser::parseIfStmt() {
-  auto ifStmt = std::make_unique<IfStmt>();
+  auto ifStmt = make<IfStmt>();
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
   ifStmt->condition = parseExpr();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
@@ -126,7 +187,7 @@ StmtPtr Parser::parseIfStmt() {
 }
 
 StmtPtr Parser::parseWhileStmt() {
-  auto whileStmt = std::make_unique<WhileStmt>();
+  auto whileStmt = make<WhileStmt>();
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
   whileStmt->condition = parseExpr();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
@@ -136,7 +197,7 @@ StmtPtr Parser::parseWhileStmt() {
 }
 
 StmtPtr Parser::parseForStmt() {
-  auto forStmt = std::make_unique<ForStmt>();
+  auto forStmt = make<ForStmt>();
   consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
   if (match(TOKEN_SEMICOLON)) {
     // there is no initializer;
@@ -161,14 +222,14 @@ StmtPtr Parser::parseForStmt() {
 }
 
 StmtPtr Parser::parseExprStmt() {
-  auto exprStmt = std::make_unique<ExprStmt>();
+  auto exprStmt = make<ExprStmt>();
   exprStmt->expr = parseExpr();
   consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
   return exprStmt;
 }
 
 StmtPtr Parser::parseReturnStmt() {
-  auto returnStmt = std::make_unique<ReturnStmt>();
+  auto returnStmt = make<ReturnStmt>();
   if (!check(TOKEN_SEMICOLON)) {
     returnStmt->expr = parseExpr();
   }
@@ -177,14 +238,14 @@ StmtPtr Parser::parseReturnStmt() {
 }
 
 StmtPtr Parser::parsePrintStmt() {
-  auto printStmt = std::make_unique<PrintStmt>();
+  auto printStmt = make<PrintStmt>();
   printStmt->expr = parseExpr();
   consume(TOKEN_SEMICOLON, "Expect ';' after print statement.");
   return printStmt;
 }
 
 StmtPtr Parser::parseBlock() {
-  auto block = std::make_unique<BlockStmt>();
+  auto block = make<BlockStmt>();
   std::vector<StmtPtr> statements;
   while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
     if (match(TOKEN_VAR)) {
@@ -199,181 +260,199 @@ StmtPtr Parser::parseBlock() {
   return block;
 }
 
-ExprPtr Parser::parseExpr() {
-  return parseAssign();
+const Parser::Rule& Parser::rule(TokenType type) {
+  static const auto rules = []() {
+    std::array<Rule, TOKEN_EOF + 1> rules{};
+    rules[TOKEN_LEFT_PAREN]    = {&Parser::parseGrouping, &Parser::parseArgs, PREC_CALL};
+    rules[TOKEN_DOT]           = {nullptr, &Parser::parseGet, PREC_CALL};
+    rules[TOKEN_LEFT_BRACKET]  = {&Parser::parseArray, &Parser::parseIndex, PREC_CALL};
+    // a block where a statement starts.
+    rules[TOKEN_LEFT_BRACE]    = {&Parser::parseMap, nullptr, PREC_NONE};
+    rules[TOKEN_MINUS]         = {&Parser::parseUnary, &Parser::parseBinary, PREC_TERM};
+    rules[TOKEN_PLUS]          = {nullptr, &Parser::parseBinary, PREC_TERM};
+    rules[TOKEN_SLASH]         = {nullptr, &Parser::parseBinary, PREC_FACTOR};
+    rules[TOKEN_STAR]          = {nullptr, &Parser::parseBinary, PREC_FACTOR};
+    rules[TOKEN_BANG]          = {&Parser::parseUnary, nullptr, PREC_NONE};
+    rules[TOKEN_BANG_EQUAL]    = {nullptr, &Parser::parseBinary, PREC_EQUALITY};
+    rules[TOKEN_EQUAL_EQUAL]   = {nullptr, &Parser::parseBinary, PREC_EQUALITY};
+    rules[TOKEN_EQUAL]         = {nullptr, &Parser::parseAssign, PREC_ASSIGN};
+    rules[TOKEN_GREATER]       = {nullptr, &Parser::parseBinary, PREC_COMPARISON};
+    rules[TOKEN_GREATER_EQUAL] = {nullptr, &Parser::parseBinary, PREC_COMPARISON};
+    rules[TOKEN_LESS]          = {nullptr, &Parser::parseBinary, PREC_COMPARISON};
+    rules[TOKEN_LESS_EQUAL]    = {nullptr, &Parser::parseBinary, PREC_COMPARISON};
+    rules[TOKEN_AND]           = {nullptr, &Parser::parseLogical, PREC_AND};
+    rules[TOKEN_OR]            = {nullptr, &Parser::parseLogical, PREC_OR};
+    rules[TOKEN_IDENTIFIER]    = {&Parser::parseVariable, nullptr, PREC_NONE};
+    rules[TOKEN_STRING]        = {&Parser::parseString, nullptr, PREC_NONE};
+    rules[TOKEN_NUMBER]        = {&Parser::parseNumber, nullptr, PREC_NONE};
+    rules[TOKEN_NIL]           = {&Parser::parseLiteral, nullptr, PREC_NONE};
+    rules[TOKEN_TRUE]          = {&Parser::parseLiteral, nullptr, PREC_NONE};
+    rules[TOKEN_FALSE]         = {&Parser::parseLiteral, nullptr, PREC_NONE};
+    rules[TOKEN_THIS]          = {&Parser::parseThis, nullptr, PREC_NONE};
+    return rules;
+  }();
+  return rules[type];
 }
 
-ExprPtr Parser::parseAssign() {
-  auto expr = parseOr();
-  if (match(TOKEN_EQUAL)) {
-    // decrease one layer of indirection
-    auto value = parseAssign();
-    if (expr->getType() == Expr::VARIABLE) {
-      auto assignExpr = std::make_unique<Assign>();
-      auto v = dynamic_cast<Variable*>(expr.get());
-      assignExpr->name = v->name;
-      assignExpr->value = std::move(value);
-      return assignExpr;
-    } else if (expr->getType() == Expr::GET) {
-      auto setExpr = std::make_unique<Set>();
-      auto get = dynamic_cast<Get*>(expr.get());
-      setExpr->object = std::move(get->object);
-      setExpr->name = get->name;
-      setExpr->value = std::move(value);
-      return setExpr;
-    }
-    error("Invalid assignment target.");
-  }
-  return expr;
+ExprPtr Parser::parseExpr() {
+  return parsePrecedence(PREC_ASSIGN);
 }
 
-ExprPtr Parser::parseOr() {
-  auto expr = parseAnd();
-  while (match(TOKEN_OR)) {
-    auto orExpr = std::make_unique<Logical>();
-    orExpr->op = previous_;
-    orExpr->left = std::move(expr);
-    orExpr->right = parseAnd();
-    expr = std::move(orExpr);
+// parses an expression whose operators bind at least as tight as `precedence`.
+ExprPtr Parser::parsePrecedence(Precedence precedence) {
+  auto prefix = rule(current_.type_).prefix;
+  if (!prefix) {
+    error("Expect expression");
+    return nullptr;
+  }
+  advance();
+  auto expr = (this->*prefix)();
+  while (expr && precedence <= rule(current_.type_).precedence) {
+    advance();
+    expr = (this->*rule(previous_.type_).infix)(std::move(expr));
   }
   return expr;
 }
 
-ExprPtr Parser::parseAnd() {
-  auto expr = parseEquality();
-  while (match(TOKEN_AND)) {
-    auto andExpr = std::make_unique<Logical>();
-    andExpr->op = previous_;
-    andExpr->left = std::move(expr);
-    andExpr->right = parseEquality();
-    expr = std::move(andExpr);
-  }
-  return expr;
+ExprPtr Parser::parseAssign(ExprPtr target) {
+  // right associative.
+  auto value = parsePrecedence(PREC_ASSIGN);
+  if (target->getType() == Expr::VARIABLE) {
+    auto assignExpr = make<Assign>();
+    assignExpr->name = static_cast<Variable*>(target.get())->name;
+    assignExpr->value = std::move(value);
+    return assignExpr;
+  } else if (target->getType() == Expr::GET) {
+    auto setExpr = make<Set>();
+    auto get = static_cast<Get*>(target.get());
+    setExpr->object = std::move(get->object);
+    setExpr->name = get->name;
+    setExpr->value = std::move(value);
+    return setExpr;
+  } else if (target->getType() == Expr::INDEX) {
+    auto setExpr = make<IndexSet>();
+    auto index = static_cast<Index*>(target.get());
+    setExpr->object = std::move(index->object);
+    setExpr->index = std::move(index->index);
+    setExpr->value = std::move(value);
+    return setExpr;
+  }
+  error("Invalid assignment target.");
+  return target;
+}
+
+ExprPtr Parser::parseLogical(ExprPtr left) {
+  auto logical = make<Logical>();
+  logical->op = previous_;
+  logical->left = std::move(left);
+  logical->right = parsePrecedence(static_cast<Precedence>(rule(previous_.type_).precedence + 1));
+  return logical;
+}
+
+ExprPtr Parser::parseBinary(ExprPtr left) {
+  auto binary = make<Binary>();
+  binary->op = previous_;
+  binary->left = std::move(left);
+  // left associative, the right operand only takes tighter operators.
+  binary->right = parsePrecedence(static_cast<Precedence>(rule(previous_.type_).precedence + 1));
+  return binary;
 }
 
-ExprPtr Parser::parseEquality() {
-  auto expr = parseCmp();
-  while (match(TOKEN_BANG_EQUAL, TOKEN_EQUAL_EQUAL)) {
-    auto equalityExpr = std::make_unique<Binary>();
-    equalityExpr->op = previous_;
-    equalityExpr->left = std::move(expr);
-    equalityExpr->right = parseCmp();
-    expr = std::move(equalityExpr);
-  }
-  return expr;
+ExprPtr Parser::parseUnary() {
+  auto unaryExpr = make<Unary>();
+  unaryExpr->op = previous_;
+  unaryExpr->right = parsePrecedence(PREC_UNARY);
+  return unaryExpr;
 }
 
-ExprPtr Parser::parseCmp() {
-  auto expr = parseTerm();
-  while (match(TOKEN_GREATER, TOKEN_GREATER_EQUAL,
-      TOKEN_LESS, TOKEN_LESS_EQUAL)) {
-    auto cmpExpr = std::make_unique<Binary>();
-    cmpExpr->op = previous_;
-    cmpExpr->left = std::move(expr);
-    cmpExpr->right = parseTerm();
-    expr = std::move(cmpExpr);
+ExprPtr Parser::parseArgs(ExprPtr callee) {
+  auto expr = make<Call>();
+  expr->callee = std::move(callee);
+  if (!check(TOKEN_RIGHT_PAREN)) {
+    do {
+      expr->arguments.push_back(parseExpr());
+    } while (match(TOKEN_COMMA));
   }
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
   return expr;
 }
 
-ExprPtr Parser::parseTerm() {
-  auto expr = parseFactor();
-  while (match(TOKEN_PLUS, TOKEN_MINUS)) {
-    auto termExpr = std::make_unique<Binary>();
-    termExpr->op = previous_;
-    termExpr->left = std::move(expr);
-    termExpr->right = parseFactor();
-    expr = std::move(termExpr);
-  }
-  return expr;
+ExprPtr Parser::parseGet(ExprPtr object) {
+  consume(TOKEN_IDENTIFIER, "Expect identifier after '.'.");
+  auto getExpr = make<Get>();
+  getExpr->name = previous_;
+  getExpr->object = std::move(object);
+  return getExpr;
 }
 
-ExprPtr Parser::parseFactor() {
-  auto expr = parseUnary();
-  while (match(TOKEN_SLASH, TOKEN_STAR)) {
-    auto factorExpr = std::make_unique<Binary>();
-    factorExpr->op = previous_;
-    factorExpr->left = std::move(expr);
-    factorExpr->right = parseUnary();
-    expr = std::move(factorExpr);
-  }
-  return expr;
+ExprPtr Parser::parseIndex(ExprPtr object) {
+  auto indexExpr = make<Index>();
+  indexExpr->object = std::move(object);
+  indexExpr->index = parseExpr();
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+  return indexExpr;
 }
 
-ExprPtr Parser::parseUnary() {
-  if (match(TOKEN_BANG, TOKEN_MINUS)) {
-    auto unaryExpr = std::make_unique<Unary>();
-    unaryExpr->op = previous_;
-    unaryExpr->right = parseUnary();
-    return unaryExpr;
+ExprPtr Parser::parseArray() {
+  auto arrayExpr = make<Array>();
+  if (!check(TOKEN_RIGHT_BRACKET)) {
+    do {
+      arrayExpr->elements.push_back(parseExpr());
+    } while (match(TOKEN_COMMA));
   }
-  return parseCall();
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after elements.");
+  return arrayExpr;
 }
 
-ExprPtr Parser::parseArgs(ExprPtr callee) {
-  auto expr = std::make_unique<Call>();
-  expr->callee = std::move(callee);
-  if (!check(TOKEN_RIGHT_PAREN)) {
+ExprPtr Parser::parseMap() {
+  auto mapExpr = make<Map>();
+  if (!check(TOKEN_RIGHT_BRACE)) {
     do {
-      expr->arguments.push_back(parseExpr());
+      mapExpr->keys.push_back(parseExpr());
+      consume(TOKEN_COLON, "Expect ':' after key.");
+      mapExpr->values.push_back(parseExpr());
     } while (match(TOKEN_COMMA));
   }
-  consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
-  return expr;
+  consume(TOKEN_RIGHT_BRACE, "Expect '}' after entries.");
+  return mapExpr;
 }
 
+ExprPtr Parser::parseLiteral() {
+  auto literalExpr = make<Literal>();
+  literalExpr->literal = previous_.type_;
+  return literalExpr;
+}
 
-ExprPtr Parser::parseCall() {
-  auto expr = parsePrimary();
-  while (true) {
-    if (match(TOKEN_LEFT_PAREN)) {
-      expr = parseArgs(std::move(expr));
-    } else if (match(TOKEN_DOT)) {
-      consume(TOKEN_IDENTIFIER, "Expect identifier after '.'.");
-      auto getExpr = std::make_unique<Get>();
-      getExpr->name = previous_;
-      getExpr->object = std::move(expr);
-      expr = std::move(getExpr);
-    } else {
-      break;
-    }
-  }
-  return expr;
+ExprPtr Parser::parseThis() {
+  return make<This>();
 }
 
-ExprPtr Parser::parsePrimary() {
-  if (match(TOKEN_NIL, TOKEN_FALSE, TOKEN_TRUE)) {
-    auto literalExpr = std::make_unique<Literal>();
-    literalExpr->literal = previous_.type_;
-    return literalExpr;
-  }
-  if (match(TOKEN_THIS)) {
-    return std::make_unique<This>();
-  }
-  if (match(TOKEN_NUMBER)) {
-    auto numberExpr = std::make_unique<Number>();
-    // attention: 'strtod' may interpret 123.123e12 to valid number.
-    numberExpr->value = std::strtod(previous_.lexeme_.data(), nullptr);
-    return numberExpr;
-  }
-  if (match(TOKEN_STRING)) {
-    auto stringExpr = std::make_unique<String>();
-    stringExpr->str = previous_.lexeme_;
-    return stringExpr;
-  }
-  if (match(TOKEN_IDENTIFIER)) {
-    auto variable = std::make_unique<Variable>();
-    variable->name = previous_;
-    return variable;
-  }
-  if (match(TOKEN_LEFT_PAREN)) {
-    auto grouping = std::make_unique<Grouping>();
-    grouping->expr = parseExpr();
-    consume(TOKEN_RIGHT_PAREN, "Expect ')' after grouping expression");
-    return grouping;
-  }
-  error("Expect expression");
-  return nullptr;
+ExprPtr Parser::parseNumber() {
+  auto numberExpr = make<Number>();
+  // attention: 'strtod' may interpret 123.123e12 to valid number.
+  // the source may end right after the number, 'strtod' needs a '\0'.
+  std::string digits(previous_.lexeme_);
+  numberExpr->value = std::strtod(digits.c_str(), nullptr);
+  return numberExpr;
+}
+
+ExprPtr Parser::parseString() {
+  auto stringExpr = make<String>();
+  stringExpr->str = previous_.lexeme_;
+  return stringExpr;
+}
+
+ExprPtr Parser::parseVariable() {
+  auto variable = make<Variable>();
+  variable->name = previous_;
+  return variable;
+}
+
+ExprPtr Parser::parseGrouping() {
+  auto grouping = make<Grouping>();
+  grouping->expr = parseExpr();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after grouping expression");
+  return grouping;
 }
 
 bool Parser::match(TokenType type) {
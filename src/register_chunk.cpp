@@ -0,0 +1,111 @@
+#include <register_chunk.h>
+
+#include <cstring>
+#include <ostream>
+
+namespace alien {
+
+namespace {
+  const char* opName(RegisterOp op) {
+    switch (op) {
+      case ROP_MOVE:          return "ROP_MOVE";
+      case ROP_LOADK:         return "ROP_LOADK";
+      case ROP_LOADNIL:       return "ROP_LOADNIL";
+      case ROP_LOADBOOL:      return "ROP_LOADBOOL";
+      case ROP_PRINT:         return "ROP_PRINT";
+      case ROP_EQUAL:         return "ROP_EQUAL";
+      case ROP_GREATER:       return "ROP_GREATER";
+      case ROP_LESS:          return "ROP_LESS";
+      case ROP_ADD:           return "ROP_ADD";
+      case ROP_SUBTRACT:      return "ROP_SUBTRACT";
+      case ROP_MULTIPLY:      return "ROP_MULTIPLY";
+      case ROP_DIVIDE:        return "ROP_DIVIDE";
+      case ROP_NOT:           return "ROP_NOT";
+      case ROP_NEGATE:        return "ROP_NEGATE";
+      case ROP_CALL:          return "ROP_CALL";
+      case ROP_RETURN:        return "ROP_RETURN";
+      case ROP_GET_GLOBAL:    return "ROP_GET_GLOBAL";
+      case ROP_SET_GLOBAL:    return "ROP_SET_GLOBAL";
+      case ROP_DEFINE_GLOBAL: return "ROP_DEFINE_GLOBAL";
+      case ROP_GET_PROPERTY:  return "ROP_GET_PROPERTY";
+      case ROP_SET_PROPERTY:  return "ROP_SET_PROPERTY";
+      case ROP_ARRAY:         return "ROP_ARRAY";
+      case ROP_MAP:           return "ROP_MAP";
+      case ROP_GET_INDEX:     return "ROP_GET_INDEX";
+      case ROP_SET_INDEX:     return "ROP_SET_INDEX";
+      case ROP_JUMP:          return "ROP_JUMP";
+      case ROP_JUMP_IF_FALSE: return "ROP_JUMP_IF_FALSE";
+      case ROP_JUMP_IF_TRUE:  return "ROP_JUMP_IF_TRUE";
+    }
+    return "ROP_UNKNOWN";
+  }
+} // namespace
+
+int RegisterChunk::addConstant(const Value &value) {
+  // the names of globals and properties repeat a lot.
+  for (size_t i = 0; i < constants_.size(); i++) {
+    if (constants_[i].index() != value.index()) {
+      continue;
+    }
+    if (std::holds_alternative<double>(value)) {
+      // 0 and -0 are different constants.
+      double a = std::get<double>(value);
+      double b = std::get<double>(constants_[i]);
+      if (std::memcmp(&a, &b, sizeof(double)) == 0) {
+        return i;
+      }
+    } else if (std::holds_alternative<std::string>(value) && constants_[i] == value) {
+      return i;
+    }
+  }
+  constants_.push_back(value);
+  return constants_.size() - 1;
+}
+
+void RegisterChunk::disassemble(std::ostream &os) {
+  for (size_t i = 0; i < code_.size(); i++) {
+    disassembleInstruction(i, os);
+  }
+}
+
+void RegisterChunk::disassembleInstruction(int i, std::ostream &os) {
+  uint32_t instruction = code_[i];
+  auto op = opOf(instruction);
+  os << i << ' ' << opName(op) << ' ' << argA(instruction);
+  switch (op) {
+    case ROP_LOADK:
+    case ROP_GET_GLOBAL:
+    case ROP_SET_GLOBAL:
+    case ROP_DEFINE_GLOBAL: {
+      os << ' ' << argBx(instruction) << '(';
+      printValue(constants_[argBx(instruction)], os);
+      os << ')';
+      break;
+    }
+    case ROP_JUMP:
+    case ROP_JUMP_IF_FALSE:
+    case ROP_JUMP_IF_TRUE: {
+      os << " -> " << i + 1 + argSBx(instruction);
+      break;
+    }
+    case ROP_MOVE:
+    case ROP_LOADBOOL:
+    case ROP_NOT:
+    case ROP_NEGATE:
+    case ROP_CALL: {
+      os << ' ' << argB(instruction);
+      break;
+    }
+    case ROP_LOADNIL:
+    case ROP_PRINT:
+    case ROP_RETURN:
+      break;
+    default: {
+      os << ' ' << argB(instruction) << ' ' << argC(instruction);
+      break;
+    }
+  }
+  os << '\n';
+}
+
+}
@@ -0,0 +1,522 @@
+#include <register_compiler.h>
+#include <parser.h>
+#include <vm.h>
+#include <ast.h>
+#include <value.h>
+#include <object.h>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cassert>
+
+namespace alien {
+
+namespace {
+  void compileTimeError(std::string_view message) {
+    std::cerr << message << '\n';
+  }
+
+  std::string toString(std::string_view name) {
+    return std::string(name.data(), name.size());
+  }
+
+  // the operands are one byte.
+  const int kMaxRegisters = 256;
+  const int kMaxConstants = 1 << 16;
+} // namespace
+
+ObjFunction* RegisterCompiler::compile(std::vector<StmtPtr> &stmts) {
+  // the script itself, can't be resolved.
+  addLocal("");
+  for (const auto& stmt : stmts) {
+    stmt->accept(*this);
+  }
+  int slot = allocate();
+  emit(encodeBx(ROP_GET_GLOBAL, slot, name("main", kMaxConstants)));
+  emit(encode(ROP_CALL, slot, 0));
+  emit(encode(ROP_LOADNIL, slot));
+  emit(encode(ROP_RETURN, slot));
+  globalChunk_.setRegisters(maxSlots_);
+  return new ObjFunction("script", globalChunk_, 0);
+}
+
+void RegisterCompiler::expr(Expr &expr, int dest) {
+  int saved = freeSlot_;
+  int savedDest = dest_;
+  dest_ = dest;
+  expr.accept(*this);
+  dest_ = savedDest;
+  // the temporaries die with the expression.
+  freeSlot_ = saved;
+}
+
+int RegisterCompiler::operand(Expr &expr, Expr* later) {
+  if (expr.getType() == Expr::VARIABLE) {
+    auto name = static_cast<Variable&>(expr).name.lexeme_;
+    int slot = resolveLocal(name);
+    if (slot != -1 && (!later || !isAssigned(name, *later))) {
+      return slot;
+    }
+  } else if (dynamic_cast<This*>(&expr)) {
+    return 0;
+  }
+  int slot = allocate();
+  this->expr(expr, slot);
+  return slot;
+}
+
+int RegisterCompiler::target(int dest) {
+  return dest == kDiscard ? allocate() : dest;
+}
+
+int RegisterCompiler::allocate() {
+  if (freeSlot_ == kMaxRegisters) {
+    error("too many registers in a function.");
+    // keep going, the code is never run.
+    return freeSlot_ - 1;
+  }
+  maxSlots_ = std::max(maxSlots_, ++freeSlot_);
+  return freeSlot_ - 1;
+}
+
+int RegisterCompiler::emitJump(RegisterOp op, int a) {
+  emit(encodeBx(op, a, 0));
+  return chunk_->code().size() - 1;
+}
+
+void RegisterCompiler::fixJump(int at) {
+  int offset = chunk_->code().size() - at - 1;
+  auto& instruction = chunk_->code()[at];
+  instruction = encodeBx(opOf(instruction), argA(instruction), offset + kJumpBias);
+}
+
+void RegisterCompiler::emitLoop(int loopStart) {
+  int offset = loopStart - static_cast<int>(chunk_->code().size()) - 1;
+  if (offset + kJumpBias < 0) {
+    error("loop body too large.");
+  }
+  emit(encodeBx(ROP_JUMP, 0, offset + kJumpBias));
+}
+
+int RegisterCompiler::constant(const Value &value, int limit) {
+  int index = chunk_->addConstant(value);
+  if (index >= limit) {
+    error("too many constants in a function.");
+    return 0;
+  }
+  return index;
+}
+
+int RegisterCompiler::name(std::string_view name, int limit) {
+  return constant(Value(toString(name)), limit);
+}
+
+void RegisterCompiler::error(std::string_view message) {
+  compileTimeError(message);
+  hadError_ = true;
+}
+
+void RegisterCompiler::addLocal(std::string_view name) {
+  locals_.push_back(Local{depth_, name});
+}
+
+int RegisterCompiler::resolveLocal(std::string_view name) {
+  for (int i = locals_.size() - 1; i >= 0; i--) {
+    if (locals_[i].name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void RegisterCompiler::beginScope() {
+  depth_++;
+}
+
+void RegisterCompiler::endScope() {
+  while (!locals_.empty() && locals_.back().depth == depth_) {
+    locals_.pop_back();
+  }
+  freeSlot_ = locals_.size();
+  depth_--;
+}
+
+void RegisterCompiler::visit(ClassDecl &decl) {
+  std::string name(toString(decl.name.lexeme_));
+  currentClass_ = new ObjClass(name);
+  vm_.addObj(currentClass_);
+  for (const auto& method : decl.methods) {
+    method->accept(*this);
+  }
+  int slot = allocate();
+  emit(encodeBx(ROP_LOADK, slot, constant(currentClass_, kMaxConstants)));
+  emit(encodeBx(ROP_DEFINE_GLOBAL, slot, this->name(name, kMaxConstants)));
+  freeSlot_--;
+  currentClass_ = nullptr;
+}
+
+void RegisterCompiler::visit(FuncDecl &decl) {
+  if (!Parser::parseBody(decl)) {
+    hadError_ = true;
+    return;
+  }
+  RegisterChunk chunk;
+  chunk_ = &chunk;
+  int savedFree = freeSlot_;
+  int savedMax = maxSlots_;
+  auto savedLocals = std::move(locals_);
+  depth_++;
+  locals_.clear();
+  addLocal(currentClass_ ? "this" : decl.name.lexeme_);
+  for (const auto& parameter : decl.parameters) {
+    addLocal(parameter.lexeme_);
+  }
+  freeSlot_ = maxSlots_ = locals_.size();
+  isInitializer_ = currentClass_ && decl.name.lexeme_ == "init";
+  auto blockStmt = static_cast<BlockStmt*>(decl.body.get());
+  for (const auto& stmt : blockStmt->stmts) {
+    stmt->accept(*this);
+  }
+  if (isInitializer_) {
+    emit(encode(ROP_RETURN, 0));
+  } else {
+    int slot = allocate();
+    emit(encode(ROP_LOADNIL, slot));
+    emit(encode(ROP_RETURN, slot));
+  }
+  chunk.setRegisters(maxSlots_);
+  isInitializer_ = false;
+  locals_ = std::move(savedLocals);
+  depth_--;
+  chunk_ = &globalChunk_;
+  freeSlot_ = savedFree;
+  maxSlots_ = savedMax;
+
+  std::string name(toString(decl.name.lexeme_));
+  auto func = new ObjFunction(name, std::move(chunk), decl.parameters.size());
+  vm_.addObj(func);
+  if (currentClass_) {
+    currentClass_->addMethod(name, func);
+  } else {
+    int slot = allocate();
+    emit(encodeBx(ROP_LOADK, slot, constant(func, kMaxConstants)));
+    emit(encodeBx(ROP_DEFINE_GLOBAL, slot, this->name(name, kMaxConstants)));
+    freeSlot_--;
+  }
+}
+
+void RegisterCompiler::visit(VarDecl &decl) {
+  if (depth_ == 0) {
+    int slot = allocate();
+    if (decl.initializer) {
+      expr(*decl.initializer, slot);
+    } else {
+      emit(encode(ROP_LOADNIL, slot));
+    }
+    emit(encodeBx(ROP_DEFINE_GLOBAL, slot, name(decl.name.lexeme_, kMaxConstants)));
+    freeSlot_--;
+    return;
+  }
+  // the local isn't visible in its initializer.
+  int slot = allocate();
+  if (decl.initializer) {
+    expr(*decl.initializer, slot);
+  } else {
+    emit(encode(ROP_LOADNIL, slot));
+  }
+  addLocal(decl.name.lexeme_);
+}
+
+void RegisterCompiler::visit(ConstDecl &decl) {}
+
+void RegisterCompiler::visit(BlockStmt &stmts) {
+  beginScope();
+  for (const auto& stmt : stmts.stmts) {
+    stmt->accept(*this);
+  }
+  endScope();
+}
+
+void RegisterCompiler::visit(IfStmt &stmt) {
+  int saved = freeSlot_;
+  int condition = operand(*stmt.condition);
+  freeSlot_ = saved;
+  int thenJump = emitJump(ROP_JUMP_IF_FALSE, condition);
+  stmt.thenBranch->accept(*this);
+  if (stmt.elseBranch) {
+    int elseJump = emitJump(ROP_JUMP);
+    fixJump(thenJump);
+    stmt.elseBranch->accept(*this);
+    fixJump(elseJump);
+  } else {
+    fixJump(thenJump);
+  }
+}
+
+void RegisterCompiler::visit(WhileStmt &stmt) {
+  int loopStart = chunk_->code().size();
+  int saved = freeSlot_;
+  int condition = operand(*stmt.condition);
+  freeSlot_ = saved;
+  int exitJump = emitJump(ROP_JUMP_IF_FALSE, condition);
+  stmt.body->accept(*this);
+  emitLoop(loopStart);
+  fixJump(exitJump);
+}
+
+void RegisterCompiler::visit(ForStmt &stmt) {
+  beginScope();
+  if (stmt.initializer) {
+    stmt.initializer->accept(*this);
+  }
+  int loopStart = chunk_->code().size();
+  int exitJump = -1;
+  if (stmt.condition) {
+    int saved = freeSlot_;
+    int condition = operand(*stmt.condition);
+    freeSlot_ = saved;
+    exitJump = emitJump(ROP_JUMP_IF_FALSE, condition);
+  }
+  stmt.body->accept(*this);
+  if (stmt.increment) {
+    expr(*stmt.increment, kDiscard);
+  }
+  emitLoop(loopStart);
+  if (exitJump != -1) {
+    fixJump(exitJump);
+  }
+  endScope();
+}
+
+void RegisterCompiler::visit(PrintStmt &stmt) {
+  int saved = freeSlot_;
+  emit(encode(ROP_PRINT, operand(*stmt.expr)));
+  freeSlot_ = saved;
+}
+
+void RegisterCompiler::visit(ReturnStmt &stmt) {
+  if (isInitializer_) {
+    error("can't use `return` keyword in a initializer.");
+  }
+  int saved = freeSlot_;
+  int result;
+  if (stmt.expr) {
+    result = operand(*stmt.expr);
+  } else {
+    result = allocate();
+    emit(encode(ROP_LOADNIL, result));
+  }
+  emit(encode(ROP_RETURN, result));
+  freeSlot_ = saved;
+}
+
+void RegisterCompiler::visit(ExprStmt &stmt) {
+  expr(*stmt.expr, kDiscard);
+}
+
+void RegisterCompiler::visit(Assign &expr) {
+  int dest = dest_;
+  int slot = resolveLocal(expr.name.lexeme_);
+  if (slot != -1) {
+    // the value is computed right into the local.
+    this->expr(*expr.value, slot);
+  } else {
+    slot = operand(*expr.value);
+    emit(encodeBx(ROP_SET_GLOBAL, slot, name(expr.name.lexeme_, kMaxConstants)));
+  }
+  if (dest != kDiscard && dest != slot) {
+    emit(encode(ROP_MOVE, dest, slot));
+  }
+}
+
+void RegisterCompiler::visit(Binary &expr) {
+  int dest = dest_;
+  int left = operand(*expr.left, expr.right.get());
+  int right = operand(*expr.right);
+  int result = target(dest);
+  switch (expr.op.type_) {
+    case TOKEN_PLUS:  emit(encode(ROP_ADD, result, left, right)); break;
+    case TOKEN_MINUS: emit(encode(ROP_SUBTRACT, result, left, right)); break;
+    case TOKEN_STAR:  emit(encode(ROP_MULTIPLY, result, left, right)); break;
+    case TOKEN_SLASH: emit(encode(ROP_DIVIDE, result, left, right)); break;
+    case TOKEN_EQUAL_EQUAL: emit(encode(ROP_EQUAL, result, left, right)); break;
+    case TOKEN_GREATER: emit(encode(ROP_GREATER, result, left, right)); break;
+    case TOKEN_LESS:    emit(encode(ROP_LESS, result, left, right)); break;
+    case TOKEN_BANG_EQUAL: {
+      emit(encode(ROP_EQUAL, result, left, right));
+      emit(encode(ROP_NOT, result, result));
+      break;
+    }
+    case TOKEN_GREATER_EQUAL: {
+      emit(encode(ROP_LESS, result, left, right));
+      emit(encode(ROP_NOT, result, result));
+      break;
+    }
+    case TOKEN_LESS_EQUAL: {
+      emit(encode(ROP_GREATER, result, left, right));
+      emit(encode(ROP_NOT, result, result));
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+void RegisterCompiler::visit(Call &expr) {
+  int dest = dest_;
+  if (expr.arguments.size() >= kMaxRegisters) {
+    error("too many arguments.");
+    return;
+  }
+  // the callee and the arguments are consecutive temporaries,
+  // the result replaces the callee.
+  int base = allocate();
+  this->expr(*expr.callee, base);
+  for (const auto& arg : expr.arguments) {
+    this->expr(*arg, allocate());
+  }
+  emit(encode(ROP_CALL, base, expr.arguments.size()));
+  if (dest != kDiscard) {
+    emit(encode(ROP_MOVE, dest, base));
+  }
+}
+
+void RegisterCompiler::visit(Get &expr) {
+  int dest = dest_;
+  int object = operand(*expr.object);
+  emit(encode(ROP_GET_PROPERTY, target(dest), object, name(expr.name.lexeme_, kMaxRegisters)));
+}
+
+void RegisterCompiler::visit(Grouping &expr) {
+  this->expr(*expr.expr, dest_);
+}
+
+void RegisterCompiler::visit(Set &expr) {
+  int dest = dest_;
+  int object = operand(*expr.object, expr.value.get());
+  int value = operand(*expr.value);
+  emit(encode(ROP_SET_PROPERTY, object, name(expr.name.lexeme_, kMaxRegisters), value));
+  if (dest != kDiscard && dest != value) {
+    emit(encode(ROP_MOVE, dest, value));
+  }
+}
+
+void RegisterCompiler::visit(Unary &expr) {
+  int dest = dest_;
+  int right = operand(*expr.right);
+  emit(encode(expr.op.type_ == TOKEN_BANG ? ROP_NOT : ROP_NEGATE, target(dest), right));
+}
+
+void RegisterCompiler::visit(Variable &expr) {
+  int dest = dest_;
+  int slot = resolveLocal(expr.name.lexeme_);
+  if (slot == -1) {
+    // still read when discarded, an undefined global is an error.
+    emit(encodeBx(ROP_GET_GLOBAL, target(dest), name(expr.name.lexeme_, kMaxConstants)));
+  } else if (dest == kDiscard) {
+    return;
+  } else if (slot != dest) {
+    emit(encode(ROP_MOVE, dest, slot));
+  }
+}
+
+// a && b => a ? b : a.
+// a || b => a ? a : b.
+void RegisterCompiler::visit(Logical &expr) {
+  int dest = dest_;
+  // the left value is stored before the right side runs,
+  // which may still read the local being assigned.
+  int result = dest == kDiscard || isLocalSlot(dest) ? allocate() : dest;
+  this->expr(*expr.left, result);
+  int jump = emitJump(expr.op.type_ == TOKEN_AND ? ROP_JUMP_IF_FALSE : ROP_JUMP_IF_TRUE, result);
+  this->expr(*expr.right, result);
+  fixJump(jump);
+  if (dest != kDiscard && dest != result) {
+    emit(encode(ROP_MOVE, dest, result));
+  }
+}
+
+void RegisterCompiler::visit(Number &expr) {
+  if (dest_ != kDiscard) {
+    emit(encodeBx(ROP_LOADK, dest_, constant(Value(expr.value), kMaxConstants)));
+  }
+}
+
+void RegisterCompiler::visit(String &expr) {
+  if (dest_ != kDiscard) {
+    Value value(std::in_place_type<std::string>, expr.str.data(), expr.str.size());
+    emit(encodeBx(ROP_LOADK, dest_, constant(value, kMaxConstants)));
+  }
+}
+
+void RegisterCompiler::visit(Literal &expr) {
+  if (dest_ == kDiscard) {
+    return;
+  }
+  switch (expr.literal) {
+    case TOKEN_NIL:   emit(encode(ROP_LOADNIL, dest_)); break;
+    case TOKEN_FALSE: emit(encode(ROP_LOADBOOL, dest_, 0)); break;
+    case TOKEN_TRUE:  emit(encode(ROP_LOADBOOL, dest_, 1)); break;
+    default:
+      assert(false);
+  }
+}
+
+void RegisterCompiler::visit(This &expr) {
+  if (dest_ != kDiscard && dest_ != 0) {
+    emit(encode(ROP_MOVE, dest_, 0));
+  }
+}
+
+void RegisterCompiler::visit(Array &expr) {
+  int dest = dest_;
+  if (expr.elements.size() >= kMaxRegisters) {
+    error("too many elements in an array literal.");
+    return;
+  }
+  // the elements are consecutive temporaries.
+  int base = freeSlot_;
+  for (const auto& element : expr.elements) {
+    this->expr(*element, allocate());
+  }
+  emit(encode(ROP_ARRAY, target(dest), base, expr.elements.size()));
+}
+
+void RegisterCompiler::visit(Map &expr) {
+  int dest = dest_;
+  if (expr.keys.size() * 2 >= kMaxRegisters) {
+    error("too many entries in a map literal.");
+    return;
+  }
+  // the keys and the values alternate in consecutive temporaries.
+  int base = freeSlot_;
+  for (size_t i = 0; i < expr.keys.size(); i++) {
+    this->expr(*expr.keys[i], allocate());
+    this->expr(*expr.values[i], allocate());
+  }
+  emit(encode(ROP_MAP, target(dest), base, expr.keys.size()));
+}
+
+void RegisterCompiler::visit(Index &expr) {
+  int dest = dest_;
+  int object = operand(*expr.object, expr.index.get());
+  int index = operand(*expr.index);
+  emit(encode(ROP_GET_INDEX, target(dest), object, index));
+}
+
+void RegisterCompiler::visit(IndexSet &expr) {
+  int dest = dest_;
+  // the index and the value may assign the object.
+  int object = operand(*expr.object, &expr);
+  int index = operand(*expr.index, expr.value.get());
+  int value = operand(*expr.value);
+  emit(encode(ROP_SET_INDEX, object, index, value));
+  if (dest != kDiscard && dest != value) {
+    emit(encode(ROP_MOVE, dest, value));
+  }
+}
+
+}
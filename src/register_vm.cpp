@@ -0,0 +1,266 @@
+#include <vm.h>
+#include <value.h>
+#include <object.h>
+#include <register_chunk.h>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <cassert>
+
+namespace alien {
+
+namespace {
+  void runtimeError(std::string_view message) {
+    std::cerr << message << '\n';
+  }
+} // namespace
+
+// the frame of a function is the registers of its chunk,
+// the callee's frame starts at the register of the callee.
+InterpretResult Vm::runRegister(size_t frames) {
+  auto* callFrame = &callFrames_.back();
+  stack_.resize(callFrame->stackStart + callFrame->function->registerChunk().registers());
+  // the registers and the code of the running frame,
+  // reloaded whenever the frame or the stack changes.
+  Value* r = &stack_[callFrame->stackStart];
+  uint32_t* code = callFrame->function->registerChunk().code().data();
+  Value* k = callFrame->function->registerChunk().constants().data();
+  auto reload = [&]() {
+    callFrame = &callFrames_.back();
+    auto& chunk = callFrame->function->registerChunk();
+    r = &stack_[callFrame->stackStart];
+    code = chunk.code().data();
+    k = chunk.constants().data();
+  };
+
+#define NUMBER_OP(op) \
+  do { \
+    auto b = std::get_if<double>(&r[argB(instruction)]); \
+    auto c = std::get_if<double>(&r[argC(instruction)]); \
+    if (!b || !c) { \
+      runtimeError("binary operator need its operands to be double."); \
+      return INTERPRET_RUNTIME_ERROR; \
+    } \
+    r[argA(instruction)] = Value(*b op *c); \
+  } while (false)
+
+  for (;;) {
+#ifdef TRACE_EXECUTION
+    for (int i = 0; i < callFrame->function->registerChunk().registers(); i++) {
+      std::cout << '[';
+      printValue(r[i]);
+      std::cout << ']';
+    }
+    std::cout << '\n';
+    callFrame->function->registerChunk().disassembleInstruction(callFrame->ip);
+#endif
+    uint32_t instruction = code[callFrame->ip++];
+    switch (opOf(instruction)) {
+      case ROP_MOVE: r[argA(instruction)] = r[argB(instruction)]; break;
+      case ROP_LOADK: r[argA(instruction)] = k[argBx(instruction)]; break;
+      case ROP_LOADNIL: r[argA(instruction)] = Value(); break;
+      case ROP_LOADBOOL: r[argA(instruction)] = Value(argB(instruction) != 0); break;
+      case ROP_PRINT: {
+        printValue(r[argA(instruction)]);
+        std::cout << '\n';
+        break;
+      }
+      case ROP_EQUAL: {
+        r[argA(instruction)] = Value(isEqual(r[argB(instruction)], r[argC(instruction)]));
+        break;
+      }
+      case ROP_GREATER:  NUMBER_OP(>); break;
+      case ROP_LESS:     NUMBER_OP(<); break;
+      case ROP_SUBTRACT: NUMBER_OP(-); break;
+      case ROP_MULTIPLY: NUMBER_OP(*); break;
+      case ROP_DIVIDE:   NUMBER_OP(/); break;
+      case ROP_ADD: {
+        auto& b = r[argB(instruction)];
+        auto& c = r[argC(instruction)];
+        if (std::holds_alternative<double>(b) && std::holds_alternative<double>(c)) {
+          r[argA(instruction)] = Value(std::get<double>(b) + std::get<double>(c));
+        } else if (std::holds_alternative<std::string>(b) &&
+                   std::holds_alternative<std::string>(c)) {
+          if (argA(instruction) == argB(instruction)) {
+            // `s = s + e` into a local, appended in place.
+            std::get<std::string>(b).append(std::get<std::string>(c));
+          } else {
+            r[argA(instruction)] = Value(std::get<std::string>(b) + std::get<std::string>(c));
+          }
+        } else {
+          // a slice is added as the text it views.
+          Value result;
+          if (!concatenate(b, c, result)) {
+            runtimeError("operator '+' needs two operands in the same type.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          r[argA(instruction)] = std::move(result);
+        }
+        break;
+      }
+      case ROP_NOT: r[argA(instruction)] = Value(isFalsy(r[argB(instruction)])); break;
+      case ROP_NEGATE: {
+        auto b = std::get_if<double>(&r[argB(instruction)]);
+        if (!b) {
+          runtimeError("need number after '-'.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        r[argA(instruction)] = Value(-*b);
+        break;
+      }
+      case ROP_CALL: {
+        collectGarbage();
+        int base = callFrame->stackStart + argA(instruction);
+        int argCount = argB(instruction);
+        // callValue finds the callee below the arguments at the top.
+        stack_.resize(base + argCount + 1);
+        size_t depth = callFrames_.size();
+        if (!callValue(stack_[base], argCount)) {
+          return INTERPRET_COMPILE_ERROR;
+        }
+        // a native calling back may have moved the frames.
+        callFrame = &callFrames_.back();
+        if (callFrames_.size() == depth) {
+          // a native or a class without an initializer, the result is in place.
+          stack_.resize(callFrame->stackStart + callFrame->function->registerChunk().registers());
+        } else {
+          auto& callee = callFrames_.back();
+          stack_.resize(callee.stackStart + callee.function->registerChunk().registers());
+        }
+        reload();
+        break;
+      }
+      case ROP_RETURN: {
+        Value result = r[argA(instruction)];
+        int start = callFrame->stackStart;
+        callFrames_.pop_back();
+        stack_[start] = std::move(result);
+        if (callFrames_.size() == frames) {
+          return INTERPRET_OK;
+        }
+        auto& caller = callFrames_.back();
+        stack_.resize(caller.stackStart + caller.function->registerChunk().registers());
+        reload();
+        break;
+      }
+      case ROP_GET_GLOBAL: {
+        auto& name = std::get<std::string>(k[argBx(instruction)]);
+        auto it = globals_.find(name);
+        if (it == globals_.end()) {
+          runtimeError("Undefined variable.");
+          if (name == "main") {
+            runtimeError("without main.");
+          }
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        r[argA(instruction)] = it->second;
+        break;
+      }
+      case ROP_SET_GLOBAL: {
+        auto& name = std::get<std::string>(k[argBx(instruction)]);
+        auto it = globals_.find(name);
+        if (it == globals_.end()) {
+          runtimeError("Undefined variable.");
+          runtimeError(name);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        it->second = r[argA(instruction)];
+        break;
+      }
+      case ROP_DEFINE_GLOBAL: {
+        globals_[std::get<std::string>(k[argBx(instruction)])] = r[argA(instruction)];
+        break;
+      }
+      case ROP_GET_PROPERTY: {
+        auto& object = r[argB(instruction)];
+        if (!std::holds_alternative<Obj*>(object) ||
+            AS_OBJ(object)->getType() != OBJ_INSTANCE) {
+          runtimeError("only objects have properties.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        auto& name = std::get<std::string>(k[argC(instruction)]);
+        auto instance = AS_OBJ(object)->asInstance();
+        if (instance->exists(name)) {
+          r[argA(instruction)] = instance->getField(name);
+          break;
+        }
+        auto method = instance->getClass()->findMethod(name);
+        if (!method) {
+          runtimeError("no such property.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        // the receiver is still in its register while collecting.
+        collectGarbage();
+        auto boundMethod = new ObjBoundMethod(method, instance);
+        addObj(boundMethod);
+        r[argA(instruction)] = boundMethod;
+        break;
+      }
+      case ROP_SET_PROPERTY: {
+        auto& object = r[argA(instruction)];
+        if (!std::holds_alternative<Obj*>(object) ||
+            AS_OBJ(object)->getType() != OBJ_INSTANCE) {
+          runtimeError("only objects can set properties.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        auto& name = std::get<std::string>(k[argB(instruction)]);
+        AS_OBJ(object)->asInstance()->setField(name, r[argC(instruction)]);
+        break;
+      }
+      case ROP_ARRAY: {
+        // the elements are still in their registers while collecting.
+        collectGarbage();
+        auto first = r + argB(instruction);
+        auto array = new ObjArray(std::vector<Value>(first, first + argC(instruction)));
+        addObj(array);
+        r[argA(instruction)] = array;
+        break;
+      }
+      case ROP_MAP: {
+        collectGarbage();
+        auto map = new ObjMap();
+        addObj(map);
+        auto first = r + argB(instruction);
+        for (int i = 0; i < argC(instruction) * 2; i += 2) {
+          if (!setIndex(map, first[i], first[i + 1])) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+        }
+        r[argA(instruction)] = map;
+        break;
+      }
+      case ROP_GET_INDEX: {
+        if (!getIndex(r[argB(instruction)], r[argC(instruction)], r[argA(instruction)])) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case ROP_SET_INDEX: {
+        if (!setIndex(r[argA(instruction)], r[argB(instruction)], r[argC(instruction)])) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        break;
+      }
+      case ROP_JUMP: callFrame->ip += argSBx(instruction); break;
+      case ROP_JUMP_IF_FALSE: {
+        if (isFalsy(r[argA(instruction)])) {
+          callFrame->ip += argSBx(instruction);
+        }
+        break;
+      }
+      case ROP_JUMP_IF_TRUE: {
+        if (!isFalsy(r[argA(instruction)])) {
+          callFrame->ip += argSBx(instruction);
+        }
+        break;
+      }
+      default:
+        assert(false);
+    }
+  }
+#undef NUMBER_OP
+}
+
+}
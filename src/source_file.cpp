@@ -0,0 +1,60 @@
+#include <source_file.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace alien {
+
+SourceFile::~SourceFile() {
+  if (mapped_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool SourceFile::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      // the lexer reads it once from the front to the back.
+      madvise(data, info.st_size, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(data);
+      size_ = info.st_size;
+      mapped_ = true;
+      close(fd);
+      return true;
+    }
+  }
+  // pipes, empty files and file systems without mmap.
+  bool ok = read(fd);
+  close(fd);
+  return ok;
+}
+
+bool SourceFile::read(int fd) {
+  char block[1 << 16];
+  for (;;) {
+    ssize_t n = ::read(fd, block, sizeof(block));
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    buffer_.append(block, n);
+  }
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+  return true;
+}
+
+}
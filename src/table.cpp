@@ -0,0 +1,191 @@
+#include <table.h>
+#include <object.h>
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace alien {
+
+namespace {
+  const size_t kGroup = 16;
+  const int8_t kEmpty = -128;
+  const int8_t kDeleted = -2;
+
+  // a bit for every slot of the group at `ctrl` whose byte is `byte`.
+  uint32_t matchByte(const int8_t* ctrl, int8_t byte) {
+#ifdef __SSE2__
+    auto group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroup; i++) {
+      mask |= static_cast<uint32_t>(ctrl[i] == byte) << i;
+    }
+    return mask;
+#endif
+  }
+
+  // empty and deleted are the bytes with the sign bit set.
+  uint32_t matchFree(const int8_t* ctrl) {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroup; i++) {
+      mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+    }
+    return mask;
+#endif
+  }
+
+  uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+  }
+
+  // eight bytes at a time.
+  uint64_t hashBytes(const char* bytes, size_t size) {
+    uint64_t hash = size * 0x9e3779b97f4a7c15ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+      uint64_t word;
+      std::memcpy(&word, bytes + i, 8);
+      hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+      hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    return mix(hash ^ tail);
+  }
+} // namespace
+
+uint64_t hashValue(const Value& value) {
+  if (auto number = std::get_if<double>(&value)) {
+    // 0 and -0 are equal.
+    double d = *number == 0 ? 0 : *number;
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    return mix(bits);
+  }
+  if (auto str = std::get_if<std::string>(&value)) {
+    return hashBytes(str->data(), str->size());
+  }
+  if (auto obj = std::get_if<Obj*>(&value)) {
+    // hashed like the string it equals.
+    if ((*obj)->getType() == OBJ_SLICE) {
+      auto view = (*obj)->asSlice()->view();
+      return hashBytes(view.data(), view.size());
+    }
+    return mix(reinterpret_cast<uintptr_t>(*obj));
+  }
+  if (auto b = std::get_if<bool>(&value)) {
+    return mix(*b ? 2 : 1);
+  }
+  return 0;
+}
+
+// the groups are probed in a triangular sequence, which visits every
+// group once when their number is a power of 2.
+size_t Table::findSlot(const Value& key, uint64_t hash) const {
+  if (slots_.empty()) {
+    return kNotFound;
+  }
+  size_t mask = slots_.size() / kGroup - 1;
+  size_t group = (hash >> 7) & mask;
+  auto byte = static_cast<int8_t>(hash & 0x7f);
+  for (size_t step = 1; ; step++) {
+    const int8_t* ctrl = &ctrl_[group * kGroup];
+    for (uint32_t match = matchByte(ctrl, byte); match; match &= match - 1) {
+      size_t i = group * kGroup + __builtin_ctz(match);
+      if (isEqual(slots_[i].key, key)) {
+        return i;
+      }
+    }
+    // the key would have been put in the first empty slot.
+    if (matchByte(ctrl, kEmpty)) {
+      return kNotFound;
+    }
+    group = (group + step) & mask;
+  }
+}
+
+size_t Table::freeSlot(uint64_t hash) const {
+  size_t mask = slots_.size() / kGroup - 1;
+  size_t group = (hash >> 7) & mask;
+  for (size_t step = 1; ; step++) {
+    if (uint32_t match = matchFree(&ctrl_[group * kGroup])) {
+      return group * kGroup + __builtin_ctz(match);
+    }
+    group = (group + step) & mask;
+  }
+}
+
+Value* Table::find(const Value& key) {
+  size_t i = findSlot(key, hashValue(key));
+  return i == kNotFound ? nullptr : &slots_[i].value;
+}
+
+void Table::set(const Value& key, const Value& value) {
+  uint64_t hash = hashValue(key);
+  size_t i = findSlot(key, hash);
+  if (i != kNotFound) {
+    slots_[i].value = value;
+    return;
+  }
+  // at most 7/8 of the slots are used, so that a probe finds an empty one.
+  if ((size_ + deleted_ + 1) * 8 > slots_.size() * 7) {
+    size_t capacity = kGroup;
+    while ((size_ + 1) * 2 > capacity) {
+      capacity *= 2;
+    }
+    rehash(capacity);
+  }
+  i = freeSlot(hash);
+  if (ctrl_[i] == kDeleted) {
+    deleted_--;
+  }
+  ctrl_[i] = static_cast<int8_t>(hash & 0x7f);
+  slots_[i].key = key;
+  slots_[i].value = value;
+  size_++;
+}
+
+bool Table::erase(const Value& key) {
+  size_t i = findSlot(key, hashValue(key));
+  if (i == kNotFound) {
+    return false;
+  }
+  // the slot may be on the probe sequence of another key.
+  ctrl_[i] = kDeleted;
+  slots_[i] = Entry();
+  size_--;
+  deleted_++;
+  return true;
+}
+
+void Table::rehash(size_t capacity) {
+  auto ctrl = std::move(ctrl_);
+  auto slots = std::move(slots_);
+  ctrl_.assign(capacity, kEmpty);
+  slots_.clear();
+  slots_.resize(capacity);
+  deleted_ = 0;
+  for (size_t i = 0; i < slots.size(); i++) {
+    if (ctrl[i] < 0) {
+      continue;
+    }
+    uint64_t hash = hashValue(slots[i].key);
+    size_t j = freeSlot(hash);
+    ctrl_[j] = static_cast<int8_t>(hash & 0x7f);
+    slots_[j] = std::move(slots[i]);
+  }
+}
+
+}
@@ -20,9 +20,12 @@ std::string_view typeString(const TokenType type) {
     case TOKEN_RIGHT_PAREN:   return ")";
     case TOKEN_LEFT_BRACE:    return "{";
     case TOKEN_RIGHT_BRACE:   return "}";
+    case TOKEN_LEFT_BRACKET:  return "[";
+    case TOKEN_RIGHT_BRACKET: return "]";
     case TOKEN_COMMA:         return ",";
     case TOKEN_SEMICOLON:     return ";";
     case TOKEN_DOT:           return ".";
+    case TOKEN_COLON:         return ":";
     case TOKEN_BANG:          return "!";
     case TOKEN_EQUAL:         return "=";
     case TOKEN_EQUAL_EQUAL:   return "==";
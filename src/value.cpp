@@ -45,7 +45,19 @@ bool isFalsy(const Value& value) {
   return std::visit(FalsinessVisitor(), value);
 }
 
+namespace {
+  bool isSlice(const Value& value) {
+    auto obj = std::get_if<Obj*>(&value);
+    return obj && (*obj)->getType() == OBJ_SLICE;
+  }
+} // namespace
+
 bool isEqual(const Value& lhs, const Value& rhs) {
+  // a slice equals a string or a slice of the same text.
+  if (isSlice(lhs) || isSlice(rhs)) {
+    std::string_view a, b;
+    return stringView(lhs, a) && stringView(rhs, b) && a == b;
+  }
   return lhs == rhs;
 }
 
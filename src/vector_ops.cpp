@@ -0,0 +1,247 @@
+#include <vector_ops.h>
+
+#include <algorithm>
+
+// the avx2 versions are compiled for avx2 on their own, the rest of the
+// program doesn't need it, and chosen when the cpu supports it.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ALIEN_AVX2
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace alien {
+
+namespace {
+  bool hasAvx2() {
+#ifdef ALIEN_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+  }
+
+#ifdef ALIEN_AVX2
+  AVX2_TARGET void addAvx2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    for (; i < size; i++) {
+      out[i] = a[i] + b[i];
+    }
+  }
+
+  AVX2_TARGET void multiplyAvx2(const double* a, const double* b, double* out, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    for (; i < size; i++) {
+      out[i] = a[i] * b[i];
+    }
+  }
+
+  AVX2_TARGET void scaleAvx2(const double* a, double k, double* out, size_t size) {
+    auto factor = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), factor));
+    }
+    for (; i < size; i++) {
+      out[i] = a[i] * k;
+    }
+  }
+
+  AVX2_TARGET double horizontalSum(__m256d v) {
+    double lanes[4];
+    _mm256_storeu_pd(lanes, v);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  }
+
+  // four accumulators, so that the additions don't wait for each other.
+  AVX2_TARGET double sumAvx2(const double* a, size_t size) {
+    auto s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+      s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+      s2 = _mm256_add_pd(s2, _mm256_loadu_pd(a + i + 8));
+      s3 = _mm256_add_pd(s3, _mm256_loadu_pd(a + i + 12));
+    }
+    for (; i + 4 <= size; i += 4) {
+      s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+    }
+    double sum = horizontalSum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    for (; i < size; i++) {
+      sum += a[i];
+    }
+    return sum;
+  }
+
+  AVX2_TARGET double dotAvx2(const double* a, const double* b, size_t size) {
+    auto s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+      s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+      s2 = _mm256_add_pd(s2, _mm256_mul_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8)));
+      s3 = _mm256_add_pd(s3, _mm256_mul_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12)));
+    }
+    for (; i + 4 <= size; i += 4) {
+      s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    double sum = horizontalSum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    for (; i < size; i++) {
+      sum += a[i] * b[i];
+    }
+    return sum;
+  }
+
+  AVX2_TARGET double minAvx2(const double* a, size_t size) {
+    auto m = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      m = _mm256_min_pd(m, _mm256_loadu_pd(a + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double result = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    for (; i < size; i++) {
+      result = std::min(result, a[i]);
+    }
+    return result;
+  }
+
+  AVX2_TARGET double maxAvx2(const double* a, size_t size) {
+    auto m = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      m = _mm256_max_pd(m, _mm256_loadu_pd(a + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    for (; i < size; i++) {
+      result = std::max(result, a[i]);
+    }
+    return result;
+  }
+
+  // a scan of the four lanes by two shifted additions, then the
+  // total of the blocks before is added to all of them.
+  AVX2_TARGET void prefixSumAvx2(const double* a, double* out, size_t size) {
+    auto zero = _mm256_setzero_pd();
+    auto carry = zero;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+      auto x = _mm256_loadu_pd(a + i);
+      // [0, x0, x1, x2]
+      x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, 0x90), zero, 0x1));
+      // [0, 0, x0, x1]
+      x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, 0x40), zero, 0x3));
+      x = _mm256_add_pd(x, carry);
+      _mm256_storeu_pd(out + i, x);
+      carry = _mm256_permute4x64_pd(x, 0xff);
+    }
+    double sum = i > 0 ? out[i - 1] : 0;
+    for (; i < size; i++) {
+      sum += a[i];
+      out[i] = sum;
+    }
+  }
+#endif
+} // namespace
+
+void addVectors(const double* a, const double* b, double* out, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return addAvx2(a, b, out, size);
+  }
+#endif
+  for (size_t i = 0; i < size; i++) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+void multiplyVectors(const double* a, const double* b, double* out, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return multiplyAvx2(a, b, out, size);
+  }
+#endif
+  for (size_t i = 0; i < size; i++) {
+    out[i] = a[i] * b[i];
+  }
+}
+
+void scaleVector(const double* a, double k, double* out, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return scaleAvx2(a, k, out, size);
+  }
+#endif
+  for (size_t i = 0; i < size; i++) {
+    out[i] = a[i] * k;
+  }
+}
+
+double sumVector(const double* a, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return sumAvx2(a, size);
+  }
+#endif
+  double sum = 0;
+  for (size_t i = 0; i < size; i++) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+double dotVectors(const double* a, const double* b, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return dotAvx2(a, b, size);
+  }
+#endif
+  double sum = 0;
+  for (size_t i = 0; i < size; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+double minVector(const double* a, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return minAvx2(a, size);
+  }
+#endif
+  return *std::min_element(a, a + size);
+}
+
+double maxVector(const double* a, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return maxAvx2(a, size);
+  }
+#endif
+  return *std::max_element(a, a + size);
+}
+
+void prefixSum(const double* a, double* out, size_t size) {
+#ifdef ALIEN_AVX2
+  if (hasAvx2()) {
+    return prefixSumAvx2(a, out, size);
+  }
+#endif
+  double sum = 0;
+  for (size_t i = 0; i < size; i++) {
+    sum += a[i];
+    out[i] = sum;
+  }
+}
+
+}
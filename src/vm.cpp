@@ -7,11 +7,16 @@
 #include <chunk.h>
 #include <parser.h>
 #include <compiler.h>
+#include <register_compiler.h>
+#include <bytecode_cache.h>
+#include <native.h>
 #include <vm.h>
 #include <common.h>
 
+#include <algorithm>
 #include <iostream>
 #include <string_view>
+#include <cmath>
 #include <cstdint>
 #include <cassert>
 
@@ -21,6 +26,18 @@ namespace {
   void runtimeError(std::string_view message) {
     std::cerr << message << '\n';
   }
+
+  bool forCompare(double i, double limit, uint8_t compare) {
+    switch (compare) {
+      case FOR_LESS:          return i < limit;
+      case FOR_LESS_EQUAL:    return i <= limit;
+      case FOR_GREATER:       return i > limit;
+      case FOR_GREATER_EQUAL: return i >= limit;
+      default:
+        assert(false);
+    }
+    return false;
+  }
 } // namespace
 
 void Vm::push(const Value &value) {
@@ -71,6 +88,22 @@ bool Vm::callValue(const Value &callee, int argCount) {
         stack_[stack_.size() - argCount - 1] = boundMethod->receiver_;
         return call(boundMethod->method_, argCount);
       }
+      case OBJ_NATIVE: {
+        auto native = obj->asNative();
+        if (native->arity() >= 0 && native->arity() != argCount) {
+          runtimeError("the number of arguments and parameters is different.");
+          return false;
+        }
+        // the result replaces the callee, like a return.
+        size_t start = stack_.size() - argCount - 1;
+        Value result;
+        if (!native->function()(*this, NativeArgs(stack_, start + 1, argCount), result)) {
+          return false;
+        }
+        stack_[start] = std::move(result);
+        stack_.resize(start + 1);
+        return true;
+      }
       default:
         runtimeError("can only call functions and classes.");
     }
@@ -83,12 +116,101 @@ bool Vm::call(ObjFunction* callee, int argCount) {
     runtimeError("the number of arguments and parameters is different.");
     return false;
   }
+  if (!callee->isCompiled() && !compileFunction(callee)) {
+    return false;
+  }
   CallFrame callFrame(callee, stack_.size() - argCount - 1);
   callFrame.ip = 0;
   callFrames_.push_back(callFrame);
   return true;
 }
 
+bool Vm::compileFunction(ObjFunction *function) {
+  // a stub left by `interpret`, whose compiler and ast are gone.
+  if (!compiler_) {
+    runtimeError("the function was never compiled, use compile() to call it later.");
+    return false;
+  }
+  return compiler_->compileLazily(function);
+}
+
+namespace {
+  // the element `elements[index]`, nullptr after reporting a runtime error.
+  template <typename T>
+  T* element(std::vector<T>& elements, const Value& index) {
+    auto i = std::get_if<double>(&index);
+    if (!i || !(*i >= 0) || *i != std::trunc(*i)) {
+      runtimeError("an index must be a non-negative integer.");
+      return nullptr;
+    }
+    if (*i >= elements.size()) {
+      runtimeError("index out of range.");
+      return nullptr;
+    }
+    return &elements[static_cast<size_t>(*i)];
+  }
+} // namespace
+
+bool Vm::getIndex(const Value& object, const Value& index, Value& result) {
+  auto obj = std::get_if<Obj*>(&object);
+  if (obj && (*obj)->getType() == OBJ_ARRAY) {
+    auto value = element((*obj)->asArray()->elements(), index);
+    if (value) {
+      result = *value;
+    }
+    return value != nullptr;
+  }
+  if (obj && (*obj)->getType() == OBJ_FLOAT64_ARRAY) {
+    auto value = element((*obj)->asFloat64Array()->elements(), index);
+    if (value) {
+      result = *value;
+    }
+    return value != nullptr;
+  }
+  if (obj && (*obj)->getType() == OBJ_MAP) {
+    auto value = (*obj)->asMap()->table().find(index);
+    result = value ? *value : Value();
+    return true;
+  }
+  runtimeError("only arrays and maps can be indexed.");
+  return false;
+}
+
+bool Vm::setIndex(const Value& object, const Value& index, const Value& value) {
+  auto obj = std::get_if<Obj*>(&object);
+  if (obj && (*obj)->getType() == OBJ_ARRAY) {
+    auto target = element((*obj)->asArray()->elements(), index);
+    if (target) {
+      *target = value;
+    }
+    return target != nullptr;
+  }
+  if (obj && (*obj)->getType() == OBJ_FLOAT64_ARRAY) {
+    auto number = std::get_if<double>(&value);
+    if (!number) {
+      runtimeError("a float64 array only holds numbers.");
+      return false;
+    }
+    auto target = element((*obj)->asFloat64Array()->elements(), index);
+    if (target) {
+      *target = *number;
+    }
+    return target != nullptr;
+  }
+  if (obj && (*obj)->getType() == OBJ_MAP) {
+    // it could never be found again.
+    auto number = std::get_if<double>(&index);
+    if (number && std::isnan(*number)) {
+      runtimeError("a key can't be NaN.");
+      return false;
+    }
+    (*obj)->asMap()->table().set(index, value);
+    return true;
+  }
+  runtimeError("only arrays and maps can be indexed.");
+  return false;
+}
+
 bool Vm::bindMethod(ObjClass *klass, const std::string &name) {
   auto method = klass->findMethod(name);
   if (!method) {
@@ -103,15 +225,45 @@ bool Vm::bindMethod(ObjClass *klass, const std::string &name) {
 }
 
 InterpretResult Vm::interpret(std::string_view source) {
-  Parser parser(source);
+  // the register machine and the dumps always compile.
+  bool compiles = options_.registers || options_.dumpIr || options_.dumpTypes;
+  bool snapshot = !options_.snapshotFile.empty() && !compiles;
+  // a snapshot holds the compiled functions as well.
+  bool cache = !options_.cacheFile.empty() && !compiles && !snapshot;
+  if (snapshot) {
+    image_ = std::make_unique<CacheImage>();
+    if (readSnapshot(options_.snapshotFile, source, cacheFlags(options_), *this, *image_, globals_)) {
+      return runMain();
+    }
+  } else if (cache) {
+    image_ = std::make_unique<CacheImage>();
+    if (auto script = readCache(options_.cacheFile, source, cacheFlags(options_), *this, *image_)) {
+      push(script);
+      call(script, 0);
+      return run();
+    }
+  }
+  // -O analyses every body before anything runs.
+  Parser parser(source, options_.lazyParse && !options_.optimize);
   auto program = parser.parse();
 //  for (const auto& stmt : program) {
 //    stmt->trace(std::cout)callFrame.function->chunk().code()[callFrame.ip++]
   if (parser.hadError()) {
     return INTERPRET_PARSE_ERROR;
   }
+  if (options_.registers) {
+    RegisterCompiler compiler(*this);
+    ObjFunction* script = compiler.compile(program);
+    addObj(script);
+    if (compiler.hadError()) {
+      return INTERPRET_COMPILE_ERROR;
+    }
+    push(script);
+    call(script, 0);
+    return runRegister();
+  }
   Compiler compiler(*this);
-  ObjFunction* script = compiler.compile(program);
+  ObjFunction* script = compiler.compile(program, !snapshot);
   // don't forget this, or some objected will be mistakenly reclaimed .
   // after the first garbage collection, the object's flag will not be flipped.
   // then some objects in the global chunk will be reclaimed.
@@ -119,32 +271,165 @@ InterpretResult Vm::interpret(std::string_view source) {
   if (compiler.hadError()) {
     return INTERPRET_COMPILE_ERROR;
   }
+  // before it runs, the quickened instructions are rewritten in place.
+  if (cache && !writeCache(options_.cacheFile, source, cacheFlags(options_), script)) {
+    std::cerr << "Couldn't write the cache " << options_.cacheFile << '\n';
+  }
   push(script);
   call(script, 0);
-  return run();
+  compiler_ = &compiler;
+  auto result = run();
+  if (snapshot && result == INTERPRET_OK) {
+    if (!writeSnapshot(options_.snapshotFile, source, cacheFlags(options_), globals_)) {
+      std::cerr << "Couldn't write the snapshot " << options_.snapshotFile << '\n';
+    }
+    result = runMain();
+  }
+  compiler_ = nullptr;
+  return result;
+}
+
+ObjFunction* Vm::compile(std::string_view source) {
+  Parser parser(source, options_.lazyParse && !options_.optimize);
+  auto program = parser.parse();
+  if (parser.hadError()) {
+    return nullptr;
+  }
+  Compiler compiler(*this);
+  compiler.setLazy(false);
+  compiler.setOpen(true);
+  ObjFunction* script = compiler.compile(program, false);
+  addObj(script);
+  if (compiler.hadError()) {
+    return nullptr;
+  }
+  scripts_.push_back(script);
+  return script;
+}
+
+InterpretResult Vm::execute(ObjFunction* script) {
+  Value result;
+  return call(script, {}, result);
+}
+
+bool Vm::getGlobal(const std::string& name, Value& value) const {
+  auto it = globals_.find(name);
+  if (it == globals_.end()) {
+    return false;
+  }
+  value = it->second;
+  return true;
+}
+
+void Vm::setGlobal(const std::string& name, const Value& value) {
+  globals_[name] = value;
+}
+
+InterpretResult Vm::call(const Value& callee, const std::vector<Value>& args, Value& result) {
+  // a native may call back, its caller's frames stay below.
+  size_t frames = callFrames_.size();
+  size_t base = stack_.size();
+  push(callee);
+  for (const auto& arg : args) {
+    push(arg);
+  }
+  auto status = INTERPRET_RUNTIME_ERROR;
+  if (callValue(callee, args.size())) {
+    // a class without an initializer has no frame to run.
+    if (callFrames_.size() == frames) {
+      status = INTERPRET_OK;
+    } else if (callFrames_.back().function->registerChunk().code().empty()) {
+      status = run(frames);
+    } else {
+      status = runRegister(frames);
+    }
+  }
+  if (status == INTERPRET_OK) {
+    result = stack_[base];
+  }
+  // a runtime error leaves the frames of the call behind.
+  callFrames_.erase(callFrames_.begin() + frames, callFrames_.end());
+  stack_.resize(base);
+  return status;
+}
+
+void Vm::defineNative(const std::string& name, NativeFn function, int arity) {
+  auto native = new ObjNative(name, function, arity);
+  addObj(native);
+  natives_[name] = native;
+  globals_[name] = native;
 }
 
-InterpretResult Vm::run() {
+ObjNative* Vm::native(const std::string& name) const {
+  auto it = natives_.find(name);
+  return it == natives_.end() ? nullptr : it->second;
+}
+
+InterpretResult Vm::runMain() {
+  auto main = globals_.find("main");
+  if (main == globals_.end()) {
+    runtimeError("Undefined variable.");
+    runtimeError("without main.");
+    return INTERPRET_RUNTIME_ERROR;
+  }
+  // the result of the top-level code.
+  stack_.clear();
+  push(main->second);
+  if (!callValue(main->second, 0)) {
+    return INTERPRET_RUNTIME_ERROR;
+  }
+  // `main` may be a class without an initializer.
+  return callFrames_.empty() ? INTERPRET_OK : run();
+}
+
+InterpretResult Vm::run(size_t frames) {
   for (;;) {
     collectGarbage();
     auto& callFrame = callFrames_.back();
     auto& chunk = callFrame.function->chunk();
 
 #define READ_BYTE() \
-  chunk.code()[callFrame.ip++]
+  chunk.instructions()[callFrame.ip++]
 #define READ_CONSTANT() \
   chunk.getConstant(READ_BYTE())
-#define BINARY_OP(op) \
+#define BINARY_OP(op, quick) \
   do {  \
     if (!std::holds_alternative<double>(peek(0)) || \
         !std::holds_alternative<double>(peek(1))) { \
       runtimeError("binary operator need its operands to be double."); \
       return INTERPRET_RUNTIME_ERROR; \
     } \
+    QUICKEN(quick); \
     double b = std::get<double>(pop()); \
     double a = std::get<double>(pop()); \
     push(Value(a op b)); \
   } while (false);
+// rewrite the instruction being executed, it's specialised next time.
+#define QUICKEN(op) \
+  chunk.rewrite(callFrame.ip - 1, op)
+// the guard failed, restore the generic instruction and execute it again.
+#define DEQUICKEN(op) \
+  chunk.rewrite(--callFrame.ip, op)
+// operates on the operands in place, without copying them out of the stack.
+#define NUMBER_OP(op, generic) \
+  do { \
+    auto b = std::get_if<double>(&stack_[stack_.size() - 1]); \
+    auto a = std::get_if<double>(&stack_[stack_.size() - 2]); \
+    if (!a || !b) { \
+      DEQUICKEN(generic); \
+      break; \
+    } \
+    stack_[stack_.size() - 2] = Value(*a op *b); \
+    stack_.pop_back(); \
+  } while (false);
+// the operands are known to be numbers.
+#define DOUBLE_OP(op) \
+  do { \
+    double b = *std::get_if<double>(&stack_[stack_.size() - 1]); \
+    double a = *std::get_if<double>(&stack_[stack_.size() - 2]); \
+    stack_[stack_.size() - 2] = Value(a op b); \
+    stack_.pop_back(); \
+  } while (false);
 
 #ifdef TRACE_EXECUTION
   for (const auto& value : stack_) {
@@ -211,28 +496,96 @@ InterpretResult Vm::run() {
         }
         break;
       }
+      case OP_FOR_PREP: {
+        uint8_t slot = READ_BYTE();
+        uint8_t compare = READ_BYTE();
+        uint8_t offset = READ_BYTE();
+        // the counter and the limit are adjacent locals.
+        Value* counter = &stack_[callFrame.stackStart + slot];
+        if (!std::holds_alternative<double>(counter[0]) ||
+            !std::holds_alternative<double>(counter[1])) {
+          runtimeError("binary operator need its operands to be double.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        if (!forCompare(std::get<double>(counter[0]),
+                        std::get<double>(counter[1]), compare)) {
+          callFrame.ip += offset;
+        }
+        break;
+      }
+      case OP_FOR_LOOP: {
+        uint8_t slot = READ_BYTE();
+        uint8_t compare = READ_BYTE();
+        double step = std::get<double>(READ_CONSTANT());
+        uint8_t offset = READ_BYTE();
+        // the body can't assign the counter, it is still a number.
+        Value* counter = &stack_[callFrame.stackStart + slot];
+        double& i = *std::get_if<double>(&counter[0]);
+        i += step;
+        if (forCompare(i, std::get<double>(counter[1]), compare)) {
+          callFrame.ip -= offset;
+        }
+        break;
+      }
       case OP_ADD: {
         if (std::holds_alternative<double>(peek(0)) &&
             std::holds_alternative<double>(peek(1))) {
+          QUICKEN(OP_ADD_NUM);
           double b = std::get<double>(pop());
           double a = std::get<double>(pop());
           push(Value(a + b));
         } else if (std::holds_alternative<std::string>(peek(0)) &&
                    std::holds_alternative<std::string>(peek(1))) {
+          QUICKEN(OP_ADD_STR);
           auto r = std::get<std::string>(pop());
           auto l = std::get<std::string>(pop());
           push(Value(l + r));
         } else {
-          runtimeError("operator '+' needs two operands in the same type.");
-          return INTERPRET_RUNTIME_ERROR;
+          // a slice is added as the text it views.
+          Value result;
+          if (!concatenate(peek(1), peek(0), result)) {
+            runtimeError("operator '+' needs two operands in the same type.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          pop();
+          pop();
+          push(result);
+        }
+        break;
+      }
+      case OP_SUBTRACT: BINARY_OP(-, OP_SUBTRACT_NUM); break;
+      case OP_MULTIPLY: BINARY_OP(*, OP_MULTIPLY_NUM); break;
+      case OP_DIVIDE:   BINARY_OP(/, OP_DIVIDE_NUM); break;
+      case OP_GREATER:  BINARY_OP(>, OP_GREATER_NUM); break;
+      case OP_LESS:     BINARY_OP(<, OP_LESS_NUM); break;
+      case OP_ADD_NUM:      NUMBER_OP(+, OP_ADD); break;
+      case OP_SUBTRACT_NUM: NUMBER_OP(-, OP_SUBTRACT); break;
+      case OP_MULTIPLY_NUM: NUMBER_OP(*, OP_MULTIPLY); break;
+      case OP_DIVIDE_NUM:   NUMBER_OP(/, OP_DIVIDE); break;
+      case OP_GREATER_NUM:  NUMBER_OP(>, OP_GREATER); break;
+      case OP_LESS_NUM:     NUMBER_OP(<, OP_LESS); break;
+      case OP_ADD_DOUBLE:      DOUBLE_OP(+); break;
+      case OP_SUBTRACT_DOUBLE: DOUBLE_OP(-); break;
+      case OP_MULTIPLY_DOUBLE: DOUBLE_OP(*); break;
+      case OP_DIVIDE_DOUBLE:   DOUBLE_OP(/); break;
+      case OP_GREATER_DOUBLE:  DOUBLE_OP(>); break;
+      case OP_LESS_DOUBLE:     DOUBLE_OP(<); break;
+      case OP_NEGATE_DOUBLE: {
+        auto& value = stack_.back();
+        value = Value(-*std::get_if<double>(&value));
+        break;
+      }
+      case OP_ADD_STR: {
+        auto r = std::get_if<std::string>(&stack_[stack_.size() - 1]);
+        auto l = std::get_if<std::string>(&stack_[stack_.size() - 2]);
+        if (!l || !r) {
+          DEQUICKEN(OP_ADD);
+          break;
         }
+        l->append(*r);
+        stack_.pop_back();
         break;
       }
-      case OP_SUBTRACT: BINARY_OP(-); break;
-      case OP_MULTIPLY: BINARY_OP(*); break;
-      case OP_DIVIDE:   BINARY_OP(/); break;
-      case OP_GREATER:  BINARY_OP(>); break;
-      case OP_LESS:     BINARY_OP(<); break;
       case OP_EQUAL: {
         auto b = pop();
         auto a = pop();
@@ -247,12 +600,43 @@ InterpretResult Vm::run() {
         }
         break;
       }
+      case OP_TAIL_CALL: {
+        uint8_t argCount = READ_BYTE();
+        Value callee = peek(argCount);
+        ObjFunction* function = nullptr;
+        if (std::holds_alternative<Obj*>(callee)) {
+          auto obj = AS_OBJ(callee);
+          if (obj->getType() == OBJ_FUNCTION) {
+            function = obj->asFunction();
+          } else if (obj->getType() == OBJ_BOUND_METHOD) {
+            function = obj->asBoundMethod()->method_;
+            stack_[stack_.size() - argCount - 1] = obj->asBoundMethod()->receiver_;
+          }
+        }
+        // classes and errors take the usual way, OP_RETURN follows.
+        if (!function || function->arity() != argCount) {
+          if (!callValue(callee, argCount)) {
+            return INTERPRET_COMPILE_ERROR;
+          }
+          break;
+        }
+        if (!function->isCompiled() && !compileFunction(function)) {
+          return INTERPRET_COMPILE_ERROR;
+        }
+        // the callee and the arguments replace the frame of the caller.
+        int start = callFrame.stackStart;
+        std::move(stack_.end() - argCount - 1, stack_.end(), stack_.begin() + start);
+        stack_.resize(start + argCount + 1);
+        callFrame.function = function;
+        callFrame.ip = 0;
+        break;
+      }
       case OP_RETURN: {
         auto result = pop();
         stack_.resize(callFrame.stackStart);
         push(result);
         callFrames_.pop_back();
-        if (callFrames_.empty()) {
+        if (callFrames_.size() == frames) {
           return INTERPRET_OK;
         }
         break;
@@ -270,6 +654,32 @@ InterpretResult Vm::run() {
         stack_[callFrame.stackStart + index] = peek(0);
         break;
       }
+      case OP_APPEND_LOCAL: {
+        uint8_t index = READ_BYTE();
+        auto& local = stack_[callFrame.stackStart + index];
+        auto& value = stack_.back();
+        if (std::holds_alternative<std::string>(local) &&
+            std::holds_alternative<std::string>(value)) {
+          // amortised by the capacity of the string, not a copy of it.
+          std::get<std::string>(local).append(std::get<std::string>(value));
+        } else if (std::holds_alternative<double>(local) &&
+                   std::holds_alternative<double>(value)) {
+          std::get<double>(local) += std::get<double>(value);
+        } else {
+          std::string_view view;
+          Value result;
+          if (std::holds_alternative<std::string>(local) && stringView(value, view)) {
+            std::get<std::string>(local).append(view);
+          } else if (concatenate(local, value, result)) {
+            local = std::move(result);
+          } else {
+            runtimeError("operator '+' needs two operands in the same type.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+        }
+        stack_.pop_back();
+        break;
+      }
       case OP_GET_GLOBAL: {
         std::string name = std::get<std::string>(READ_CONSTANT());
         if (globals_.find(name) == globals_.end()) {
@@ -324,6 +734,47 @@ InterpretResult Vm::run() {
         push(value);
         break;
       }
+      case OP_ARRAY: {
+        uint8_t count = READ_BYTE();
+        // the elements stay on the stack until the array is created.
+        auto array = new ObjArray(std::vector<Value>(stack_.end() - count, stack_.end()));
+        addObj(array);
+        stack_.resize(stack_.size() - count);
+        push(array);
+        break;
+      }
+      case OP_MAP: {
+        uint8_t count = READ_BYTE();
+        auto map = new ObjMap();
+        addObj(map);
+        // the keys and the values alternate.
+        for (size_t i = stack_.size() - count * 2; i < stack_.size(); i += 2) {
+          if (!setIndex(map, stack_[i], stack_[i + 1])) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+        }
+        stack_.resize(stack_.size() - count * 2);
+        push(map);
+        break;
+      }
+      case OP_GET_INDEX: {
+        Value value;
+        if (!getIndex(stack_[stack_.size() - 2], stack_.back(), value)) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        stack_[stack_.size() - 2] = std::move(value);
+        stack_.pop_back();
+        break;
+      }
+      case OP_SET_INDEX: {
+        if (!setIndex(stack_[stack_.size() - 3], stack_[stack_.size() - 2], stack_.back())) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        // leaves the value, like an assignment.
+        stack_[stack_.size() - 3] = std::move(stack_.back());
+        stack_.resize(stack_.size() - 2);
+        break;
+      }
       case OP_DEFINE_GLOBAL: {
         auto name = std::get<std::string>(READ_CONSTANT());
         globals_[name] = peek(0);
@@ -336,6 +787,10 @@ InterpretResult Vm::run() {
 #undef READ_BYTE
 #undef READ_CONSTANT
 #undef BINARY_OP
+#undef QUICKEN
+#undef DEQUICKEN
+#undef NUMBER_OP
+#undef DOUBLE_OP
   }
 }
 
@@ -382,6 +837,26 @@ void Vm::sweep() {
       std::cout << "bound method\n";
       break;
     }
+    case OBJ_NATIVE: {
+      std::cout << "native\n";
+      break;
+    }
+    case OBJ_ARRAY: {
+      std::cout << "array\n";
+      break;
+    }
+    case OBJ_MAP: {
+      std::cout << "map\n";
+      break;
+    }
+    case OBJ_FLOAT64_ARRAY: {
+      std::cout << "float64 array\n";
+      break;
+    }
+    case OBJ_SLICE: {
+      std::cout << "slice\n";
+      break;
+    }
   }
 #endif
       delete *it;
@@ -401,6 +876,12 @@ void Vm::markRoots() {
       AS_OBJ(value)->mark();
     }
   }
+  for (auto script : scripts_) {
+    script->mark();
+  }
+  for (const auto& item : natives_) {
+    item.second->mark();
+  }
   // we should mark the frames cause
   // the first slot of the callee
   // in the stack may be replaced with an instance
@@ -409,6 +890,14 @@ void Vm::markRoots() {
   }
 }
 
+Vm::Vm() {
+  defineBuiltins(*this);
+}
+
+Vm::Vm(const Options& options) : options_(options) {
+  defineBuiltins(*this);
+}
+
 Vm::~Vm() {
   for (const auto& obj : objs_) {
     delete obj;
@@ -0,0 +1,186 @@
+// checks the embedding api: compile, execute, call, getGlobal and setGlobal.
+// usage: embedtest, it prints the failed checks and exits with 1 on any.
+#include <vm.h>
+
+#include <iostream>
+#include <string>
+
+using namespace alien;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+  if (!ok) {
+    std::cout << "FAILED: " << what << '\n';
+    failures++;
+  }
+}
+
+bool isNumber(const Value& value, double expected) {
+  auto number = std::get_if<double>(&value);
+  return number && *number == expected;
+}
+
+const char* kScript = R"(
+var calls = 0;
+
+func add(a, b) {
+    return a * b + 1;
+}
+
+func bump() {
+    calls = calls + 1;
+    return calls;
+}
+
+func g() {
+    return 1;
+}
+
+func h() {
+    return 2;
+}
+
+func main() {
+    print add(2, 3);
+    return g() + 10;
+}
+)";
+
+void testCall(const Options& options) {
+  Vm vm(options);
+  auto script = vm.compile(kScript);
+  check(script != nullptr, "compile");
+  if (!script) {
+    return;
+  }
+  check(vm.execute(script) == INTERPRET_OK, "execute");
+  Value add, result;
+  check(vm.getGlobal("add", add), "getGlobal of a function");
+  check(vm.call(add, {Value(4.0), Value(5.0)}, result) == INTERPRET_OK, "call");
+  check(isNumber(result, 21), "the result of a call");
+  // only called with numbers by the script, the host may pass anything.
+  check(vm.call(add, {Value(std::string("x")), Value(std::string("y"))}, result) ==
+            INTERPRET_RUNTIME_ERROR, "a call with the wrong types is a runtime error");
+  check(vm.call(add, {Value(1.0), Value(1.0)}, result) == INTERPRET_OK, "a call after an error");
+  Value bump, calls;
+  vm.getGlobal("bump", bump);
+  vm.call(bump, {}, result);
+  vm.call(bump, {}, result);
+  check(vm.getGlobal("calls", calls) && isNumber(calls, 2), "the globals persist");
+  check(!vm.getGlobal("nosuch", calls), "getGlobal of an undefined name");
+
+  // a call to a function the host rebinds isn't inlined.
+  Value main, h;
+  vm.getGlobal("main", main);
+  vm.getGlobal("h", h);
+  check(vm.call(main, {}, result) == INTERPRET_OK && isNumber(result, 11), "before setGlobal");
+  vm.setGlobal("g", h);
+  check(vm.call(main, {}, result) == INTERPRET_OK && isNumber(result, 12), "after setGlobal");
+  vm.setGlobal("g", Value(std::string("not a function")));
+  check(vm.call(main, {}, result) != INTERPRET_OK, "a call to a global which isn't a function");
+}
+
+// a function of `interpret` which main never called was left as a stub.
+void testInterpretStub() {
+  Vm vm;
+  check(vm.interpret("func rule(x) { return x * 2; } func main() { print 1; }") == INTERPRET_OK,
+        "interpret");
+  Value rule, result;
+  check(vm.getGlobal("rule", rule), "getGlobal after interpret");
+  check(vm.call(rule, {Value(21.0)}, result) == INTERPRET_RUNTIME_ERROR,
+        "a stub of interpret is a runtime error");
+}
+
+// apply(f, x) is f(x) + x, the native calls back into the vm.
+bool apply(Vm& vm, NativeArgs args, Value& result) {
+  Value value;
+  if (vm.call(args[0], {args[1]}, value) != INTERPRET_OK) {
+    return false;
+  }
+  // the call grew the stack, the arguments are still there.
+  auto a = std::get_if<double>(&value);
+  auto b = std::get_if<double>(&args[1]);
+  if (!a || !b) {
+    return false;
+  }
+  result = Value(*a + *b);
+  return true;
+}
+
+const char* kCallbackScript = R"(
+func deep(n) {
+    if (n == 0) {
+        return 0;
+    }
+    return deep(n - 1) + 1;
+}
+
+func twice(x) {
+    return apply(deep, x) + x;
+}
+
+func broken(x) {
+    return x + "s";
+}
+
+func outer(x) {
+    var a = 1;
+    var b = apply(twice, x) + a;
+    return b + apply(deep, 2);
+}
+
+func failing(x) {
+    return apply(broken, x);
+}
+
+func main() {
+    if (outer(300) != 1205) {
+        return broken(1);
+    }
+}
+)";
+
+// a native calls a function which calls the native again, the frames
+// of the script below are left as they were.
+void testCallback(const Options& options) {
+  Vm vm(options);
+  vm.defineNative("apply", apply, 2);
+  auto script = vm.compile(kCallbackScript);
+  check(script != nullptr && vm.execute(script) == INTERPRET_OK, "compile a callback");
+  Value outer, failing, result;
+  vm.getGlobal("outer", outer);
+  vm.getGlobal("failing", failing);
+  // apply(twice, 300) is 900 + 300, then 1 and apply(deep, 2) are added.
+  check(vm.call(outer, {Value(300.0)}, result) == INTERPRET_OK && isNumber(result, 1205),
+        "a native calling back into the vm");
+  check(vm.call(failing, {Value(1.0)}, result) != INTERPRET_OK,
+        "an error in a call of a native");
+  check(vm.call(outer, {Value(1.0)}, result) == INTERPRET_OK && isNumber(result, 9),
+        "a callback after an error");
+  // the script runs on the register machine with interpret.
+  Vm interpreted(options);
+  interpreted.defineNative("apply", apply, 2);
+  check(interpreted.interpret(kCallbackScript) == INTERPRET_OK, "a callback of interpret");
+}
+
+} // namespace
+
+int main() {
+  Options plain;
+  testCall(plain);
+  Options optimized;
+  optimized.optimize = true;
+  testCall(optimized);
+  Options registers;
+  registers.registers = true;
+  testCall(registers);
+  testInterpretStub();
+  testCallback(plain);
+  testCallback(optimized);
+  testCallback(registers);
+  std::cout << (failures ? "embedtest failed\n" : "embedtest ok\n");
+  return failures ? 1 : 0;
+}